@@ -0,0 +1,86 @@
+#include "Microbench.hpp"
+#include "Metrics.hpp"
+#include "Logger.hpp"
+#include <iostream>
+#include <string>
+
+/* timings only, dispersion and iteration counts are noisy or chosen by the caller */
+static Metrics medians(const Metrics &metrics)
+{
+    const std::string suffix = ".median_us";
+    Metrics selected;
+    for (const auto &[name, value] : metrics.values())
+    {
+        if (name.size() > suffix.size() && name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0)
+            selected.set(name, value);
+    }
+    return selected;
+}
+
+/*
+ * microbench [PREFIX|all] [--iterations N] [--json FILE] [--baseline FILE] [--threshold PERCENT]:
+ * every registered case warm, then with evicted caches. Medians that grew past threshold
+ * percent over the baseline fail the run.
+ */
+int main(int argc, char **argv)
+{
+    try
+    {
+        Log::init();
+        Microbench::Options options;
+        std::string jsonPath;
+        std::string baselinePath;
+        double threshold = 10.0;
+        for (int i = 1; i < argc; i++)
+        {
+            std::string arg{argv[i]};
+            if (arg == "--iterations" && i + 1 < argc)
+                options.iterations = std::stoul(argv[++i]);
+            else if (arg == "--json" && i + 1 < argc)
+                jsonPath = argv[++i];
+            else if (arg == "--baseline" && i + 1 < argc)
+                baselinePath = argv[++i];
+            else if (arg == "--threshold" && i + 1 < argc)
+                threshold = std::stod(argv[++i]);
+            else
+                options.filter = arg;
+        }
+
+        Metrics metrics;
+        for (bool cold : {false, true})
+        {
+            options.cold = cold;
+            for (const Microbench::Result &result : Microbench::run(options))
+            {
+                std::string key = result.name + (cold ? ".cold" : ".warm");
+                metrics.set(key + ".median_us", result.medianUs);
+                metrics.set(key + ".mad_us", result.madUs);
+                metrics.set(key + ".min_us", result.minUs);
+                metrics.set(key + ".iterations", result.iterations);
+            }
+        }
+        if (!jsonPath.empty())
+        {
+            metrics.write(jsonPath);
+            Log(Logger::info) << "Microbench results written to " << jsonPath;
+        }
+
+        uint32_t failures = 0;
+        if (!baselinePath.empty())
+        {
+            for (const std::string &regression : medians(metrics).regressions(medians(Metrics::read(baselinePath)), threshold / 100.0))
+            {
+                Log(Logger::error) << "Regression " << regression;
+                failures++;
+            }
+        }
+        Log::shutdown();
+        return failures ? 1 : 0;
+    }
+    catch (const std::exception &e)
+    {
+        Log::shutdown();
+        std::cerr << "\033[1;31" << e.what() << "\033[0m" << '\n';
+        return 1;
+    }
+}
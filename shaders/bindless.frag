@@ -0,0 +1,15 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
+layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec2 fragTexCoord;
+layout(location = 2) flat in uint fragMaterial;
+
+layout(location = 0) out vec4 outColor;
+
+layout(set = 1, binding = 0) uniform sampler texSampler;
+layout(set = 1, binding = 1) uniform texture2D textures[];
+
+void main() {
+    outColor = texture(sampler2D(textures[nonuniformEXT(fragMaterial)], texSampler), fragTexCoord);
+}
@@ -1,20 +1,30 @@
 #version 450
 
 layout(binding = 0) uniform UniformBufferObject {
-    mat4 model;
     mat4 view;
     mat4 proj;
 } ubo;
 
+layout(std430, binding = 2) readonly buffer Instances {
+    mat4 model[];
+} instances;
+
+layout(push_constant) uniform PushConstants {
+    uint objectId;
+    uint materialIndex;
+} object;
+
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inColor;
 layout(location = 2) in vec2 texCoord;
 
 layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec2 fragTexCoord;
+layout(location = 2) flat out uint fragMaterial;
 
 void main() {
-    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 1.0);
+    gl_Position = ubo.proj * ubo.view * instances.model[object.objectId] * vec4(inPosition, 1.0);
     fragColor = inColor;
     fragTexCoord = texCoord;
-}
\ No newline at end of file
+    fragMaterial = object.materialIndex;
+}
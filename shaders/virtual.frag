@@ -0,0 +1,42 @@
+#version 450
+
+layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec2 fragTexCoord;
+
+layout(location = 0) out vec4 outColor;
+
+layout(set = 1, binding = 0) uniform usampler2D pageTable;
+layout(set = 1, binding = 1) uniform sampler2D tileCache;
+layout(std430, set = 1, binding = 2) writeonly buffer Feedback {
+    uint requested[];
+} feedback;
+layout(set = 1, binding = 3) uniform VirtualTexture {
+    vec2 size;
+    float tileSize;
+    float border;
+    vec2 cacheSize;
+    uint levelCount;
+    uint padding;
+    /* first page, pages per row, rows, first row in the page table */
+    uvec4 levels[16];
+} vt;
+
+void main() {
+    vec2 texel = fract(fragTexCoord) * vt.size;
+    vec2 dx = dFdx(texel);
+    vec2 dy = dFdy(texel);
+    float lod = 0.5 * log2(max(max(dot(dx, dx), dot(dy, dy)), 1e-8));
+    uint level = uint(clamp(floor(lod), 0.0, float(vt.levelCount - 1u)));
+
+    /* the page this pixel wants, the host loads it if it is missing */
+    uvec4 info = vt.levels[level];
+    uvec2 page = min(uvec2(texel / (vt.tileSize * float(1u << level))), info.yz - 1u);
+    feedback.requested[info.x + page.y * info.y + page.x] = 1u;
+
+    /* the entry names the cache tile and the level of the page or of its nearest resident ancestor */
+    uvec4 entry = texelFetch(pageTable, ivec2(page.x, info.w + page.y), 0);
+    vec2 inTile = fract(texel / (vt.tileSize * float(1u << entry.z)));
+    float slot = vt.tileSize + 2.0 * vt.border;
+    vec2 cached = vec2(entry.xy) * slot + vt.border + inTile * vt.tileSize;
+    outColor = textureLod(tileCache, cached / vt.cacheSize, 0.0);
+}
@@ -0,0 +1,74 @@
+#include "AssetWatcher.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include "Logger.hpp"
+
+bool AssetWatcher::init()
+{
+    fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0)
+        Log(Logger::warn) << "inotify unavailable: " << strerror(errno);
+    return fd >= 0;
+}
+
+void AssetWatcher::destroy()
+{
+    if (fd >= 0)
+        close(fd);
+    fd = -1;
+    files.clear();
+    directories.clear();
+}
+
+void AssetWatcher::watch(const std::string &path)
+{
+    if (fd < 0)
+        return;
+    std::filesystem::path file{path};
+    std::string directory = file.parent_path().empty() ? "." : file.parent_path().string();
+
+    auto found = directories.find(directory);
+    int wd = found != directories.end() ? found->second : -1;
+    if (wd < 0)
+    {
+        /* close write catches in place saves, moved to catches files renamed over the old one */
+        wd = inotify_add_watch(fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (wd < 0)
+        {
+            Log(Logger::warn) << "Cannot watch " << directory << ": " << strerror(errno);
+            return;
+        }
+        directories[directory] = wd;
+    }
+    files[{wd, file.filename().string()}] = path;
+    Log(Logger::debug) << "Watching " << path;
+}
+
+std::vector<std::string> AssetWatcher::poll()
+{
+    std::vector<std::string> changed;
+    if (fd < 0)
+        return changed;
+    alignas(inotify_event) char events[4096];
+    while (true)
+    {
+        ssize_t length = read(fd, events, sizeof(events));
+        if (length <= 0)
+            break;
+        for (ssize_t offset = 0; offset < length;)
+        {
+            const inotify_event *event = reinterpret_cast<const inotify_event *>(events + offset);
+            offset += sizeof(inotify_event) + event->len;
+            if (!event->len)
+                continue;
+            auto file = files.find({event->wd, event->name});
+            if (file != files.end() && std::find(changed.begin(), changed.end(), file->second) == changed.end())
+                changed.push_back(file->second);
+        }
+    }
+    return changed;
+}
@@ -0,0 +1,33 @@
+#ifndef ASSETWATCHER_HPP
+#define ASSETWATCHER_HPP
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+ * Reports files that were rewritten. The directory of every file is watched rather
+ * than the file itself, editors and compilers often write a new file and rename it
+ * over the old one, which a watch on the old inode would never see.
+ */
+class AssetWatcher {
+public:
+    /* false when inotify is unavailable */
+    bool init();
+    void destroy();
+    bool active() const { return fd >= 0; };
+
+    /* path is reported exactly as given */
+    void watch(const std::string &path);
+    /* never blocks, every path at most once per call */
+    std::vector<std::string> poll();
+
+private:
+    int fd = -1;
+    /* watch descriptor and file name to the watched path */
+    std::map<std::pair<int, std::string>, std::string> files;
+    std::map<std::string, int> directories;
+};
+
+#endif
@@ -0,0 +1,56 @@
+#include "Camera.hpp"
+#include <memory>
+#include <vector>
+#include <glm/gtc/matrix_transform.hpp>
+#include "Scene.hpp"
+#include "Microbench.hpp"
+
+UniformBufferObject Camera::uniforms(const SceneSnapshot &snapshot, float aspect, glm::vec3 &eye)
+{
+    glm::mat4 orbit = glm::rotate(glm::mat4(1.0f), snapshot.orbitAngle, glm::vec3(0.0f, 1.0f, 0.0f));
+    eye = glm::vec3(orbit * glm::vec4(5.0f, 5.0f, 0.0f, 1.0f));
+
+    UniformBufferObject ubo{};
+    ubo.view = glm::lookAt(eye, glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    ubo.proj = glm::perspective(glm::radians(FOV_DEGREES), aspect, NEAR_PLANE, FAR_PLANE);
+    ubo.proj[1][1] *= -1;
+    return ubo;
+}
+
+/*
+ * The matrices of one frame: camera, the turning pivots and the scene update into a heap
+ * buffer standing in for the mapped instance region. The grid matches App::makeDrawList.
+ */
+static bool matricesRegistered = Microbench::add("camera.matrices", [] {
+    const uint32_t draws = 1024;
+    const uint32_t spinStride = 8;
+    auto scene = std::make_shared<Scene>();
+    auto pivots = std::make_shared<std::vector<std::pair<uint32_t, glm::vec3>>>();
+    uint32_t root = scene->addNode(Scene::ROOT, glm::mat4(1.0f));
+    for (uint32_t i = 0; i < draws; i++)
+    {
+        glm::vec3 position(8.0f * (i % 32), 0.0f, 8.0f * (i / 32));
+        if (i % spinStride == 0)
+        {
+            pivots->push_back({scene->addNode(root, glm::translate(glm::mat4(1.0f), position)), position});
+            scene->addNode(pivots->back().first, glm::mat4(1.0f));
+        }
+        else
+            scene->addNode(root, glm::translate(glm::mat4(1.0f), position));
+    }
+    auto instances = std::make_shared<std::vector<glm::mat4>>(size_t(scene->size()) * MAX_FRAMES_IN_FLIGHT);
+    auto snapshot = std::make_shared<SceneSnapshot>();
+    auto frame = std::make_shared<uint32_t>(0);
+    return Microbench::Body{[scene, pivots, instances, snapshot, frame] {
+        snapshot->orbitAngle -= 0.01f;
+        snapshot->spinAngle += 0.02f;
+        glm::vec3 eye;
+        UniformBufferObject ubo = Camera::uniforms(*snapshot, 16.0f / 9.0f, eye);
+        for (const auto &[node, position] : *pivots)
+            scene->setLocal(node, glm::rotate(glm::translate(glm::mat4(1.0f), position), snapshot->spinAngle, glm::vec3(0.0f, 1.0f, 0.0f)));
+        uint32_t slot = (*frame)++ % MAX_FRAMES_IN_FLIGHT;
+        scene->update(slot, instances->data() + size_t(slot) * scene->size());
+        Microbench::keep(ubo);
+        Microbench::keep(instances->data());
+    }};
+});
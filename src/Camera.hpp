@@ -0,0 +1,21 @@
+#ifndef CAMERA_HPP
+#define CAMERA_HPP
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+#include "SceneState.hpp"
+#include "UniformBufferObject.hpp"
+
+/* camera orbiting the origin, derived from the simulation state every frame */
+class Camera {
+public:
+    static constexpr float FOV_DEGREES = 90.0f;
+    static constexpr float NEAR_PLANE = 0.1f;
+    static constexpr float FAR_PLANE = 30.0f;
+
+    /* view and projection for width / height aspect, eye receives the camera position */
+    static UniformBufferObject uniforms(const SceneSnapshot &snapshot, float aspect, glm::vec3 &eye);
+};
+
+#endif
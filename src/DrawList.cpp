@@ -0,0 +1,57 @@
+#include "DrawList.hpp"
+#include <cstring>
+#include "Microbench.hpp"
+
+void sortDrawList(DrawList &draws, DrawList &scratch)
+{
+    size_t count = draws.size();
+    if (count < 2)
+        return;
+    scratch.resize(count);
+
+    /* histograms of all eight digits in one read of the keys */
+    uint32_t histograms[8][256];
+    memset(histograms, 0, sizeof(histograms));
+    for (const DrawCommand &draw : draws)
+        for (int digit = 0; digit < 8; digit++)
+            histograms[digit][(draw.sortKey >> (digit * 8)) & 0xFF]++;
+
+    DrawList *src = &draws;
+    DrawList *dst = &scratch;
+    for (int digit = 0; digit < 8; digit++)
+    {
+        uint32_t *histogram = histograms[digit];
+        uint32_t firstByte = (src->front().sortKey >> (digit * 8)) & 0xFF;
+        if (histogram[firstByte] == count)
+            continue;
+
+        uint32_t offsets[256];
+        uint32_t sum = 0;
+        for (int bucket = 0; bucket < 256; bucket++)
+        {
+            offsets[bucket] = sum;
+            sum += histogram[bucket];
+        }
+        for (const DrawCommand &draw : *src)
+            (*dst)[offsets[(draw.sortKey >> (digit * 8)) & 0xFF]++] = draw;
+        std::swap(src, dst);
+    }
+    if (src != &draws)
+        draws.swap(scratch);
+}
+
+static bool sortRegistered = Microbench::add("drawlist.sort", [] {
+    DrawList unsorted(10000);
+    uint64_t state = 0x9E3779B97F4A7C15ull;
+    for (DrawCommand &draw : unsorted)
+    {
+        state = state * 6364136223846793005ull + 1442695040888963407ull;
+        draw.sortKey = SortKey::pack(0, 0, uint32_t(state >> 48) & 0xFF, 0, uint32_t(state >> 20));
+    }
+    return Microbench::Body{[unsorted] {
+        DrawList draws = unsorted;
+        DrawList scratch;
+        sortDrawList(draws, scratch);
+        Microbench::keep(draws.data());
+    }};
+});
@@ -0,0 +1,43 @@
+#ifndef DRAWLIST_HPP
+#define DRAWLIST_HPP
+
+#include <cstdint>
+#include <vector>
+#include "UniformBufferObject.hpp"
+
+/*
+ * Draw order packed most significant first: pass 4 bits, pipeline 8, material 16,
+ * mesh 16, depth bucket 20. Sorting by key groups draws that share bound state.
+ */
+struct SortKey
+{
+    static constexpr uint32_t DEPTH_BITS = 20;
+    static constexpr uint32_t DEPTH_BUCKETS = 1u << DEPTH_BITS;
+
+    static uint64_t pack(uint32_t pass, uint32_t pipeline, uint32_t material, uint32_t mesh, uint32_t depth)
+    {
+        return (uint64_t(pass & 0xF) << 60) | (uint64_t(pipeline & 0xFF) << 52) | (uint64_t(material & 0xFFFF) << 36)
+             | (uint64_t(mesh & 0xFFFF) << 20) | uint64_t(depth & (DEPTH_BUCKETS - 1));
+    }
+    static uint32_t pass(uint64_t key) { return uint32_t(key >> 60); };
+    static uint32_t pipeline(uint64_t key) { return uint32_t(key >> 52) & 0xFF; };
+    static uint32_t material(uint64_t key) { return uint32_t(key >> 36) & 0xFFFF; };
+    static uint32_t mesh(uint64_t key) { return uint32_t(key >> 20) & 0xFFFF; };
+    static uint32_t depth(uint64_t key) { return uint32_t(key) & (DEPTH_BUCKETS - 1); };
+};
+
+struct DrawCommand
+{
+    uint64_t sortKey = 0;
+    uint32_t indexCount;
+    uint32_t firstIndex;
+    int32_t vertexOffset;
+    PushConstants object;
+};
+
+using DrawList = std::vector<DrawCommand>;
+
+/* stable LSD radix sort on sortKey, one byte per pass, passes where every key shares the byte are skipped */
+void sortDrawList(DrawList &draws, DrawList &scratch);
+
+#endif
@@ -0,0 +1,18 @@
+#include "FileRead.hpp"
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+
+void readAll(int fd, void *destination, size_t size, uint64_t offset, const char *what)
+{
+    char *dst = static_cast<char *>(destination);
+    while (size > 0)
+    {
+        ssize_t count = pread(fd, dst, size, static_cast<off_t>(offset));
+        if (count <= 0)
+            throw std::runtime_error(std::string("Failed to read ") + what);
+        dst += count;
+        size -= count;
+        offset += count;
+    }
+}
@@ -0,0 +1,14 @@
+#ifndef FILEREAD_HPP
+#define FILEREAD_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Reads size bytes at offset with pread, which leaves the file position alone so
+ * job workers can share one descriptor. Throws "Failed to read <what>" when the
+ * file ends early or the read fails.
+ */
+void readAll(int fd, void *destination, size_t size, uint64_t offset, const char *what);
+
+#endif
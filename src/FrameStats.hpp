@@ -0,0 +1,39 @@
+#ifndef FRAMESTATS_HPP
+#define FRAMESTATS_HPP
+
+#include <vector>
+#include <algorithm>
+#include <numeric>
+#include <cstddef>
+
+/* collects timing samples (milliseconds) and summarizes them */
+class FrameStats {
+private:
+    std::vector<double> samples;
+
+public:
+    void add(double ms) { samples.push_back(ms); }
+    void clear() { samples.clear(); }
+    size_t count() const { return samples.size(); }
+
+    double mean() const
+    {
+        if (samples.empty())
+            return 0.0;
+        return std::accumulate(samples.begin(), samples.end(), 0.0) / samples.size();
+    }
+
+    double percentile(double p) const
+    {
+        if (samples.empty())
+            return 0.0;
+        std::vector<double> sorted = samples;
+        size_t index = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+        std::nth_element(sorted.begin(), sorted.begin() + index, sorted.end());
+        return sorted[index];
+    }
+
+    double median() const { return percentile(0.5); }
+};
+
+#endif
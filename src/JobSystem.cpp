@@ -0,0 +1,310 @@
+#include "JobSystem.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+#include "Logger.hpp"
+
+struct Job
+{
+    Jobs::JobFn fn;
+    JobCounter *counter;
+};
+
+void Jobs::init(uint32_t threads)
+{
+    shutdown();
+    if (threads == 0)
+    {
+        unsigned hardware = std::thread::hardware_concurrency();
+        threads = hardware > 1 ? hardware - 1 : 1;
+    }
+    mainThread = std::this_thread::get_id();
+    workerIndex = 0;
+    stopping = false;
+
+    /* every deque exists before the first thief starts */
+    for (uint32_t i = 0; i <= threads; i++)
+        workerList.push_back(std::make_unique<Worker>());
+    for (uint32_t i = 1; i <= threads; i++)
+        workerList[i]->thread = std::thread(&Jobs::workerLoop, static_cast<int>(i));
+    Log(Logger::debug) << "Job system started with " << threads << " worker threads";
+}
+
+void Jobs::shutdown()
+{
+    if (workerList.empty())
+        return;
+    stopping = true;
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+    }
+    wake.notify_all();
+    for (auto &worker : workerList)
+        if (worker->thread.joinable())
+            worker->thread.join();
+
+    /* whatever is left still has to signal its counters */
+    while (Job *job = take())
+        execute(job);
+    pumpMain();
+    workerList.clear();
+    workerIndex = -1;
+}
+
+void Jobs::workerLoop(int index)
+{
+    workerIndex = index;
+    while (true)
+    {
+        if (Job *job = take())
+        {
+            execute(job);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        sleeping++;
+        wake.wait(lock, [] { return stopping.load() || queued.load() > 0; });
+        sleeping--;
+        if (stopping)
+            return;
+    }
+}
+
+void Jobs::enqueue(Job *job)
+{
+    /* counted before it becomes visible so a thief never takes queued below zero */
+    queued++;
+    if (workerIndex < 0 || !workerList[workerIndex]->deque.push(job))
+    {
+        std::lock_guard<std::mutex> lock(injectedMutex);
+        injected.push_back(job);
+    }
+    if (sleeping.load() > 0)
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+        }
+        wake.notify_one();
+    }
+}
+
+Job *Jobs::take()
+{
+    Job *job = nullptr;
+    if (workerIndex >= 0)
+        job = workerList[workerIndex]->deque.pop();
+    if (!job)
+    {
+        std::lock_guard<std::mutex> lock(injectedMutex);
+        if (!injected.empty())
+        {
+            job = injected.front();
+            injected.pop_front();
+        }
+    }
+    size_t count = workerList.size();
+    size_t start = workerIndex >= 0 ? workerIndex + 1 : 0;
+    for (size_t i = 0; !job && i < count; i++)
+    {
+        size_t victim = (start + i) % count;
+        if (static_cast<int>(victim) != workerIndex)
+            job = workerList[victim]->deque.steal();
+    }
+    if (job)
+        queued--;
+    return job;
+}
+
+void Jobs::execute(Job *job)
+{
+    std::exception_ptr failure;
+    try
+    {
+        job->fn();
+    }
+    catch (...)
+    {
+        failure = std::current_exception();
+    }
+    JobCounter *counter = job->counter;
+    delete job;
+    finish(counter, failure);
+}
+
+void Jobs::finish(JobCounter *counter, std::exception_ptr failure)
+{
+    if (!counter)
+    {
+        if (failure)
+        {
+            try
+            {
+                std::rethrow_exception(failure);
+            }
+            catch (const std::exception &e)
+            {
+                Log(Logger::error) << "Job failed: " << e.what();
+            }
+            catch (...)
+            {
+                Log(Logger::error) << "Job failed";
+            }
+        }
+        return;
+    }
+
+    /* decremented under the lock, wait and spawnAfter observe pending and continuations together */
+    std::vector<Job *> ready;
+    {
+        std::lock_guard<std::mutex> lock(counter->mutex);
+        if (failure && !counter->failure)
+            counter->failure = failure;
+        if (counter->pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            ready.swap(counter->continuations);
+    }
+    for (Job *job : ready)
+    {
+        if (workerList.empty())
+            execute(job);
+        else
+            enqueue(job);
+    }
+}
+
+void Jobs::spawn(JobFn fn, JobCounter *counter)
+{
+    if (counter)
+        counter->pending.fetch_add(1, std::memory_order_relaxed);
+    Job *job = new Job{std::move(fn), counter};
+    if (workerList.empty())
+        execute(job);
+    else
+        enqueue(job);
+}
+
+void Jobs::spawnAfter(JobCounter &dependency, JobFn fn, JobCounter *counter)
+{
+    if (counter)
+        counter->pending.fetch_add(1, std::memory_order_relaxed);
+    Job *job = new Job{std::move(fn), counter};
+    {
+        std::lock_guard<std::mutex> lock(dependency.mutex);
+        if (dependency.pending.load(std::memory_order_acquire) != 0)
+        {
+            dependency.continuations.push_back(job);
+            return;
+        }
+    }
+    if (workerList.empty())
+        execute(job);
+    else
+        enqueue(job);
+}
+
+void Jobs::wait(JobCounter &counter)
+{
+    bool onMain = std::this_thread::get_id() == mainThread;
+    while (true)
+    {
+        if (counter.done())
+        {
+            /* the last finisher may still hold the lock, the counter can die right after this */
+            std::exception_ptr failure;
+            {
+                std::lock_guard<std::mutex> lock(counter.mutex);
+                failure = counter.failure;
+                counter.failure = nullptr;
+            }
+            if (failure)
+                std::rethrow_exception(failure);
+            return;
+        }
+        if (onMain)
+            pumpMain();
+        if (Job *job = take())
+            execute(job);
+        else
+            std::this_thread::yield();
+    }
+}
+
+void Jobs::parallelFor(size_t count, size_t grain, const std::function<void(size_t first, size_t last)> &fn)
+{
+    grain = std::max<size_t>(grain, 1);
+    JobCounter counter;
+    for (size_t first = 0; first < count; first += grain)
+    {
+        size_t last = std::min(count, first + grain);
+        spawn([&fn, first, last] { fn(first, last); }, &counter);
+    }
+    wait(counter);
+}
+
+void Jobs::runOnMain(JobFn fn, JobCounter *counter)
+{
+    if (counter)
+        counter->pending.fetch_add(1, std::memory_order_relaxed);
+    Job *job = new Job{std::move(fn), counter};
+    if (workerList.empty() || std::this_thread::get_id() == mainThread)
+        execute(job);
+    else
+        mainJobs.push(job);
+}
+
+void Jobs::pumpMain()
+{
+    if (workerList.empty())
+        return;
+    if (std::this_thread::get_id() != mainThread)
+        throw std::runtime_error("Main thread jobs pumped from another thread");
+    Job *job;
+    while (mainJobs.pop(job))
+        execute(job);
+}
+
+void Jobs::benchmark(uint32_t tasks)
+{
+    auto work = [](size_t task) {
+        double sum = 0.0;
+        for (size_t i = 1; i <= 20000; i++)
+            sum += std::sqrt(static_cast<double>(task * i));
+        return sum;
+    };
+    auto elapsed = [](std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    };
+    std::vector<double> threaded(tasks), spawned(tasks), ranged(tasks);
+
+    /* one thread per task, started in waves so large counts stay under the thread limit */
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t wave = 0; wave < tasks; wave += 256)
+    {
+        std::vector<std::thread> threads;
+        for (uint32_t i = wave; i < std::min(tasks, wave + 256); i++)
+            threads.emplace_back([&, i] { threaded[i] = work(i); });
+        for (auto &thread : threads)
+            thread.join();
+    }
+    double threadMs = elapsed(start);
+
+    start = std::chrono::steady_clock::now();
+    JobCounter counter;
+    for (uint32_t i = 0; i < tasks; i++)
+        spawn([&, i] { spawned[i] = work(i); }, &counter);
+    wait(counter);
+    double spawnMs = elapsed(start);
+
+    start = std::chrono::steady_clock::now();
+    parallelFor(tasks, 16, [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; i++)
+            ranged[i] = work(i);
+    });
+    double rangeMs = elapsed(start);
+
+    if (threaded != spawned || threaded != ranged)
+        throw std::runtime_error("Job benchmark results differ");
+    Log(Logger::info) << "Jobs tasks " << tasks << " workers " << workers()
+                      << " thread per task " << threadMs << " ms spawn " << spawnMs
+                      << " ms parallel for " << rangeMs << " ms";
+}
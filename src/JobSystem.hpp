@@ -0,0 +1,97 @@
+#ifndef JOBSYSTEM_HPP
+#define JOBSYSTEM_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+#include "WorkStealingDeque.hpp"
+#include "MpscQueue.hpp"
+
+struct Job;
+
+/*
+ * Outstanding jobs spawned against it, jobs scheduled with spawnAfter start once it
+ * drops to zero. The first exception thrown by one of its jobs is rethrown by wait.
+ */
+class JobCounter {
+public:
+    JobCounter() = default;
+    JobCounter(const JobCounter &) = delete;
+    JobCounter &operator=(const JobCounter &) = delete;
+
+    bool done() const { return pending.load(std::memory_order_acquire) == 0; };
+
+private:
+    friend class Jobs;
+    std::atomic<uint32_t> pending{0};
+    std::mutex mutex;
+    std::vector<Job *> continuations;
+    std::exception_ptr failure;
+};
+
+/*
+ * Work-stealing scheduler. Every worker owns a Chase-Lev deque, idle workers steal
+ * from the others. The thread calling init is worker 0 and only runs jobs while it
+ * waits, other threads submit through a shared queue. Without init jobs run inline.
+ */
+class Jobs {
+public:
+    using JobFn = std::function<void()>;
+
+    /* 0 starts one worker per hardware thread besides the caller */
+    static void init(uint32_t threads = 0);
+    static void shutdown();
+    static uint32_t workers() { return static_cast<uint32_t>(workerList.size()); };
+
+    static void spawn(JobFn fn, JobCounter *counter = nullptr);
+    static void spawnAfter(JobCounter &dependency, JobFn fn, JobCounter *counter = nullptr);
+    /* runs other jobs until the counter reaches zero */
+    static void wait(JobCounter &counter);
+    /* splits [0, count) into ranges of at most grain items and waits for all of them */
+    static void parallelFor(size_t count, size_t grain, const std::function<void(size_t first, size_t last)> &fn);
+
+    /* GLFW may only be called from the main thread, jobs queue those calls here */
+    static void runOnMain(JobFn fn, JobCounter *counter = nullptr);
+    /* main thread only, runs the queued main thread jobs */
+    static void pumpMain();
+
+    /* logs the scheduler against one std::thread per task */
+    static void benchmark(uint32_t tasks);
+
+private:
+    struct Worker
+    {
+        WorkStealingDeque<Job> deque;
+        std::thread thread;
+    };
+
+    inline static std::vector<std::unique_ptr<Worker>> workerList;
+    inline static std::thread::id mainThread;
+    inline static thread_local int workerIndex = -1;
+
+    /* jobs spawned from threads without a deque */
+    inline static std::mutex injectedMutex;
+    inline static std::deque<Job *> injected;
+    inline static MpscQueue<Job *> mainJobs;
+
+    inline static std::mutex sleepMutex;
+    inline static std::condition_variable wake;
+    inline static std::atomic<uint32_t> queued{0};
+    inline static std::atomic<uint32_t> sleeping{0};
+    inline static std::atomic<bool> stopping{false};
+
+    static void workerLoop(int index);
+    static void enqueue(Job *job);
+    static Job *take();
+    static void execute(Job *job);
+    static void finish(JobCounter *counter, std::exception_ptr failure);
+};
+
+#endif
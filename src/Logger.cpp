@@ -1,15 +1,219 @@
 #include "Logger.hpp"
-#include <ctime>
+#include "MpscQueue.hpp"
+#include <fstream>
+#include <iomanip>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdlib>
+#include <stdexcept>
+
+namespace
+{
+    MpscQueue<Log::Record> queue;
+    std::thread thread;
+    std::atomic<bool> running{false};
+    std::atomic<uint64_t> pushed{0};
+    std::atomic<uint64_t> written{0};
+    /* set by the worker before it blocks, producers only take the lock when it is set */
+    std::atomic<bool> sleeping{false};
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+    bool toConsole = true;
+    std::ofstream file;
+    const auto start = std::chrono::steady_clock::now();
+}
 
 std::ostream& operator<<(std::ostream& os, const Logger& log)
 {
     if (log == Logger::reset)
     {
         os << "\033[0m\n";
-        return os;    
+        return os;
     }
-    std::time_t t = std::time(0);
-    std::tm* now = std::localtime(&t);
-    os << level[log] << "[" << now->tm_hour << ":" << (now->tm_min < 10 ? "0" : "") <<now->tm_min << ":" << (now->tm_sec < 10 ? "0" : "") << now->tm_sec << "] ";
+    os << level[log];
     return os;
-}
\ No newline at end of file
+}
+
+static void writeBody(std::ostream &os, const Log::Record &record)
+{
+    double seconds = std::chrono::duration<double>(record.time - start).count();
+    std::ios::fmtflags flags = os.flags();
+    os << "[" << std::fixed << std::setprecision(6) << std::setw(12) << seconds << "] ";
+    os.flags(flags);
+    if (record.format)
+        record.format(os);
+    else
+        os << record.text;
+}
+
+void Log::write(const Record &record)
+{
+    if (toConsole)
+    {
+        std::cout << record.lvl;
+        writeBody(std::cout, record);
+        std::cout << Logger::reset;
+    }
+    if (file.is_open())
+    {
+        writeBody(file, record);
+        file << '\n';
+    }
+}
+
+static void wakeWorker()
+{
+    std::lock_guard<std::mutex> lock(wakeMutex);
+    sleeping.store(false, std::memory_order_relaxed);
+    wake.notify_one();
+}
+
+/* the fences pair with the ones in enqueue, either the worker sees the record or the producer sees it sleeping */
+static void sleepWorker()
+{
+    std::unique_lock<std::mutex> lock(wakeMutex);
+    sleeping.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!queue.empty() || !running.load(std::memory_order_acquire))
+    {
+        sleeping.store(false, std::memory_order_relaxed);
+        return;
+    }
+    wake.wait(lock, [] { return !sleeping.load(std::memory_order_relaxed); });
+}
+
+void Log::drain()
+{
+    Record record;
+    bool any = false;
+    while (queue.pop(record))
+    {
+        write(record);
+        written.fetch_add(1, std::memory_order_release);
+        any = true;
+    }
+    if (any)
+    {
+        std::cout.flush();
+        if (file.is_open())
+            file.flush();
+    }
+}
+
+void Log::worker()
+{
+    while (running.load(std::memory_order_acquire))
+    {
+        drain();
+        sleepWorker();
+    }
+    drain();
+}
+
+void Log::init(bool console, const std::string &path)
+{
+    if (running.load())
+        return;
+    toConsole = console;
+    if (!path.empty())
+    {
+        file.open(path, std::ios::out | std::ios::trunc);
+        if (!file.is_open())
+            throw std::runtime_error("Failed to open log file");
+    }
+    if (const char *env = std::getenv("SCOP_LOG"))
+        setMask(std::string(env));
+    running.store(true, std::memory_order_release);
+    thread = std::thread(worker);
+}
+
+void Log::shutdown()
+{
+    if (!running.exchange(false))
+        return;
+    wakeWorker();
+    thread.join();
+    /* records pushed by threads that still saw the worker running */
+    drain();
+    if (file.is_open())
+        file.close();
+}
+
+void Log::flush()
+{
+    if (!running.load(std::memory_order_acquire))
+        return;
+    uint64_t target = pushed.load(std::memory_order_acquire);
+    while (written.load(std::memory_order_acquire) < target)
+        std::this_thread::yield();
+}
+
+void Log::setLevel(Logger lvl, bool enable)
+{
+    if (enable)
+        mask.fetch_or(1u << lvl, std::memory_order_relaxed);
+    else
+        mask.fetch_and(~(1u << lvl), std::memory_order_relaxed);
+}
+
+void Log::setMask(uint32_t newMask)
+{
+    mask.store(newMask, std::memory_order_relaxed);
+}
+
+/* comma separated list, e.g. "warn,error" */
+void Log::setMask(const std::string &levels)
+{
+    const std::string names[4] = {"info", "debug", "warn", "error"};
+    uint32_t newMask = 0;
+    std::stringstream ss{levels};
+    for (std::string item; std::getline(ss, item, ',');)
+    {
+        for (int i = 0; i < 4; i++)
+            if (item == names[i])
+                newMask |= 1u << i;
+    }
+    setMask(newMask);
+}
+
+void Log::enqueue(Record record)
+{
+    record.time = std::chrono::steady_clock::now();
+    if (!running.load(std::memory_order_acquire))
+    {
+        write(record);
+        return;
+    }
+    pushed.fetch_add(1, std::memory_order_release);
+    queue.push(std::move(record));
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleeping.load(std::memory_order_relaxed))
+        wakeWorker();
+}
+
+void Log::push(Logger lvl, std::string text)
+{
+    if (!enabled(lvl))
+        return;
+    Record record;
+    record.lvl = lvl;
+    record.text = std::move(text);
+    enqueue(std::move(record));
+}
+
+void Log::deferred(Logger lvl, std::function<void(std::ostream &)> format)
+{
+    if (!enabled(lvl))
+        return;
+    Record record;
+    record.lvl = lvl;
+    record.format = std::move(format);
+    enqueue(std::move(record));
+}
+
+Log::~Log()
+{
+    if (active)
+        push(lvl, stream.str());
+}
@@ -3,14 +3,78 @@
 
 #include <iostream>
 #include <ostream>
+#include <sstream>
+#include <string>
+#include <functional>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 enum loglevel {
-    info, debug, warn, error, reset 
+    info, debug, warn, error, reset
 };
 
 const std::string level[4] = {"\033[32m", "\033[36m", "\033[33m", "\033[1m\033[31m"};
 
-using Logger = loglevel; 
+using Logger = loglevel;
 
 std::ostream& operator<<(std::ostream& os, const Logger& log);
 
-#endif
\ No newline at end of file
+/*
+ * Asynchronous logger: callers only build a record and push it into a lock-free
+ * queue, a background thread formats timestamps and writes to the sinks.
+ * Usage: Log(Logger::info) << "text " << value;
+ */
+class Log {
+public:
+    struct Record
+    {
+        Logger lvl = Logger::info;
+        std::chrono::steady_clock::time_point time;
+        std::string text;
+        std::function<void(std::ostream &)> format;
+    };
+
+    static void init(bool console = true, const std::string &file = "");
+    static void shutdown();
+    static void flush();
+
+    /* runtime filtering, one bit per level */
+    static void setLevel(Logger lvl, bool enabled);
+    static void setMask(uint32_t mask);
+    static void setMask(const std::string &levels);
+    static bool enabled(Logger lvl)
+    {
+        return mask.load(std::memory_order_relaxed) & (1u << lvl);
+    }
+
+    static void push(Logger lvl, std::string text);
+    /* the formatter runs on the logging thread, captures must be by value */
+    static void deferred(Logger lvl, std::function<void(std::ostream &)> format);
+
+    explicit Log(Logger lvl) : lvl(lvl), active(enabled(lvl)) {};
+    ~Log();
+    Log(const Log &) = delete;
+    Log &operator=(const Log &) = delete;
+
+    template <typename T>
+    Log &operator<<(const T &value)
+    {
+        if (active)
+            stream << value;
+        return *this;
+    }
+
+private:
+    inline static std::atomic<uint32_t> mask{0xF};
+
+    Logger lvl;
+    bool active;
+    std::ostringstream stream;
+
+    static void enqueue(Record record);
+    static void write(const Record &record);
+    static void drain();
+    static void worker();
+};
+
+#endif
@@ -0,0 +1,77 @@
+#include "Metrics.hpp"
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+void Metrics::set(const std::string &name, double value)
+{
+    for (auto &entry : entries)
+    {
+        if (entry.first == name)
+        {
+            entry.second = value;
+            return;
+        }
+    }
+    entries.emplace_back(name, value);
+}
+
+void Metrics::write(const std::string &path) const
+{
+    std::ofstream file(path);
+    if (!file.is_open())
+        throw std::runtime_error("Failed to open " + path);
+    file << std::setprecision(6) << "{\n";
+    for (size_t i = 0; i < entries.size(); i++)
+        file << "    \"" << entries[i].first << "\": " << entries[i].second << (i + 1 < entries.size() ? ",\n" : "\n");
+    file << "}\n";
+}
+
+/* only reads what write produces, string keys with number values */
+Metrics Metrics::read(const std::string &path)
+{
+    std::ifstream file(path);
+    if (!file.is_open())
+        throw std::runtime_error("Failed to open " + path);
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    std::string text = buffer.str();
+
+    Metrics metrics;
+    size_t pos = 0;
+    while ((pos = text.find('"', pos)) != std::string::npos)
+    {
+        size_t end = text.find('"', pos + 1);
+        size_t colon = end == std::string::npos ? end : text.find(':', end);
+        if (colon == std::string::npos)
+            throw std::runtime_error("Malformed metrics file " + path);
+        std::string name = text.substr(pos + 1, end - pos - 1);
+        char *last = nullptr;
+        double value = std::strtod(text.c_str() + colon + 1, &last);
+        if (last == text.c_str() + colon + 1)
+            throw std::runtime_error("Metric " + name + " has no value in " + path);
+        metrics.set(name, value);
+        pos = last - text.c_str();
+    }
+    return metrics;
+}
+
+std::vector<std::string> Metrics::regressions(const Metrics &baseline, double threshold) const
+{
+    std::vector<std::string> regressed;
+    for (const auto &[name, value] : entries)
+    {
+        for (const auto &[baseName, baseValue] : baseline.entries)
+        {
+            if (baseName == name && value > baseValue * (1.0 + threshold) && baseValue >= 0.0)
+            {
+                std::ostringstream line;
+                line << name << " " << baseValue << " -> " << value;
+                regressed.push_back(line.str());
+            }
+        }
+    }
+    return regressed;
+}
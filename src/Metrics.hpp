@@ -0,0 +1,23 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <string>
+#include <utility>
+#include <vector>
+
+/* named measurements of one run written as a flat JSON object, every metric is lower is better */
+class Metrics {
+public:
+    void set(const std::string &name, double value);
+    const std::vector<std::pair<std::string, double>> &values() const { return entries; };
+
+    void write(const std::string &path) const;
+    static Metrics read(const std::string &path);
+    /* metrics that grew by more than threshold (a fraction) over the baseline, missing ones are skipped */
+    std::vector<std::string> regressions(const Metrics &baseline, double threshold) const;
+
+private:
+    std::vector<std::pair<std::string, double>> entries;
+};
+
+#endif
@@ -0,0 +1,70 @@
+#include "Microbench.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include "Logger.hpp"
+
+bool Microbench::add(const std::string &name, Fixture fixture)
+{
+    cases().push_back({name, std::move(fixture)});
+    return true;
+}
+
+/* larger than any last level cache, every line is written so it has to be refetched */
+void Microbench::evictCaches()
+{
+    static std::vector<char> flush(64 << 20);
+    for (size_t i = 0; i < flush.size(); i += 64)
+        flush[i]++;
+    keep(flush[0]);
+}
+
+static double median(std::vector<double> values)
+{
+    size_t middle = values.size() / 2;
+    std::nth_element(values.begin(), values.begin() + middle, values.end());
+    return values[middle];
+}
+
+std::vector<Microbench::Result> Microbench::run(const Options &options)
+{
+    std::vector<Case> selected = cases();
+    std::sort(selected.begin(), selected.end(), [](const Case &a, const Case &b) { return a.name < b.name; });
+
+    std::vector<Result> results;
+    for (const Case &benchCase : selected)
+    {
+        if (options.filter != "all" && benchCase.name.compare(0, options.filter.size(), options.filter) != 0)
+            continue;
+        Body body = benchCase.fixture();
+        if (!body)
+        {
+            Log(Logger::warn) << "Microbench " << benchCase.name << " skipped";
+            continue;
+        }
+
+        for (uint32_t i = 0; i < options.warmup; i++)
+            body();
+        std::vector<double> samples;
+        samples.reserve(options.iterations);
+        for (uint32_t i = 0; i < options.iterations; i++)
+        {
+            if (options.cold)
+                evictCaches();
+            auto start = std::chrono::steady_clock::now();
+            body();
+            samples.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+        }
+        if (samples.empty())
+            continue;
+
+        double middle = median(samples);
+        std::vector<double> deviations(samples.size());
+        std::transform(samples.begin(), samples.end(), deviations.begin(), [middle](double sample) { return std::abs(sample - middle); });
+        Result result{benchCase.name, options.iterations, middle, median(deviations), *std::min_element(samples.begin(), samples.end())};
+        Log(Logger::info) << "Microbench " << result.name << (options.cold ? " cold" : " warm") << " iterations " << result.iterations
+                          << " median " << result.medianUs << " us mad " << result.madUs << " us min " << result.minUs << " us";
+        results.push_back(result);
+    }
+    return results;
+}
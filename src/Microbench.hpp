@@ -0,0 +1,67 @@
+#ifndef MICROBENCH_HPP
+#define MICROBENCH_HPP
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+/*
+ * Registry of isolated timings for cpu hot paths. A case is a fixture that prepares
+ * its inputs and returns the body to time, modules register theirs with a static
+ *     static bool registered = Microbench::add("module.case", [] { ...; return body; });
+ * Cases only touch cpu memory, they are built into the microbench binary without the window
+ * system or the device. A fixture returning an empty body skips its case.
+ */
+class Microbench {
+public:
+    using Body = std::function<void()>;
+    using Fixture = std::function<Body()>;
+
+    struct Options
+    {
+        /* runs cases whose name starts with this, "all" runs every case */
+        std::string filter = "all";
+        uint32_t warmup = 5;
+        uint32_t iterations = 50;
+        /* evict the caches before every timed iteration */
+        bool cold = false;
+    };
+
+    struct Result
+    {
+        std::string name;
+        uint32_t iterations;
+        double medianUs;
+        /* median absolute deviation from the median */
+        double madUs;
+        double minUs;
+    };
+
+    static bool add(const std::string &name, Fixture fixture);
+    static std::vector<Result> run(const Options &options);
+
+    /* keeps the compiler from dropping a result nobody reads */
+    template <typename T>
+    static void keep(T &&value)
+    {
+        asm volatile("" : : "g"(&value) : "memory");
+    }
+
+private:
+    struct Case
+    {
+        std::string name;
+        Fixture fixture;
+    };
+    /* function local so registrations from other translation units never see it unconstructed */
+    static std::vector<Case> &cases()
+    {
+        static std::vector<Case> registered;
+        return registered;
+    }
+
+    static void evictCaches();
+};
+
+#endif
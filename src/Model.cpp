@@ -1,29 +1,27 @@
 #include "Model.hpp"
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
+#include <memory>
 #include <stdexcept>
 #include <string>
 #include <sstream>
 
-#include <iostream>
+#include "Logger.hpp"
+#include "Microbench.hpp"
 
-void Model::loadModel()
+void Model::parseObj(std::istream &in, std::vector<glm::vec3> &positions, std::vector<int> &faces)
 {
-    std::vector<Vertex> read_verticies;
-    std::vector<int> read_indicies;
-    std::ifstream file{"teapot.obj"};
-    if (!file.is_open())
-        throw std::runtime_error("Failed to open file");
-    for (std::string line; std::getline(file, line);)
+    for (std::string line; std::getline(in, line);)
     {
         std::stringstream ss{line};
         char type;
         ss >> type;
         if (type == 'v')
         {
-            Vertex v;
-            ss >> v.pos.x >> v.pos.y >> v.pos.z;
-            v.texCoord = {v.pos.x / glm::length(v.pos), -v.pos.y / glm::length(v.pos)};
-            read_verticies.push_back(v);
+            glm::vec3 pos;
+            ss >> pos.x >> pos.y >> pos.z;
+            positions.push_back(pos);
         }
         else if (type == 'f')
         {
@@ -35,19 +33,130 @@ void Model::loadModel()
                     face.push_back(std::stoi(item));
             }
             if (face.size() != 3)
-                std::cout << "weird shit detected\n";
+                Log(Logger::warn) << "weird shit detected";
             for (int i = 0; i + 2 < face.size(); i++)
             {
-                read_indicies.push_back(face[i + 2]);
-                read_indicies.push_back(face[i]);
-                read_indicies.push_back(face[i + 1]);
+                faces.push_back(face[i + 2]);
+                faces.push_back(face[i]);
+                faces.push_back(face[i + 1]);
             }
         }
     }
+}
+
+glm::vec2 Model::sphericalUv(const glm::vec3 &pos)
+{
+    return {pos.x / glm::length(pos), -pos.y / glm::length(pos)};
+}
 
-    for (auto &i : read_indicies)
+void Model::expand(const std::vector<Vertex> &unique, const std::vector<int> &faces)
+{
+    for (auto &i : faces)
     {
         indices.push_back(indices.size());
-        vertices.push_back(read_verticies[i - 1]);
+        vertices.push_back(unique[i - 1]);
     }
-}
\ No newline at end of file
+}
+
+void Model::loadModel()
+{
+    std::vector<glm::vec3> positions;
+    std::vector<int> read_indicies;
+    std::ifstream file{path};
+    if (!file.is_open())
+        throw std::runtime_error("Failed to open " + path);
+    parseObj(file, positions, read_indicies);
+
+    std::vector<Vertex> read_verticies(positions.size());
+    for (size_t i = 0; i < positions.size(); i++)
+    {
+        read_verticies[i].pos = positions[i];
+        read_verticies[i].texCoord = sphericalUv(positions[i]);
+    }
+    expand(read_verticies, read_indicies);
+}
+
+/* the file is read once by the fixture, the cases only see memory */
+static std::string benchSource()
+{
+    std::ifstream file{"teapot.obj"};
+    std::stringstream text;
+    text << file.rdbuf();
+    return text.str();
+}
+
+static bool parseRegistered = Microbench::add("model.parse", [] {
+    std::string text = benchSource();
+    if (text.empty())
+        return Microbench::Body{};
+    return Microbench::Body{[text] {
+        std::istringstream in{text};
+        std::vector<glm::vec3> positions;
+        std::vector<int> faces;
+        Model::parseObj(in, positions, faces);
+        Microbench::keep(faces.data());
+    }};
+});
+
+static bool uvRegistered = Microbench::add("model.uv", [] {
+    std::istringstream in{benchSource()};
+    std::vector<glm::vec3> positions;
+    std::vector<int> faces;
+    Model::parseObj(in, positions, faces);
+    if (positions.empty())
+        return Microbench::Body{};
+    return Microbench::Body{[positions] {
+        std::vector<glm::vec2> uvs(positions.size());
+        for (size_t i = 0; i < positions.size(); i++)
+            uvs[i] = Model::sphericalUv(positions[i]);
+        Microbench::keep(uvs.data());
+    }};
+});
+
+static bool expandRegistered = Microbench::add("model.expand", [] {
+    std::istringstream in{benchSource()};
+    std::vector<glm::vec3> positions;
+    std::vector<int> faces;
+    Model::parseObj(in, positions, faces);
+    if (faces.empty())
+        return Microbench::Body{};
+    std::vector<Vertex> unique(positions.size());
+    for (size_t i = 0; i < positions.size(); i++)
+        unique[i].pos = positions[i];
+    return Microbench::Body{[unique, faces] {
+        Model model;
+        model.expand(unique, faces);
+        Microbench::keep(model.vertices.data());
+    }};
+});
+
+/*
+ * The copy uploadBuffer does into mapped staging memory, vertices then indices. A plain
+ * allocation aligned like a mapping stands in for the staging buffer, it needs no device.
+ */
+static bool stageRegistered = Microbench::add("model.stage", [] {
+    std::istringstream in{benchSource()};
+    std::vector<glm::vec3> positions;
+    std::vector<int> faces;
+    Model::parseObj(in, positions, faces);
+    if (faces.empty())
+        return Microbench::Body{};
+    std::vector<Vertex> unique(positions.size());
+    for (size_t i = 0; i < positions.size(); i++)
+        unique[i].pos = positions[i];
+    auto model = std::make_shared<Model>();
+    model->expand(unique, faces);
+
+    const size_t alignment = 256;
+    size_t vertexBytes = model->vertices.size() * sizeof(Vertex);
+    size_t indexBytes = model->indices.size() * sizeof(uint32_t);
+    size_t size = (vertexBytes + indexBytes + alignment - 1) & ~(alignment - 1);
+    std::shared_ptr<char> staging(static_cast<char *>(std::aligned_alloc(alignment, size)), std::free);
+    if (!staging)
+        throw std::runtime_error("Failed to allocate staging memory");
+    return Microbench::Body{[model, staging, vertexBytes, indexBytes] {
+        memcpy(staging.get(), model->vertices.data(), vertexBytes);
+        memcpy(staging.get() + vertexBytes, model->indices.data(), indexBytes);
+        Microbench::keep(staging.get());
+    }};
+});
@@ -10,6 +10,8 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include <array>
+#include <istream>
+#include <string>
 #include <vector>
 
 struct Vertex
@@ -54,7 +56,14 @@ class Model
 public:
     std::vector<Vertex> vertices;
     std::vector<uint32_t> indices;
+    std::string path = "teapot.obj";
     void loadModel();
+
+    /* stages of loadModel, public so they can be timed on their own */
+    static void parseObj(std::istream &in, std::vector<glm::vec3> &positions, std::vector<int> &faces);
+    static glm::vec2 sphericalUv(const glm::vec3 &pos);
+    /* one vertex per face corner, faces hold 1 based obj indices */
+    void expand(const std::vector<Vertex> &unique, const std::vector<int> &faces);
 };
 
 #endif
\ No newline at end of file
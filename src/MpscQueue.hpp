@@ -0,0 +1,67 @@
+#ifndef MPSCQUEUE_HPP
+#define MPSCQUEUE_HPP
+
+#include <atomic>
+#include <utility>
+
+/*
+ * Unbounded multi-producer single-consumer linked queue (Vyukov), one heap node per push.
+ * push() is wait-free for producers apart from the allocation, pop() may only be called from one thread.
+ */
+template <typename T>
+class MpscQueue {
+private:
+    struct Node
+    {
+        std::atomic<Node *> next{nullptr};
+        T value{};
+    };
+
+    alignas(64) std::atomic<Node *> head;
+    alignas(64) Node *tail;
+
+public:
+    MpscQueue()
+    {
+        Node *stub = new Node();
+        head.store(stub, std::memory_order_relaxed);
+        tail = stub;
+    }
+    ~MpscQueue()
+    {
+        while (tail)
+        {
+            Node *next = tail->next.load(std::memory_order_relaxed);
+            delete tail;
+            tail = next;
+        }
+    }
+    MpscQueue(const MpscQueue &) = delete;
+    MpscQueue &operator=(const MpscQueue &) = delete;
+
+    void push(T value)
+    {
+        Node *node = new Node();
+        node->value = std::move(value);
+        Node *prev = head.exchange(node, std::memory_order_acq_rel);
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    bool pop(T &out)
+    {
+        Node *next = tail->next.load(std::memory_order_acquire);
+        if (!next)
+            return false;
+        out = std::move(next->value);
+        delete tail;
+        tail = next;
+        return true;
+    }
+
+    bool empty() const
+    {
+        return tail->next.load(std::memory_order_acquire) == nullptr;
+    }
+};
+
+#endif
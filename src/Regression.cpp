@@ -0,0 +1,74 @@
+#include "Regression.hpp"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+#include <stb_image.h>
+
+/* 3x3 box filter per channel, edges clamp */
+static std::vector<float> blur(const unsigned char *pixels, int width, int height)
+{
+    std::vector<float> out(static_cast<size_t>(width) * height * 3);
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            float sum[3] = {};
+            for (int dy = -1; dy <= 1; dy++)
+            {
+                for (int dx = -1; dx <= 1; dx++)
+                {
+                    int sx = std::min(std::max(x + dx, 0), width - 1);
+                    int sy = std::min(std::max(y + dy, 0), height - 1);
+                    const unsigned char *pixel = pixels + (static_cast<size_t>(sy) * width + sx) * 4;
+                    for (int c = 0; c < 3; c++)
+                        sum[c] += pixel[c];
+                }
+            }
+            for (int c = 0; c < 3; c++)
+                out[(static_cast<size_t>(y) * width + x) * 3 + c] = sum[c] / (9.0f * 255.0f);
+        }
+    }
+    return out;
+}
+
+double GoldenImage::difference(const std::string &image, const std::string &golden)
+{
+    int width = 0, height = 0, goldenWidth = 0, goldenHeight = 0, channels = 0;
+    stbi_uc *pixels = stbi_load(image.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+    if (!pixels)
+        throw std::runtime_error("Failed to load " + image);
+    stbi_uc *reference = stbi_load(golden.c_str(), &goldenWidth, &goldenHeight, &channels, STBI_rgb_alpha);
+    if (!reference)
+    {
+        stbi_image_free(pixels);
+        throw std::runtime_error("Failed to load " + golden);
+    }
+    if (width != goldenWidth || height != goldenHeight)
+    {
+        stbi_image_free(pixels);
+        stbi_image_free(reference);
+        return 1.0;
+    }
+
+    std::vector<float> a = blur(pixels, width, height);
+    std::vector<float> b = blur(reference, width, height);
+    stbi_image_free(pixels);
+    stbi_image_free(reference);
+
+    const float weights[3] = {0.299f, 0.587f, 0.114f};
+    size_t visible = 0;
+    size_t count = static_cast<size_t>(width) * height;
+    for (size_t i = 0; i < count; i++)
+    {
+        float distance = 0.0f;
+        for (int c = 0; c < 3; c++)
+        {
+            float delta = a[i * 3 + c] - b[i * 3 + c];
+            distance += weights[c] * delta * delta;
+        }
+        if (std::sqrt(distance) > VISIBLE)
+            visible++;
+    }
+    return count ? static_cast<double>(visible) / count : 0.0;
+}
@@ -0,0 +1,21 @@
+#ifndef REGRESSION_HPP
+#define REGRESSION_HPP
+
+#include <string>
+#include "Metrics.hpp"
+
+/*
+ * Compares rendered frames with a stored reference. Both images are box filtered
+ * before a luma weighted distance is taken per pixel, so single pixel rasterization
+ * and dithering differences stay below the visibility threshold.
+ */
+class GoldenImage {
+public:
+    /* per pixel distance in [0, 1] above which a difference counts as visible */
+    static constexpr double VISIBLE = 0.04;
+
+    /* fraction of visibly different pixels, 1 when the sizes differ */
+    static double difference(const std::string &image, const std::string &golden);
+};
+
+#endif
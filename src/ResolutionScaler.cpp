@@ -0,0 +1,25 @@
+#include "ResolutionScaler.hpp"
+#include <algorithm>
+#include <cmath>
+
+bool ResolutionScaler::update(double frameMs)
+{
+    if (targetMs <= 0.0 || frameMs <= 0.0)
+        return false;
+    average = average < 0.0 ? frameMs : average + (frameMs - average) * 0.1;
+
+    /* dead band around the target so the scale does not oscillate */
+    if (average <= targetMs * 1.05 && average >= targetMs * 0.85)
+        return false;
+
+    float wanted = current * static_cast<float>(std::sqrt(targetMs / average));
+    wanted = std::clamp(wanted, current - MAX_STEP, current + MAX_STEP);
+    wanted = std::clamp(std::round(wanted / QUANTUM) * QUANTUM, MIN_SCALE, MAX_SCALE);
+    if (wanted == current)
+        return false;
+
+    /* expected time at the new scale, keeps the average from pulling further in the same direction */
+    average *= (wanted * wanted) / (current * current);
+    current = wanted;
+    return true;
+}
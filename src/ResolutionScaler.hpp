@@ -0,0 +1,29 @@
+#ifndef RESOLUTIONSCALER_HPP
+#define RESOLUTIONSCALER_HPP
+
+/*
+ * Picks the fraction of the output resolution to render so the measured frame time
+ * stays near a target. Cost is taken as proportional to pixel count, the scale
+ * follows the square root of the time ratio in small quantized steps.
+ */
+class ResolutionScaler {
+public:
+    static constexpr float MIN_SCALE = 0.5f;
+    static constexpr float MAX_SCALE = 1.0f;
+    /* largest change per update and the grid the scale snaps to */
+    static constexpr float MAX_STEP = 0.05f;
+    static constexpr float QUANTUM = 1.0f / 32.0f;
+
+    double targetMs = 0.0;
+
+    /* returns true when the scale changed */
+    bool update(double frameMs);
+    float scale() const { return current; };
+    double averageMs() const { return average; };
+
+private:
+    float current = MAX_SCALE;
+    double average = -1.0;
+};
+
+#endif
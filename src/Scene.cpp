@@ -0,0 +1,267 @@
+#include "Scene.hpp"
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <stdexcept>
+#include <glm/gtc/matrix_transform.hpp>
+#include "Microbench.hpp"
+
+#if defined(__SSE__) || defined(_M_X64)
+# include <xmmintrin.h>
+#elif defined(__ARM_NEON)
+# include <arm_neon.h>
+#endif
+
+/* out = a * b for column major matrices, out may not alias a or b */
+static void multiply(const glm::mat4 &a, const glm::mat4 &b, glm::mat4 &out)
+{
+    const float *lhs = &a[0][0];
+    const float *rhs = &b[0][0];
+    float *dst = &out[0][0];
+#if defined(__SSE__) || defined(_M_X64)
+    __m128 c0 = _mm_loadu_ps(lhs);
+    __m128 c1 = _mm_loadu_ps(lhs + 4);
+    __m128 c2 = _mm_loadu_ps(lhs + 8);
+    __m128 c3 = _mm_loadu_ps(lhs + 12);
+    for (int col = 0; col < 4; col++)
+    {
+        const float *r = rhs + col * 4;
+        __m128 sum = _mm_mul_ps(c0, _mm_set1_ps(r[0]));
+        sum = _mm_add_ps(sum, _mm_mul_ps(c1, _mm_set1_ps(r[1])));
+        sum = _mm_add_ps(sum, _mm_mul_ps(c2, _mm_set1_ps(r[2])));
+        sum = _mm_add_ps(sum, _mm_mul_ps(c3, _mm_set1_ps(r[3])));
+        _mm_storeu_ps(dst + col * 4, sum);
+    }
+#elif defined(__ARM_NEON)
+    float32x4_t c0 = vld1q_f32(lhs);
+    float32x4_t c1 = vld1q_f32(lhs + 4);
+    float32x4_t c2 = vld1q_f32(lhs + 8);
+    float32x4_t c3 = vld1q_f32(lhs + 12);
+    for (int col = 0; col < 4; col++)
+    {
+        const float *r = rhs + col * 4;
+        float32x4_t sum = vmulq_n_f32(c0, r[0]);
+        sum = vmlaq_n_f32(sum, c1, r[1]);
+        sum = vmlaq_n_f32(sum, c2, r[2]);
+        sum = vmlaq_n_f32(sum, c3, r[3]);
+        vst1q_f32(dst + col * 4, sum);
+    }
+#else
+    out = a * b;
+    (void)lhs;
+    (void)rhs;
+    (void)dst;
+#endif
+}
+
+uint32_t Scene::addNode(uint32_t parent, const glm::mat4 &local)
+{
+    if (parent != ROOT && parent >= slots.size())
+        throw std::runtime_error("Scene node parent does not exist");
+    if (capacity && slots.size() >= capacity)
+        throw std::runtime_error("Scene is full, the instance buffer holds " + std::to_string(capacity) + " nodes");
+    uint32_t id = static_cast<uint32_t>(slots.size());
+    uint32_t index = static_cast<uint32_t>(ids.size());
+    uint32_t depth = parent == ROOT ? 0 : depths[slots[parent]] + 1;
+    if (!depths.empty() && depth < depths.back())
+        sorted = false;
+
+    locals.push_back(local);
+    worlds.push_back(local);
+    parents.push_back(parent == ROOT ? ROOT : slots[parent]);
+    depths.push_back(depth);
+    ids.push_back(id);
+    dirty.push_back(1);
+    slots.push_back(index);
+    stale.push_back(0);
+    firstDirty = std::min(firstDirty, index);
+    return id;
+}
+
+void Scene::setLocal(uint32_t node, const glm::mat4 &local)
+{
+    uint32_t index = slots[node];
+    locals[index] = local;
+    dirty[index] = 1;
+    firstDirty = std::min(firstDirty, index);
+}
+
+void Scene::clear()
+{
+    locals.clear();
+    worlds.clear();
+    parents.clear();
+    depths.clear();
+    ids.clear();
+    dirty.clear();
+    slots.clear();
+    stale.clear();
+    for (auto &frame : pending)
+        frame.clear();
+    firstDirty = 0;
+    sorted = true;
+}
+
+/* stable counting sort on depth, nodes keep their insertion order within a level */
+void Scene::sortByDepth()
+{
+    uint32_t count = size();
+    uint32_t maxDepth = count ? *std::max_element(depths.begin(), depths.end()) : 0;
+    std::vector<uint32_t> offsets(maxDepth + 2, 0);
+    for (uint32_t depth : depths)
+        offsets[depth + 1]++;
+    for (size_t i = 1; i < offsets.size(); i++)
+        offsets[i] += offsets[i - 1];
+
+    std::vector<uint32_t> order(count);
+    for (uint32_t i = 0; i < count; i++)
+        order[i] = offsets[depths[i]]++;
+
+    std::vector<glm::mat4> sortedLocals(count), sortedWorlds(count);
+    std::vector<uint32_t> sortedParents(count), sortedDepths(count), sortedIds(count);
+    std::vector<uint8_t> sortedDirty(count);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint32_t to = order[i];
+        sortedLocals[to] = locals[i];
+        sortedWorlds[to] = worlds[i];
+        sortedParents[to] = parents[i] == ROOT ? ROOT : order[parents[i]];
+        sortedDepths[to] = depths[i];
+        sortedIds[to] = ids[i];
+        sortedDirty[to] = dirty[i];
+        slots[ids[i]] = to;
+    }
+    locals.swap(sortedLocals);
+    worlds.swap(sortedWorlds);
+    parents.swap(sortedParents);
+    depths.swap(sortedDepths);
+    ids.swap(sortedIds);
+    dirty.swap(sortedDirty);
+
+    firstDirty = static_cast<uint32_t>(std::find(dirty.begin(), dirty.end(), 1) - dirty.begin());
+    sorted = true;
+}
+
+uint32_t Scene::update(uint32_t frame, glm::mat4 *instances)
+{
+    if (!sorted)
+        sortByDepth();
+
+    uint8_t frameBit = static_cast<uint8_t>(1u << frame);
+    for (uint32_t id : pending[frame])
+    {
+        instances[id] = worlds[slots[id]];
+        stale[id] &= ~frameBit;
+    }
+    pending[frame].clear();
+
+    uint32_t count = size();
+    uint32_t updated = 0;
+    for (uint32_t i = firstDirty; i < count; i++)
+    {
+        uint32_t parent = parents[i];
+        /* the parent precedes the child, its flag is final by now */
+        if (parent != ROOT && dirty[parent])
+            dirty[i] = 1;
+        if (!dirty[i])
+            continue;
+
+        if (parent == ROOT)
+            worlds[i] = locals[i];
+        else
+            multiply(worlds[parent], locals[i], worlds[i]);
+
+        uint32_t id = ids[i];
+        instances[id] = worlds[i];
+        for (uint32_t other = 0; other < MAX_FRAMES_IN_FLIGHT; other++)
+        {
+            uint8_t otherBit = static_cast<uint8_t>(1u << other);
+            if (other == frame || (stale[id] & otherBit))
+                continue;
+            stale[id] |= otherBit;
+            pending[other].push_back(id);
+        }
+        updated++;
+    }
+    if (firstDirty < count)
+        std::fill(dirty.begin() + firstDirty, dirty.end(), 0);
+    firstDirty = count;
+    return updated;
+}
+
+std::string Scene::validate() const
+{
+    uint32_t count = size();
+    if (!sorted)
+        return "not sorted by depth";
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (slots[ids[i]] != i)
+            return "node " + std::to_string(ids[i]) + " is not at its slot";
+        uint32_t parent = parents[i];
+        if (parent != ROOT && parent >= i)
+            return "node " + std::to_string(ids[i]) + " precedes its parent";
+        if (i >= firstDirty && dirty[i])
+            continue;
+
+        glm::mat4 expected = parent == ROOT ? locals[i] : worlds[parent] * locals[i];
+        for (int col = 0; col < 4; col++)
+        {
+            for (int row = 0; row < 4; row++)
+            {
+                if (std::abs(expected[col][row] - worlds[i][col][row]) > 1e-4f * (1.0f + std::abs(expected[col][row])))
+                    return "world matrix of node " + std::to_string(ids[i]) + " is out of date";
+            }
+        }
+    }
+    return "";
+}
+
+/*
+ * Random hierarchy added out of depth order, a few nodes move per frame. The fixture checks
+ * the result first: parents before children and no frame left with a stale copy.
+ */
+static bool updateRegistered = Microbench::add("scene.update", [] {
+    const uint32_t count = 20000;
+    const uint32_t frames = MAX_FRAMES_IN_FLIGHT;
+    auto scene = std::make_shared<Scene>();
+    auto instances = std::make_shared<std::vector<glm::mat4>>(size_t(count) * frames);
+    uint64_t state = 0x9E3779B97F4A7C15ull;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        state = state * 6364136223846793005ull + 1442695040888963407ull;
+        uint32_t parent = i < 16 ? Scene::ROOT : uint32_t(state >> 33) % i;
+        scene->addNode(parent, glm::translate(glm::mat4(1.0f), glm::vec3(1.0f, 0.0f, 0.0f)));
+    }
+
+    auto frameInstances = [instances, count](uint32_t frame) { return instances->data() + size_t(frame) * count; };
+    auto move = [scene, count](float angle) {
+        for (uint32_t node = 0; node < count; node += 97)
+            scene->setLocal(node, glm::rotate(glm::translate(glm::mat4(1.0f), glm::vec3(1.0f, 0.0f, 0.0f)), angle, glm::vec3(0.0f, 1.0f, 0.0f)));
+    };
+
+    for (uint32_t frame = 0; frame < frames; frame++)
+        scene->update(frame, frameInstances(frame));
+    move(0.5f);
+    for (uint32_t frame = 0; frame < frames; frame++)
+        scene->update(frame, frameInstances(frame));
+    std::string error = scene->validate();
+    for (uint32_t frame = 0; frame < frames && error.empty(); frame++)
+    {
+        for (uint32_t node = 0; node < count && error.empty(); node++)
+        {
+            if (frameInstances(frame)[node] != scene->world(node))
+                error = "frame " + std::to_string(frame) + " has a stale copy of node " + std::to_string(node);
+        }
+    }
+    if (!error.empty())
+        throw std::runtime_error("scene.update: " + error);
+
+    auto frame = std::make_shared<uint32_t>(0);
+    return Microbench::Body{[scene, frameInstances, move, frame] {
+        move(static_cast<float>(*frame));
+        scene->update(*frame % frames, frameInstances(*frame % frames));
+        (*frame)++;
+        Microbench::keep(scene->world(0));
+    }};
+});
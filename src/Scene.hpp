@@ -0,0 +1,66 @@
+#ifndef SCENE_HPP
+#define SCENE_HPP
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+#include <string>
+
+#ifndef MAX_FRAMES_IN_FLIGHT
+# define MAX_FRAMES_IN_FLIGHT 2
+#endif
+
+/*
+ * Transform hierarchy stored as structure of arrays in depth order, a parent is
+ * always updated before its children. Nodes are addressed by stable ids, the id is
+ * also the slot of the node in the instance buffer.
+ */
+class Scene {
+public:
+    static constexpr uint32_t ROOT = ~0u;
+
+    /* parent has to exist already, ROOT for top level nodes; throws once capacity nodes exist */
+    uint32_t addNode(uint32_t parent, const glm::mat4 &local);
+    /* nodes the instance buffer has room for, 0 is unbounded; kept by clear */
+    void setCapacity(uint32_t nodes) { capacity = nodes; };
+    void setLocal(uint32_t node, const glm::mat4 &local);
+    const glm::mat4 &local(uint32_t node) const { return locals[slots[node]]; };
+    const glm::mat4 &world(uint32_t node) const { return worlds[slots[node]]; };
+    uint32_t size() const { return static_cast<uint32_t>(ids.size()); };
+    void clear();
+
+    /*
+     * Recomputes the world matrices of dirty subtrees and writes them into the
+     * instances of frame, indexed by node id. Matrices that changed while another
+     * frame was recorded are copied first. Returns the number of recomputed nodes.
+     */
+    uint32_t update(uint32_t frame, glm::mat4 *instances);
+
+    /* empty when every parent precedes its children and every world matrix is current, else what is not */
+    std::string validate() const;
+
+private:
+    /* indexed by depth order */
+    std::vector<glm::mat4> locals;
+    std::vector<glm::mat4> worlds;
+    std::vector<uint32_t> parents;
+    std::vector<uint32_t> depths;
+    std::vector<uint32_t> ids;
+    std::vector<uint8_t> dirty;
+
+    /* indexed by id */
+    std::vector<uint32_t> slots;
+    /* one bit per frame whose instance copy is out of date */
+    std::vector<uint8_t> stale;
+    std::vector<uint32_t> pending[MAX_FRAMES_IN_FLIGHT];
+
+    uint32_t firstDirty = 0;
+    uint32_t capacity = 0;
+    bool sorted = true;
+
+    void sortByDepth();
+};
+
+#endif
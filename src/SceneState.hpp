@@ -0,0 +1,36 @@
+#ifndef SCENESTATE_HPP
+#define SCENESTATE_HPP
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+/* result of one fixed simulation step */
+struct SceneSnapshot
+{
+    /* simulation time in seconds */
+    double time = 0.0;
+    float orbitAngle = 0.0f;
+    /* turn of the spinning draws */
+    float spinAngle = 0.0f;
+};
+
+/* simulation output handed to the renderer, the renderer only derives frame data from it */
+struct SceneState
+{
+    SceneSnapshot previous;
+    SceneSnapshot current;
+    /* how far the wall clock is between previous and current, in [0, 1) */
+    float alpha = 0.0f;
+
+    SceneSnapshot interpolated() const
+    {
+        SceneSnapshot blended;
+        blended.time = previous.time + (current.time - previous.time) * alpha;
+        blended.orbitAngle = glm::mix(previous.orbitAngle, current.orbitAngle, alpha);
+        blended.spinAngle = glm::mix(previous.spinAngle, current.spinAngle, alpha);
+        return blended;
+    }
+};
+
+#endif
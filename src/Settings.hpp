@@ -0,0 +1,161 @@
+#ifndef SETTINGS_HPP
+#define SETTINGS_HPP
+
+#include <string>
+#include <cstdint>
+#include <stdexcept>
+
+/* runtime options, filled from the command line */
+struct Settings
+{
+    /* record one command buffer per frame slot and swapchain image and reuse it until invalidated */
+    bool reuseCommandBuffers = false;
+    /* run N frames per mode, log cpu frame times and exit */
+    uint32_t benchFrames = 0;
+    /* secondary command buffers recorded in parallel on the job system, 0 records inline */
+    uint32_t recordThreads = 0;
+    /* number of draws submitted for the model, used to stress command recording */
+    uint32_t drawCount = 1;
+    /* sample textures through the descriptor indexing array when the device supports it */
+    bool bindless = false;
+    /* resize the window every frame for N frames and report memory */
+    uint32_t resizeStress = 0;
+    /* requested samples per pixel, clamped to what the device supports */
+    uint32_t msaa = 1;
+    /* use vkCmdBeginRendering instead of render pass and framebuffer objects when supported */
+    bool dynamicRendering = false;
+    /* write the simulation clock of this run to a file, or drive the simulation from one */
+    std::string recordClock;
+    std::string replayClock;
+    /* log compiled render graphs */
+    bool dumpGraph = false;
+    /* job system worker threads, 0 uses every hardware thread */
+    uint32_t jobThreads = 0;
+    /* compare N tasks on the job system against a thread per task and exit */
+    uint32_t benchJobs = 0;
+    /* render below the swapchain resolution to keep gpu frame time near this many ms, 0 disables */
+    float targetFrameMs = 0.0f;
+    /* write every presented frame into this directory, as png or raw yuv 4:2:0 */
+    std::string captureDir;
+    std::string captureFormat = "png";
+    /* obj file rendered, selects the reference scene together with --draws */
+    std::string model = "teapot.obj";
+    /* image sampled by the model */
+    std::string texture = "swmg.jpg";
+    /* write load, frame time and memory metrics of the run as JSON */
+    std::string metricsPath;
+    /* fail when a metric grows past threshold percent over this metrics file */
+    std::string baselinePath;
+    float regressionThreshold = 10.0f;
+    /* compare captured frame golden-frame with this png, frames only reproduce with --replay-clock */
+    std::string goldenPath;
+    uint32_t goldenFrame = 30;
+    /* write the golden from the captured frame instead of comparing against it */
+    bool updateGolden = false;
+    /* fraction of pixels allowed to differ visibly */
+    float goldenTolerance = 0.01f;
+    /* seconds between device memory reports, 0 disables them */
+    float memoryLogInterval = 10.0f;
+    /* write static geometry straight into device local memory when the host can map it */
+    bool directUpload = true;
+    /* draw a chunked mesh file written by --make-chunks, keeping at most stream-pool MiB of it resident */
+    std::string streamPath;
+    uint32_t streamPoolMiB = 64;
+    /* split --model into a chunked mesh file and exit */
+    std::string makeChunks;
+    /* sample a tiled texture file written by --make-vtex, keeping vt-cache MiB of its tiles resident */
+    std::string virtualTexture;
+    uint32_t virtualCacheMiB = 64;
+    /* split --texture into a tiled texture file and exit */
+    std::string makeVirtualTexture;
+    /* reload the model, texture and compiled shaders when their files change */
+    bool hotReload = false;
+
+    static Settings parse(int argc, char **argv)
+    {
+        Settings settings;
+        for (int i = 1; i < argc; i++)
+        {
+            std::string arg{argv[i]};
+            if (arg == "--reuse-cmd")
+                settings.reuseCommandBuffers = true;
+            else if (arg == "--bench" && i + 1 < argc)
+                settings.benchFrames = std::stoul(argv[++i]);
+            else if (arg == "--record-threads" && i + 1 < argc)
+                settings.recordThreads = std::stoul(argv[++i]);
+            else if (arg == "--draws" && i + 1 < argc)
+                settings.drawCount = std::stoul(argv[++i]);
+            else if (arg == "--bindless")
+                settings.bindless = true;
+            else if (arg == "--resize-stress" && i + 1 < argc)
+                settings.resizeStress = std::stoul(argv[++i]);
+            else if (arg == "--msaa" && i + 1 < argc)
+                settings.msaa = std::stoul(argv[++i]);
+            else if (arg == "--dynamic-rendering")
+                settings.dynamicRendering = true;
+            else if (arg == "--record-clock" && i + 1 < argc)
+                settings.recordClock = argv[++i];
+            else if (arg == "--replay-clock" && i + 1 < argc)
+                settings.replayClock = argv[++i];
+            else if (arg == "--dump-graph")
+                settings.dumpGraph = true;
+            else if (arg == "--job-threads" && i + 1 < argc)
+                settings.jobThreads = std::stoul(argv[++i]);
+            else if (arg == "--bench-jobs" && i + 1 < argc)
+                settings.benchJobs = std::stoul(argv[++i]);
+            else if (arg == "--target-ms" && i + 1 < argc)
+                settings.targetFrameMs = std::stof(argv[++i]);
+            else if (arg == "--capture" && i + 1 < argc)
+                settings.captureDir = argv[++i];
+            else if (arg == "--capture-format" && i + 1 < argc)
+            {
+                settings.captureFormat = argv[++i];
+                if (settings.captureFormat != "png" && settings.captureFormat != "yuv")
+                    throw std::runtime_error("Unknown capture format: " + settings.captureFormat);
+            }
+            else if (arg == "--model" && i + 1 < argc)
+                settings.model = argv[++i];
+            else if (arg == "--texture" && i + 1 < argc)
+                settings.texture = argv[++i];
+            else if (arg == "--metrics" && i + 1 < argc)
+                settings.metricsPath = argv[++i];
+            else if (arg == "--baseline" && i + 1 < argc)
+                settings.baselinePath = argv[++i];
+            else if (arg == "--threshold" && i + 1 < argc)
+                settings.regressionThreshold = std::stof(argv[++i]);
+            else if (arg == "--golden" && i + 1 < argc)
+                settings.goldenPath = argv[++i];
+            else if (arg == "--golden-frame" && i + 1 < argc)
+                settings.goldenFrame = std::stoul(argv[++i]);
+            else if (arg == "--update-golden")
+                settings.updateGolden = true;
+            else if (arg == "--golden-tolerance" && i + 1 < argc)
+                settings.goldenTolerance = std::stof(argv[++i]);
+            else if (arg == "--memory-log" && i + 1 < argc)
+                settings.memoryLogInterval = std::stof(argv[++i]);
+            else if (arg == "--staged-upload")
+                settings.directUpload = false;
+            else if (arg == "--stream" && i + 1 < argc)
+                settings.streamPath = argv[++i];
+            else if (arg == "--stream-pool" && i + 1 < argc)
+                settings.streamPoolMiB = std::stoul(argv[++i]);
+            else if (arg == "--make-chunks" && i + 1 < argc)
+                settings.makeChunks = argv[++i];
+            else if (arg == "--vtex" && i + 1 < argc)
+                settings.virtualTexture = argv[++i];
+            else if (arg == "--vt-cache" && i + 1 < argc)
+                settings.virtualCacheMiB = std::stoul(argv[++i]);
+            else if (arg == "--make-vtex" && i + 1 < argc)
+                settings.makeVirtualTexture = argv[++i];
+            else if (arg == "--hot-reload")
+                settings.hotReload = true;
+            else
+                throw std::runtime_error("Unknown argument: " + arg);
+        }
+        if (!settings.goldenPath.empty() && (settings.replayClock.empty() || settings.captureDir.empty()))
+            throw std::runtime_error("--golden needs --replay-clock and --capture");
+        return settings;
+    }
+};
+
+#endif
@@ -0,0 +1,72 @@
+#include "Simulation.hpp"
+#include <stdexcept>
+#include <algorithm>
+#include <cstdlib>
+#include <glm/gtc/constants.hpp>
+#include "Logger.hpp"
+
+void SimulationClock::record(const std::string &path)
+{
+    recording.open(path);
+    if (!recording)
+        throw std::runtime_error("Failed to open clock recording " + path);
+    /* hex floats round trip exactly */
+    recording << std::hexfloat;
+}
+
+void SimulationClock::replay(const std::string &path)
+{
+    std::ifstream file{path};
+    if (!file)
+        throw std::runtime_error("Failed to open clock recording " + path);
+    std::string line;
+    while (std::getline(file, line))
+    {
+        if (!line.empty())
+            replayed.push_back(std::strtod(line.c_str(), nullptr));
+    }
+    replaying = true;
+    next = 0;
+    Log(Logger::info) << "Replaying " << replayed.size() << " clock ticks from " << path;
+}
+
+double SimulationClock::tick()
+{
+    if (replaying)
+    {
+        if (next == replayed.size())
+            throw std::runtime_error("Clock recording exhausted");
+        return replayed[next++];
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    double delta = started ? std::chrono::duration<double>(now - last).count() : 0.0;
+    last = now;
+    started = true;
+    if (recording.is_open())
+        recording << delta << "\n";
+    return delta;
+}
+
+/* orbiting the camera instead of spinning the model keeps per-draw data static */
+void Simulation::step(SceneSnapshot &snapshot)
+{
+    snapshot.time += STEP;
+    snapshot.orbitAngle -= static_cast<float>(STEP * glm::half_pi<double>());
+    snapshot.spinAngle += static_cast<float>(STEP * glm::pi<double>());
+}
+
+void Simulation::advance(SceneState &state)
+{
+    accumulator += std::min(clock.tick(), MAX_FRAME_TIME);
+    while (accumulator >= STEP)
+    {
+        previous = current;
+        step(current);
+        accumulator -= STEP;
+        stepCount++;
+    }
+    state.previous = previous;
+    state.current = current;
+    state.alpha = static_cast<float>(accumulator / STEP);
+}
@@ -0,0 +1,52 @@
+#ifndef SIMULATION_HPP
+#define SIMULATION_HPP
+
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "SceneState.hpp"
+
+/*
+ * Elapsed time between simulate calls. Measured deltas can be recorded to a file and
+ * replayed later, a replayed run steps the simulation exactly like the recorded one.
+ */
+class SimulationClock {
+public:
+    void record(const std::string &path);
+    void replay(const std::string &path);
+    /* seconds since the previous tick */
+    double tick();
+
+private:
+    std::chrono::steady_clock::time_point last;
+    bool started = false;
+    std::ofstream recording;
+    std::vector<double> replayed;
+    size_t next = 0;
+    bool replaying = false;
+};
+
+/* fixed timestep updates driven by an accumulator, independent of the frame rate */
+class Simulation {
+public:
+    static constexpr double STEP = 1.0 / 120.0;
+    /* longest frame time consumed at once, slower frames slow the simulation down */
+    static constexpr double MAX_FRAME_TIME = 0.25;
+
+    SimulationClock clock;
+
+    /* runs every due step and describes where the wall clock is between the last two */
+    void advance(SceneState &state);
+    uint64_t steps() const { return stepCount; };
+
+private:
+    double accumulator = 0.0;
+    uint64_t stepCount = 0;
+    SceneSnapshot previous;
+    SceneSnapshot current;
+
+    static void step(SceneSnapshot &snapshot);
+};
+
+#endif
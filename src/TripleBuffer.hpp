@@ -0,0 +1,43 @@
+#ifndef TRIPLEBUFFER_HPP
+#define TRIPLEBUFFER_HPP
+
+#include <atomic>
+#include <cstdint>
+
+/*
+ * Lock-free single-producer single-consumer handoff of the latest value.
+ * The writer fills its back buffer and publishes it, the reader picks up the newest
+ * published buffer, neither side ever waits and stale values are simply skipped.
+ */
+template <typename T>
+class TripleBuffer {
+private:
+    static constexpr uint8_t INDEX = 0x3;
+    static constexpr uint8_t FRESH = 0x4;
+
+    T buffers[3]{};
+    /* index of the buffer between writer and reader, FRESH when not read yet */
+    alignas(64) std::atomic<uint8_t> middle{1};
+    alignas(64) uint8_t back = 2;
+    alignas(64) uint8_t front = 0;
+
+public:
+    /* writer side */
+    T &write() { return buffers[back]; }
+    void publish()
+    {
+        back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & INDEX;
+    }
+
+    /* reader side, returns false when nothing new was published */
+    bool update()
+    {
+        if (!(middle.load(std::memory_order_relaxed) & FRESH))
+            return false;
+        front = middle.exchange(front, std::memory_order_acq_rel) & INDEX;
+        return true;
+    }
+    const T &read() const { return buffers[front]; }
+};
+
+#endif
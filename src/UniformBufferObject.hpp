@@ -5,12 +5,24 @@
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <cstdint>
 
+/* per frame data, lives in the dynamic uniform ring */
 struct UniformBufferObject
 {
-    glm::mat4 model;
     glm::mat4 view;
     glm::mat4 proj;
 };
 
-#endif
\ No newline at end of file
+/* per draw data, must stay within the guaranteed 128 bytes of push constants */
+struct PushConstants
+{
+    /* scene node, selects the world matrix in the instance buffer */
+    uint32_t objectId;
+    /* slot in the bindless texture array */
+    uint32_t materialIndex;
+};
+
+static_assert(sizeof(PushConstants) <= 128, "push constants exceed the guaranteed minimum size");
+
+#endif
@@ -32,14 +32,19 @@ bool VulkanInstance::check_validation_layer_support()
 
 void VulkanInstance::init()
 {
-    std::cout << Logger::debug << "Vulkan engine: made by @dhorvath" << Logger::reset;
+    Log(Logger::debug) << "Vulkan engine: made by @dhorvath";
     /* Validation layer */
     if (enableValidationLayers && !check_validation_layer_support())
         throw std::runtime_error("Failed to init validation layers");
     /* vulkan instance*/
+    /* request the newest version the loader knows, capped at what the engine uses */
+    vkEnumerateInstanceVersion(&instanceVersion);
+    if (instanceVersion > VK_API_VERSION_1_3)
+        instanceVersion = VK_API_VERSION_1_3;
+
     VkApplicationInfo appInfo{};
     appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
-    appInfo.apiVersion = VK_API_VERSION_1_0;
+    appInfo.apiVersion = instanceVersion;
     appInfo.pApplicationName = "Scop";
     appInfo.applicationVersion = VK_MAKE_VERSION(1, 1, 0);
     appInfo.pEngineName = "No Engine";
@@ -91,6 +96,104 @@ void VulkanInstance::pickPhysicalDevice()
     vkEnumeratePhysicalDevices(instance, &deviceCount, physicalDevices.data());
 
     physicalDevice = physicalDevices[0];
+    queryFeatures();
+}
+
+bool VulkanInstance::deviceSupportsExtension(const char *name)
+{
+    uint32_t extensionCount = 0;
+    vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+    std::vector<VkExtensionProperties> extensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, extensions.data());
+    for (auto &ext : extensions)
+    {
+        if (strcmp(ext.extensionName, name) == 0)
+            return true;
+    }
+    return false;
+}
+
+/* names are kept once, queryFeatures can run again for the same device */
+void VulkanInstance::enableExtension(const char *name)
+{
+    for (const char *enabled : deviceExtensions)
+    {
+        if (strcmp(enabled, name) == 0)
+            return;
+    }
+    deviceExtensions.push_back(name);
+}
+
+void VulkanInstance::queryFeatures()
+{
+    VkPhysicalDeviceProperties props{};
+    vkGetPhysicalDeviceProperties(physicalDevice, &props);
+    features.apiVersion = props.apiVersion < instanceVersion ? props.apiVersion : instanceVersion;
+    VkPhysicalDeviceFeatures coreFeatures{};
+    vkGetPhysicalDeviceFeatures(physicalDevice, &coreFeatures);
+    features.fragmentStores = coreFeatures.fragmentStoresAndAtomics;
+    if (features.apiVersion < VK_API_VERSION_1_1)
+        return;
+
+    bool hasIndexing = features.apiVersion >= VK_API_VERSION_1_2 || deviceSupportsExtension(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+    bool hasDynamicRendering = features.apiVersion >= VK_API_VERSION_1_3
+                               || (features.apiVersion >= VK_API_VERSION_1_2 && deviceSupportsExtension(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME));
+    bool hasTimeline = features.apiVersion >= VK_API_VERSION_1_2 || deviceSupportsExtension(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+
+    void *featureChain = nullptr;
+
+    VkPhysicalDeviceDescriptorIndexingFeatures indexingFeatures{};
+    indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+    if (hasIndexing)
+    {
+        indexingFeatures.pNext = featureChain;
+        featureChain = &indexingFeatures;
+    }
+
+    VkPhysicalDeviceDynamicRenderingFeatures dynamicRenderingFeatures{};
+    dynamicRenderingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES;
+    if (hasDynamicRendering)
+    {
+        dynamicRenderingFeatures.pNext = featureChain;
+        featureChain = &dynamicRenderingFeatures;
+    }
+
+    VkPhysicalDeviceTimelineSemaphoreFeatures timelineFeatures{};
+    timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+    if (hasTimeline)
+    {
+        timelineFeatures.pNext = featureChain;
+        featureChain = &timelineFeatures;
+    }
+
+    VkPhysicalDeviceFeatures2 features2{};
+    features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features2.pNext = featureChain;
+    vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+
+    features.descriptorIndexing = hasIndexing && indexingFeatures.runtimeDescriptorArray && indexingFeatures.descriptorBindingPartiallyBound
+                                  && indexingFeatures.descriptorBindingSampledImageUpdateAfterBind && indexingFeatures.shaderSampledImageArrayNonUniformIndexing;
+    if (features.descriptorIndexing && features.apiVersion < VK_API_VERSION_1_2)
+        enableExtension(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+
+    features.dynamicRendering = hasDynamicRendering && dynamicRenderingFeatures.dynamicRendering;
+    if (features.dynamicRendering && features.apiVersion < VK_API_VERSION_1_3)
+        enableExtension(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME);
+
+    features.timelineSemaphore = hasTimeline && timelineFeatures.timelineSemaphore;
+    if (features.timelineSemaphore && features.apiVersion < VK_API_VERSION_1_2)
+        enableExtension(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+
+    features.memoryBudget = deviceSupportsExtension(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    if (features.memoryBudget)
+        enableExtension(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+
+    Log(Logger::debug) << "Device " << props.deviceName << " api " << VK_API_VERSION_MAJOR(features.apiVersion) << "." << VK_API_VERSION_MINOR(features.apiVersion)
+                       << " descriptor indexing " << (features.descriptorIndexing ? "yes" : "no")
+                       << " dynamic rendering " << (features.dynamicRendering ? "yes" : "no")
+                       << " timeline semaphores " << (features.timelineSemaphore ? "yes" : "no")
+                       << " memory budget " << (features.memoryBudget ? "yes" : "no")
+                       << " fragment stores " << (features.fragmentStores ? "yes" : "no");
 }
 
 void VulkanInstance::makeLogicalDevice()
@@ -111,12 +214,54 @@ void VulkanInstance::makeLogicalDevice()
     }
 
     VkPhysicalDeviceFeatures deviceFeatures{};
+    deviceFeatures.fragmentStoresAndAtomics = features.fragmentStores;
+
+    /* optional features are chained behind VkPhysicalDeviceFeatures2 */
+    void *featureChain = nullptr;
+
+    VkPhysicalDeviceDescriptorIndexingFeatures indexingFeatures{};
+    indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+    if (features.descriptorIndexing)
+    {
+        indexingFeatures.runtimeDescriptorArray = VK_TRUE;
+        indexingFeatures.descriptorBindingPartiallyBound = VK_TRUE;
+        indexingFeatures.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+        indexingFeatures.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+        indexingFeatures.pNext = featureChain;
+        featureChain = &indexingFeatures;
+    }
+
+    VkPhysicalDeviceDynamicRenderingFeatures dynamicRenderingFeatures{};
+    dynamicRenderingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES;
+    if (features.dynamicRendering)
+    {
+        dynamicRenderingFeatures.dynamicRendering = VK_TRUE;
+        dynamicRenderingFeatures.pNext = featureChain;
+        featureChain = &dynamicRenderingFeatures;
+    }
+
+    VkPhysicalDeviceTimelineSemaphoreFeatures timelineFeatures{};
+    timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+    if (features.timelineSemaphore)
+    {
+        timelineFeatures.timelineSemaphore = VK_TRUE;
+        timelineFeatures.pNext = featureChain;
+        featureChain = &timelineFeatures;
+    }
+
+    VkPhysicalDeviceFeatures2 deviceFeatures2{};
+    deviceFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    deviceFeatures2.features = deviceFeatures;
+    deviceFeatures2.pNext = featureChain;
 
     VkDeviceCreateInfo deviceCreateInfo{};
     deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
     deviceCreateInfo.pQueueCreateInfos = deviceQueueCreateInfos.data();
     deviceCreateInfo.queueCreateInfoCount = static_cast<uint32_t>(deviceQueueCreateInfos.size());
-    deviceCreateInfo.pEnabledFeatures = &deviceFeatures;
+    if (features.apiVersion >= VK_API_VERSION_1_1)
+        deviceCreateInfo.pNext = &deviceFeatures2;
+    else
+        deviceCreateInfo.pEnabledFeatures = &deviceFeatures;
 
     deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
     deviceCreateInfo.ppEnabledExtensionNames = deviceExtensions.data();
@@ -142,4 +287,11 @@ void VulkanInstance::createSurface()
 {
     if (glfwCreateWindowSurface(instance, Window::win, nullptr, &surface) != VK_SUCCESS)
         throw std::runtime_error("Failed to create surface");
-}
\ No newline at end of file
+}
+
+void VulkanInstance::destroy()
+{
+    vkDestroyDevice(device, nullptr);
+    vkDestroySurfaceKHR(instance, surface, nullptr);
+    vkDestroyInstance(instance, nullptr);
+}
@@ -12,22 +12,46 @@
     const bool enableValidationLayers = false;
 #endif
 
+/* optional device capabilities, filled by pickPhysicalDevice */
+struct DeviceFeatures
+{
+    uint32_t apiVersion = VK_API_VERSION_1_0;
+    /* runtime sized, partially bound, update-after-bind sampled image arrays */
+    bool descriptorIndexing = false;
+    /* vkCmdBeginRendering without render pass and framebuffer objects */
+    bool dynamicRendering = false;
+    /* one monotonically increasing semaphore value per submit instead of per frame fences */
+    bool timelineSemaphore = false;
+    /* per heap budget and usage through VK_EXT_memory_budget */
+    bool memoryBudget = false;
+    /* storage buffer writes from fragment shaders, virtual texture feedback needs them */
+    bool fragmentStores = false;
+};
+
 class VulkanInstance {
 private:
     const std::vector<const char *> validationLayer {"VK_LAYER_KHRONOS_validation"};
-    const std::vector<const char *> deviceExtensions = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+    std::vector<const char *> deviceExtensions = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
 
     VkInstance instance;
+    uint32_t instanceVersion = VK_API_VERSION_1_0;
+
+    bool deviceSupportsExtension(const char *name);
+    void enableExtension(const char *name);
+    void queryFeatures();
 public:
     inline static VkPhysicalDevice physicalDevice;
     inline static VkDevice device;
     inline static VkSurfaceKHR surface;
+    inline static DeviceFeatures features;
 
     void init();
     bool check_validation_layer_support();
     void pickPhysicalDevice();
     void makeLogicalDevice();
     void createSurface();
+    /* device, surface and instance, everything created from the device has to be gone */
+    void destroy();
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,88 @@
+#ifndef WORKSTEALINGDEQUE_HPP
+#define WORKSTEALINGDEQUE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+/*
+ * Fixed capacity Chase-Lev deque (Le et al. C11 formulation).
+ * The owner pushes and pops at the bottom, any thread may steal from the top.
+ * push() fails when full, the caller runs the item inline instead.
+ */
+template <typename T>
+class WorkStealingDeque {
+public:
+    explicit WorkStealingDeque(size_t capacity = 4096)
+    {
+        size_t size = 1;
+        while (size < capacity)
+            size <<= 1;
+        mask = size - 1;
+        items = std::make_unique<std::atomic<T *>[]>(size);
+    }
+    WorkStealingDeque(const WorkStealingDeque &) = delete;
+    WorkStealingDeque &operator=(const WorkStealingDeque &) = delete;
+
+    /* owner only */
+    bool push(T *item)
+    {
+        int64_t b = bottom.load(std::memory_order_relaxed);
+        int64_t t = top.load(std::memory_order_acquire);
+        if (b - t > static_cast<int64_t>(mask))
+            return false;
+        items[b & mask].store(item, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    /* owner only */
+    T *pop()
+    {
+        int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top.load(std::memory_order_relaxed);
+        if (t > b)
+        {
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        T *item = items[b & mask].load(std::memory_order_relaxed);
+        if (t == b)
+        {
+            /* last item, race the thieves for it */
+            if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                item = nullptr;
+            bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return item;
+    }
+
+    T *steal()
+    {
+        int64_t t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = bottom.load(std::memory_order_acquire);
+        if (t >= b)
+            return nullptr;
+        T *item = items[t & mask].load(std::memory_order_relaxed);
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            return nullptr;
+        return item;
+    }
+
+    bool empty() const
+    {
+        return bottom.load(std::memory_order_relaxed) <= top.load(std::memory_order_relaxed);
+    }
+
+private:
+    alignas(64) std::atomic<int64_t> top{0};
+    alignas(64) std::atomic<int64_t> bottom{0};
+    size_t mask;
+    std::unique_ptr<std::atomic<T *>[]> items;
+};
+
+#endif
@@ -1,63 +1,120 @@
 #include "app.hpp"
 #include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <fstream>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <filesystem>
+#include "deletionQueue.hpp"
+#include "QueueFamilyIndicies.hpp"
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 #include <iostream>
 #include <stdexcept>
 #include "Logger.hpp"
+#include "renderGraph.hpp"
+#include <sstream>
+#include <thread>
 
-void App::updateUniformBuffer(uint32_t currentImage)
+/* main thread: runs the due fixed steps and hands the newest state to the renderer */
+void App::simulate()
 {
-    static auto startTime = std::chrono::high_resolution_clock::now();
+    simulation.advance(sceneState.write());
+    sceneState.publish();
+}
 
-    auto current = std::chrono::high_resolution_clock::now();
-    float deltatime = std::chrono::duration<float, std::chrono::seconds::period>(current - startTime).count();
+void App::updateUniformBuffer(uint32_t currentImage)
+{
+    sceneState.update();
+    SceneSnapshot snapshot = sceneState.read().interpolated();
+    glm::vec3 eye;
+    UniformBufferObject ubo = Camera::uniforms(snapshot, Swapchain::swapchainExtent.width / (float)Swapchain::swapchainExtent.height, eye);
+
+    uniformRing.beginFrame(currentImage);
+    uint32_t offset = uniformRing.write(&ubo, sizeof(ubo));
+    if (offset != renderpipeline.uniformOffsets[currentImage])
+    {
+        renderpipeline.uniformOffsets[currentImage] = offset;
+        renderpipeline.invalidate(DIRTY_DRAWLIST);
+    }
 
-    UniformBufferObject ubo{};
-    ubo.model = glm::rotate(glm::mat4(1.0f), deltatime * glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-    ubo.view = glm::lookAt(glm::vec3(5.0f, 5.0f, 0.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-    ubo.proj = glm::perspective(glm::radians(90.0f), Swapchain::swapchainExtent.width / (float)Swapchain::swapchainExtent.height, 0.1f, 30.0f);
-    ubo.proj[1][1] *= -1;
-    memcpy(uniformBuffersMapped[currentImage], &ubo, sizeof(ubo));
+    /* a turned pivot dirties its subtree, only those nodes are recomputed and copied */
+    for (size_t i = 0; i < pivots.size(); i++)
+        scene.setLocal(pivots[i], glm::rotate(glm::translate(glm::mat4(1.0f), pivotPositions[i]), snapshot.spinAngle, glm::vec3(0.0f, 1.0f, 0.0f)));
+    glm::mat4 *instances = reinterpret_cast<glm::mat4 *>(static_cast<char *>(instanceBuffer.data) + renderpipeline.instanceOffsets[currentImage]);
+    scene.update(currentImage, instances);
+    /* the mesh node never moves, the eye is already in mesh space */
+    if (streamer.active() && streamer.update(ubo.proj * ubo.view * scene.world(streamNode), ubo.proj, eye, {streamNode, textureSlot}, drawList))
+        renderpipeline.invalidate(DIRTY_DRAWLIST);
+    sortDraws(eye);
 }
 
 void App::drawFrame()
 {
-    vkWaitForFences(VulkanInstance::device, 1, &Syncobjects::inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
+    Syncobjects::waitFrame(currentFrame);
+    if (settings.benchFrames)
+    {
+        double gpuMs = renderpipeline.timer.read(currentFrame);
+        if (gpuMs >= 0.0)
+            gpuFrameTimes.add(gpuMs);
+    }
+    uint64_t completed = Syncobjects::completed();
+    DeletionQueue::collect(completed);
+    GpuMemory::poll(settings.memoryLogInterval);
+    if (capture.active())
+        capture.collect(completed);
+    if (virtualTexture.active() && virtualTexture.update(currentFrame))
+        renderpipeline.invalidate(DIRTY_DESCRIPTORS);
+    if (watcher.active())
+        hotReload();
+    adjustRenderScale();
     uint32_t image = 0;
     VkResult res = vkAcquireNextImageKHR(VulkanInstance::device, Swapchain::swapchain, UINT64_MAX, Syncobjects::imageDoneSemaphores[currentFrame], VK_NULL_HANDLE, &image);
 
     if (res == VK_ERROR_OUT_OF_DATE_KHR)
     {
-        swapchain.remakeSwapchain();
-        makeDepthResources();
-        renderpipeline.makeFrameBuffer(depth);
+        remakeSwapchain();
         return;
     }
     else if (res != VK_SUCCESS && res != VK_SUBOPTIMAL_KHR)
         throw std::runtime_error("Failed to get next image");
 
-    updateUniformBuffer(currentFrame);
+    auto cpuStart = std::chrono::steady_clock::now();
 
-    vkResetFences(VulkanInstance::device, 1, &Syncobjects::inFlightFences[currentFrame]);
+    updateUniformBuffer(currentFrame);
 
-    vkResetCommandBuffer(renderpipeline.commandBuffers[currentFrame], 0);
-    renderpipeline.recordCommandBuffer(renderpipeline.commandBuffers[currentFrame], image, currentFrame, vertexBuffer, indexBuffer, model);
+    if (renderpipeline.bindless)
+        renderpipeline.bindlessTextures.beginFrame(currentFrame);
 
-    VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
+    VkCommandBuffer commandBuffer;
+    if (settings.reuseCommandBuffers)
+        commandBuffer = renderpipeline.getStaticCommandBuffer(image, currentFrame, vertexBuffer, indexBuffer, drawList);
+    else
+    {
+        commandBuffer = renderpipeline.commandBuffers[currentFrame];
+        vkResetCommandBuffer(commandBuffer, 0);
+        renderpipeline.recordCommandBuffer(commandBuffer, image, currentFrame, vertexBuffer, indexBuffer, drawList);
+    }
 
-    VkSubmitInfo submitInfo{};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &renderpipeline.commandBuffers[currentFrame];
-    submitInfo.signalSemaphoreCount = 1;
-    submitInfo.pSignalSemaphores = &syncobjects.renderFinishedSemaphores[currentFrame];
-    submitInfo.waitSemaphoreCount = 1;
-    submitInfo.pWaitSemaphores = &syncobjects.imageDoneSemaphores[currentFrame];
-    submitInfo.pWaitDstStageMask = waitStages;
+    VkFence fence = syncobjects.useTimeline ? VK_NULL_HANDLE : syncobjects.inFlightFences[currentFrame];
+    VkCommandBuffer captureBuffer = capture.active() ? capture.record(image) : VK_NULL_HANDLE;
+    if (captureBuffer != VK_NULL_HANDLE)
+    {
+        /* the copy follows the frame on the queue and is what present waits for */
+        Syncobjects::submit(RenderPipeline::graphicsQueue, commandBuffer, syncobjects.imageDoneSemaphores[currentFrame],
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_NULL_HANDLE, VK_NULL_HANDLE);
+        syncobjects.frameValues[currentFrame] = Syncobjects::submit(RenderPipeline::graphicsQueue, captureBuffer,
+            VK_NULL_HANDLE, 0, syncobjects.renderFinishedSemaphores[currentFrame], fence);
+        capture.submitted(syncobjects.frameValues[currentFrame]);
+    }
+    else
+        syncobjects.frameValues[currentFrame] = Syncobjects::submit(RenderPipeline::graphicsQueue, commandBuffer,
+            syncobjects.imageDoneSemaphores[currentFrame], VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+            syncobjects.renderFinishedSemaphores[currentFrame], fence);
 
-    if (vkQueueSubmit(RenderPipeline::graphicsQueue, 1, &submitInfo, syncobjects.inFlightFences[currentFrame]) != VK_SUCCESS)
-        throw std::runtime_error("Failed to submit to queue");
+    if (settings.benchFrames)
+        cpuFrameTimes.add(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - cpuStart).count());
 
     VkPresentInfoKHR presentInfo{};
     presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -72,9 +129,7 @@ void App::drawFrame()
     if (res == VK_ERROR_OUT_OF_DATE_KHR || res == VK_SUBOPTIMAL_KHR || frameResize)
     {
         frameResize = false;
-        swapchain.remakeSwapchain();
-        makeDepthResources();
-        renderpipeline.makeFrameBuffer(depth);
+        remakeSwapchain();
         return;
     }
     else if (res != VK_SUCCESS)
@@ -83,175 +138,689 @@ void App::drawFrame()
     currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
 }
 
-// fix this
-void App::makeIndexBuffer()
+/* the slot just finished on the GPU, its timestamps are available without waiting */
+void App::adjustRenderScale()
 {
-    VkDeviceSize deviceSize = sizeof(model.indices[0]) * model.indices.size();
+    if (!renderpipeline.upscale)
+        return;
+    auto now = std::chrono::steady_clock::now();
+    double frameMs = -1.0;
+    if (renderpipeline.timer.supported)
+        frameMs = renderpipeline.timer.read(currentFrame);
+    else if (lastFrameStart != std::chrono::steady_clock::time_point{})
+        frameMs = std::chrono::duration<double, std::milli>(now - lastFrameStart).count();
+    lastFrameStart = now;
+
+    if (scaler.update(frameMs))
+    {
+        renderpipeline.setRenderScale(scaler.scale());
+        Log(Logger::debug) << "Render scale " << scaler.scale() << " " << renderpipeline.renderExtent.width << "x"
+                           << renderpipeline.renderExtent.height << " frame " << scaler.averageMs() << " ms";
+    }
+}
 
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
+void App::remakeSwapchain()
+{
+    /* a minimized window has no extent, block on events on the main thread, retry later on the render thread */
+    VkExtent2D extent = swapchain.surfaceExtent();
+    if (renderThread.joinable())
+    {
+        if (extent.width == 0 || extent.height == 0)
+        {
+            frameResize = true;
+            return;
+        }
+    }
+    else
+    {
+        while (extent.width == 0 || extent.height == 0)
+        {
+            glfwWaitEvents();
+            extent = swapchain.surfaceExtent();
+        }
+    }
+    swapchain.remakeSwapchain();
+    renderpipeline.makeFrameBuffer();
+    renderpipeline.invalidate(DIRTY_SWAPCHAIN);
+}
 
-    Buffer::makeBuffer(deviceSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+/* blocking, for the buffers made before the first frame */
+void App::uploadBuffer(Buffer &dst, const void *src, VkDeviceSize size, VkBufferUsageFlags usage, const char *name)
+{
+    VkCommandBuffer cmdBuffer = VK_NULL_HANDLE;
+    Buffer staging;
+    recordUpload(cmdBuffer, dst, staging, src, size, usage, name);
+    submitUpload(cmdBuffer, true);
+}
 
-    void *data;
-    vkMapMemory(instance.device, stagingBufferMemory, 0, deviceSize, 0, &data);
-    memcpy(data, model.indices.data(), (size_t)deviceSize);
-    vkUnmapMemory(instance.device, stagingBufferMemory);
+/*
+ * Device local destination, written in place when the host can map it, else through
+ * staging by a copy recorded into cmdBuffer, which is begun on the first copy. staging
+ * has to outlive the submit.
+ */
+void App::recordUpload(VkCommandBuffer &cmdBuffer, Buffer &dst, Buffer &staging, const void *src, VkDeviceSize size, VkBufferUsageFlags usage, const char *name)
+{
+    if (settings.directUpload && dst.initDirect(size, usage))
+    {
+        memcpy(dst.data, src, (size_t)size);
+        Log(Logger::info) << name << " " << size / 1024 << " KiB written directly to device local memory";
+        return;
+    }
 
-    Buffer::makeBuffer(deviceSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-                       VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indexBuffer.buffer, indexBuffer.bufferMemory);
+    staging.init(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+    void *data;
+    vkMapMemory(VulkanInstance::device, staging.bufferMemory, 0, size, 0, &data);
+    memcpy(data, src, (size_t)size);
+    vkUnmapMemory(VulkanInstance::device, staging.bufferMemory);
+
+    dst.init(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    if (cmdBuffer == VK_NULL_HANDLE)
+        cmdBuffer = RenderPipeline::beginSingleTimeCommands();
+    VkBufferCopy region{0, 0, size};
+    vkCmdCopyBuffer(cmdBuffer, staging.buffer, dst.buffer, 1, &region);
+    Log(Logger::info) << name << " " << size / 1024 << " KiB uploaded through staging";
+}
 
-    Buffer::copyBuffer(stagingBuffer, indexBuffer.buffer, deviceSize);
+/*
+ * Nothing to do when every upload was direct. Without wait the copies are queued ahead of
+ * the next frame, the barrier makes its vertex input read the new data, nothing blocks.
+ */
+void App::submitUpload(VkCommandBuffer cmdBuffer, bool wait)
+{
+    if (cmdBuffer == VK_NULL_HANDLE)
+        return;
+    if (wait)
+    {
+        RenderPipeline::endSingleTimeCommands(cmdBuffer);
+        return;
+    }
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+    vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+    vkEndCommandBuffer(cmdBuffer);
+    DeletionQueue::retire([cmdBuffer]() { vkFreeCommandBuffers(VulkanInstance::device, RenderPipeline::commandPool, 1, &cmdBuffer); });
+    Syncobjects::submit(RenderPipeline::graphicsQueue, cmdBuffer, VK_NULL_HANDLE, 0, VK_NULL_HANDLE, VK_NULL_HANDLE);
+}
 
-    vkDestroyBuffer(instance.device, stagingBuffer, nullptr);
-    vkFreeMemory(instance.device, stagingBufferMemory, nullptr);
+void App::makeIndexBuffer()
+{
+    VkDeviceSize deviceSize = sizeof(model.indices[0]) * model.indices.size();
+    uploadBuffer(indexBuffer, model.indices.data(), deviceSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, "Index buffer");
 }
 
-// fix this
 void App::makeVertexBuffer()
 {
     VkDeviceSize deviceSize = sizeof(model.vertices[0]) * model.vertices.size();
+    uploadBuffer(vertexBuffer, model.vertices.data(), deviceSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, "Vertex buffer");
+}
 
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
+void App::makeUniformBuffers()
+{
+    uniformRing.init(sizeof(UniformBufferObject));
+    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+        renderpipeline.uniformOffsets[i] = static_cast<uint32_t>(uniformRing.regionSize * i);
+}
 
-    Buffer::makeBuffer(deviceSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+/* one region of world matrices per frame in flight, the scene only rewrites what changed */
+void App::makeInstanceBuffer()
+{
+    VkPhysicalDeviceProperties props{};
+    vkGetPhysicalDeviceProperties(VulkanInstance::physicalDevice, &props);
+    VkDeviceSize alignment = std::max<VkDeviceSize>(props.limits.minStorageBufferOffsetAlignment, 1);
+    /* room to grow, nodes past it fail in addNode instead of writing past the region */
+    uint32_t capacity = 64;
+    while (capacity < scene.size())
+        capacity *= 2;
+    scene.setCapacity(capacity);
+    instanceRange = sizeof(glm::mat4) * capacity;
+    VkDeviceSize regionSize = (instanceRange + alignment - 1) & ~(alignment - 1);
+
+    instanceBuffer.init(regionSize * MAX_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    vkMapMemory(VulkanInstance::device, instanceBuffer.bufferMemory, 0, instanceBuffer.size, 0, &instanceBuffer.data);
+    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+        renderpipeline.instanceOffsets[i] = static_cast<uint32_t>(regionSize * i);
+}
 
-    void *data;
-    vkMapMemory(instance.device, stagingBufferMemory, 0, deviceSize, 0, &data);
-    memcpy(data, model.vertices.data(), (size_t)deviceSize);
-    vkUnmapMemory(instance.device, stagingBufferMemory);
+void App::makeBindless()
+{
+    if (!settings.bindless)
+        return;
+    if (renderpipeline.virtualTexture)
+    {
+        Log(Logger::warn) << "Virtual texturing replaces the bindless texture array";
+        return;
+    }
+    if (!VulkanInstance::features.descriptorIndexing)
+    {
+        Log(Logger::warn) << "Descriptor indexing not supported, using bound descriptor sets";
+        return;
+    }
+    renderpipeline.bindless = true;
+    renderpipeline.bindlessTextures.init(texture.sampler);
+    textureSlot = renderpipeline.bindlessTextures.add(texture.imageView);
+}
+
+void App::makeVirtualTexture()
+{
+    if (settings.virtualTexture.empty())
+        return;
+    if (!VulkanInstance::features.fragmentStores)
+    {
+        Log(Logger::warn) << "No storage writes from fragment shaders, virtual texturing disabled";
+        return;
+    }
+    virtualTexture.init(settings.virtualTexture, VkDeviceSize(settings.virtualCacheMiB) << 20);
+    renderpipeline.virtualTexture = &virtualTexture;
+}
+
+/* the model is only reloaded while it is not streamed, the texture while it is not virtual */
+void App::watchAssets()
+{
+    if (!settings.hotReload || !watcher.init())
+        return;
+    if (settings.streamPath.empty())
+        watcher.watch(model.path);
+    if (!virtualTexture.active())
+        watcher.watch(settings.texture);
+    for (const std::string &shader : renderpipeline.shaderFiles())
+        watcher.watch(shader);
+}
 
-    Buffer::makeBuffer(deviceSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-                       VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexBuffer.buffer, vertexBuffer.bufferMemory);
+/* frame boundary on the render thread: parses changed files on workers, swaps finished ones in the order they changed */
+void App::hotReload()
+{
+    auto now = std::chrono::steady_clock::now();
+    for (const std::string &path : watcher.poll())
+    {
+        auto reload = std::make_unique<AssetReload>();
+        reload->path = path;
+        reload->changed = now;
+        reload->kind = path == model.path ? AssetReload::model : path == settings.texture ? AssetReload::texture : AssetReload::shader;
+        AssetReload *pending = reload.get();
+        reloads.push_back(std::move(reload));
+        Jobs::spawn([this, pending] { parseAsset(*pending); }, &reloadJobs);
+    }
 
-    Buffer::copyBuffer(stagingBuffer, vertexBuffer.buffer, deviceSize);
+    while (!reloads.empty() && reloads.front()->done.load(std::memory_order_acquire))
+    {
+        AssetReload &reload = *reloads.front();
+        try
+        {
+            if (!reload.error.empty())
+                throw std::runtime_error(reload.error);
+            if (reload.kind == AssetReload::model)
+                swapModel(reload);
+            else if (reload.kind == AssetReload::texture)
+                swapTexture(reload);
+            else
+                swapShader(reload);
+            double latencyMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - reload.changed).count();
+            Log(Logger::info) << "Reloaded " << reload.path << " in " << latencyMs << " ms, parse " << reload.parseMs << " ms";
+        }
+        catch (const std::exception &e)
+        {
+            Log(Logger::warn) << "Keeping previous " << reload.path << ": " << e.what();
+        }
+        if (reload.pixels)
+            stbi_image_free(reload.pixels);
+        reloads.pop_front();
+    }
+}
 
-    vkDestroyBuffer(instance.device, stagingBuffer, nullptr);
-    vkFreeMemory(instance.device, stagingBufferMemory, nullptr);
+/* job: only touches the reload, the swap happens on the render thread */
+void App::parseAsset(AssetReload &reload)
+{
+    auto start = std::chrono::steady_clock::now();
+    try
+    {
+        if (reload.kind == AssetReload::model)
+        {
+            reload.model.path = reload.path;
+            reload.model.loadModel();
+            if (reload.model.indices.empty())
+                throw std::runtime_error("No triangles in " + reload.path);
+        }
+        else if (reload.kind == AssetReload::texture)
+        {
+            int channels;
+            reload.pixels = stbi_load(reload.path.c_str(), &reload.width, &reload.height, &channels, STBI_rgb_alpha);
+            if (!reload.pixels)
+                throw std::runtime_error("Failed to load texture image!");
+        }
+        else
+        {
+            /* both stages, the swap builds the pipeline from these bytes without touching the disk */
+            std::vector<std::string> files = renderpipeline.shaderFiles();
+            reload.vertexShader = RenderPipeline::readShader(files[0]);
+            reload.fragmentShader = RenderPipeline::readShader(files[1]);
+            /* a failed compile leaves a broken module, the driver is not trusted to reject it */
+            for (const std::vector<char> *code : {&reload.vertexShader, &reload.fragmentShader})
+            {
+                uint32_t magic = 0;
+                if (code->size() >= sizeof(magic))
+                    memcpy(&magic, code->data(), sizeof(magic));
+                if (code->size() % 4 != 0 || magic != 0x07230203)
+                    throw std::runtime_error("Not a SPIR-V module");
+            }
+        }
+    }
+    catch (const std::exception &e)
+    {
+        reload.error = e.what();
+    }
+    reload.parseMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    reload.done.store(true, std::memory_order_release);
 }
 
-void App::makeUniformBuffers()
+/* frames still reading the old buffers keep them until they finished */
+void App::swapModel(AssetReload &reload)
 {
-    VkDeviceSize bufferSize = sizeof(UniformBufferObject);
+    VkCommandBuffer cmdBuffer = VK_NULL_HANDLE;
+    Buffer vertices;
+    Buffer indices;
+    Buffer vertexStaging;
+    Buffer indexStaging;
+    recordUpload(cmdBuffer, vertices, vertexStaging, reload.model.vertices.data(), sizeof(reload.model.vertices[0]) * reload.model.vertices.size(),
+        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, "Vertex buffer");
+    recordUpload(cmdBuffer, indices, indexStaging, reload.model.indices.data(), sizeof(reload.model.indices[0]) * reload.model.indices.size(),
+        VK_BUFFER_USAGE_INDEX_BUFFER_BIT, "Index buffer");
+    submitUpload(cmdBuffer, false);
+
+    vertexBuffer.reset();
+    indexBuffer.reset();
+    vertexBuffer = std::move(vertices);
+    indexBuffer = std::move(indices);
+    model = std::move(reload.model);
+    for (DrawCommand &draw : drawList)
+        draw.indexCount = static_cast<uint32_t>(model.indices.size());
+    renderpipeline.invalidate(DIRTY_DRAWLIST);
+}
 
-    uniformBuffers.resize(MAX_FRAMES_IN_FLIGHT);
-    uniformBuffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
+void App::swapTexture(AssetReload &reload)
+{
+    uint32_t width = static_cast<uint32_t>(reload.width);
+    uint32_t height = static_cast<uint32_t>(reload.height);
+    VkDeviceSize imageSize = VkDeviceSize(width) * height * 4;
 
-    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    Buffer staging;
+    staging.init(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    void *data;
+    vkMapMemory(VulkanInstance::device, staging.bufferMemory, 0, imageSize, 0, &data);
+    memcpy(data, reload.pixels, imageSize);
+    vkUnmapMemory(VulkanInstance::device, staging.bufferMemory);
+
+    Image fresh{VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT};
+    fresh.makeImage(width, height, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+    fresh.makeImageView(VK_IMAGE_ASPECT_COLOR_BIT);
+
+    VkCommandBuffer cmdBuffer = RenderPipeline::beginSingleTimeCommands();
+    recordTextureUpload(cmdBuffer, staging, fresh, width, height);
+    vkEndCommandBuffer(cmdBuffer);
+    staging.reset();
+    DeletionQueue::retire([cmdBuffer]() { vkFreeCommandBuffers(VulkanInstance::device, RenderPipeline::commandPool, 1, &cmdBuffer); });
+    Syncobjects::submit(RenderPipeline::graphicsQueue, cmdBuffer, VK_NULL_HANDLE, 0, VK_NULL_HANDLE, VK_NULL_HANDLE);
+
+    /* the sampler stays for every texture, the bindless layout holds it as immutable sampler */
+    if (!renderpipeline.bindless)
+        renderpipeline.replaceTexture(fresh.imageView, texture.sampler);
+    fresh.sampler = std::move(texture.sampler);
+    if (renderpipeline.bindless)
     {
-        Buffer::makeBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, uniformBuffers[i].buffer, uniformBuffers[i].bufferMemory);
-        vkMapMemory(instance.device, uniformBuffers[i].bufferMemory, 0, bufferSize, 0, &uniformBuffersMapped[i]);
+        /* the array is update after bind, frames in flight keep sampling the old slot */
+        uint32_t slot = renderpipeline.bindlessTextures.add(fresh.imageView);
+        renderpipeline.bindlessTextures.remove(textureSlot, currentFrame);
+        textureSlot = slot;
+        for (DrawCommand &draw : drawList)
+        {
+            draw.object.materialIndex = slot;
+            draw.sortKey = SortKey::pack(SortKey::pass(draw.sortKey), SortKey::pipeline(draw.sortKey), slot,
+                SortKey::mesh(draw.sortKey), SortKey::depth(draw.sortKey));
+        }
+        renderpipeline.invalidate(DIRTY_DRAWLIST);
     }
+    texture.retire();
+    texture = std::move(fresh);
 }
 
-// fix this
-void App::makeTextureImage()
+/* only the files of the graphics pipeline are watched, it is the one pipeline built from them */
+void App::swapShader(AssetReload &reload)
 {
-    int texWidth, texHeight, texChannels;
-    stbi_uc *pixels = stbi_load("swmg.jpg", &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
-    VkDeviceSize imageSize = texWidth * texHeight * 4;
+    renderpipeline.makePipeline(reload.vertexShader, reload.fragmentShader);
+    renderpipeline.invalidate(DIRTY_PIPELINE);
+}
+
+/* one draw per object, laid out on a grid when stress testing with many draws */
+void App::makeDrawList()
+{
+    uint32_t side = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<float>(settings.drawCount))));
+    float spacing = 8.0f;
+    float origin = -0.5f * spacing * (side - 1);
+
+    scene.clear();
+    pivots.clear();
+    pivotPositions.clear();
+    uint32_t root = scene.addNode(Scene::ROOT, glm::mat4(1.0f));
+    if (!settings.streamPath.empty())
+    {
+        streamNode = scene.addNode(root, glm::mat4(1.0f));
+        drawList.clear();
+        renderpipeline.invalidate(DIRTY_DRAWLIST);
+        return;
+    }
+    drawList.resize(settings.drawCount);
+    for (uint32_t i = 0; i < settings.drawCount; i++)
+    {
+        DrawCommand &draw = drawList[i];
+        draw.indexCount = static_cast<uint32_t>(model.indices.size());
+        draw.firstIndex = 0;
+        draw.vertexOffset = 0;
+        glm::vec3 position(origin + spacing * (i % side), 0.0f, origin + spacing * (i / side));
+        if (i % SPIN_STRIDE == 0)
+        {
+            pivots.push_back(scene.addNode(root, glm::translate(glm::mat4(1.0f), position)));
+            pivotPositions.push_back(position);
+            draw.object.objectId = scene.addNode(pivots.back(), glm::mat4(1.0f));
+        }
+        else
+            draw.object.objectId = scene.addNode(root, glm::translate(glm::mat4(1.0f), position));
+        draw.object.materialIndex = textureSlot;
+        draw.sortKey = SortKey::pack(0, 0, textureSlot, 0, 0);
+    }
+    renderpipeline.invalidate(DIRTY_DRAWLIST);
+}
 
-    if (!pixels)
+/* refreshes the depth bucket of every key, front to back inside a state group */
+void App::sortDraws(const glm::vec3 &eye)
+{
+    const uint64_t depthMask = SortKey::DEPTH_BUCKETS - 1;
+    /* with the orbiting camera the depth order changes nearly every frame, re-recording reused buffers costs more than the overdraw it saves */
+    if (!settings.reuseCommandBuffers)
+    {
+        for (DrawCommand &draw : drawList)
+        {
+            glm::vec3 position = glm::vec3(scene.world(draw.object.objectId)[3]);
+            float distance = glm::clamp(glm::length(position - eye) / Camera::FAR_PLANE, 0.0f, 1.0f);
+            uint64_t bucket = static_cast<uint64_t>(distance * depthMask);
+            draw.sortKey = (draw.sortKey & ~depthMask) | bucket;
+        }
+    }
+
+    /* the sort is stable, an ordered list would come out unchanged and keeps its recorded commands */
+    auto byKey = [](const DrawCommand &a, const DrawCommand &b) { return a.sortKey < b.sortKey; };
+    if (std::is_sorted(drawList.begin(), drawList.end(), byKey))
+        return;
+    sortDrawList(drawList, drawScratch);
+    renderpipeline.invalidate(DIRTY_DRAWLIST);
+}
+
+void App::loadTexture()
+{
+    int texChannels;
+    texturePixels = stbi_load(settings.texture.c_str(), &textureWidth, &textureHeight, &texChannels, STBI_rgb_alpha);
+    if (!texturePixels)
         throw std::runtime_error("Failed to load texture image!");
+}
 
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
+// fix this
+void App::makeTextureImage()
+{
+    int texWidth = textureWidth, texHeight = textureHeight;
+    stbi_uc *pixels = texturePixels;
+    texturePixels = nullptr;
+    VkDeviceSize imageSize = texWidth * texHeight * 4;
 
-    Buffer::makeBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+    Buffer staging;
+    staging.init(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
     void *data;
-    vkMapMemory(VulkanInstance::device, stagingBufferMemory, 0, imageSize, 0, &data);
+    vkMapMemory(VulkanInstance::device, staging.bufferMemory, 0, imageSize, 0, &data);
     memcpy(data, pixels, imageSize);
-    vkUnmapMemory(VulkanInstance::device, stagingBufferMemory);
+    vkUnmapMemory(VulkanInstance::device, staging.bufferMemory);
 
     stbi_image_free(pixels);
 
     texture.makeImage(texWidth, texHeight, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
 
-    texture.transitionImageLayout(renderpipeline, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL); // specify correct layout for transfers
-    copyBufferToImage(stagingBuffer, texture.image, texWidth, texHeight);
-    texture.transitionImageLayout(renderpipeline, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL); // specify correct layout for shaders
+    VkCommandBuffer cmdBuffer = RenderPipeline::beginSingleTimeCommands();
+    recordTextureUpload(cmdBuffer, staging, texture, texWidth, texHeight);
+    RenderPipeline::endSingleTimeCommands(cmdBuffer);
+}
 
-    vkDestroyBuffer(VulkanInstance::device, stagingBuffer, nullptr);
-    vkFreeMemory(VulkanInstance::device, stagingBufferMemory, nullptr);
+/* layout transitions come from the graph, the upload is a single submit */
+void App::recordTextureUpload(VkCommandBuffer cmdBuffer, const Buffer &staging, const Image &image, uint32_t width, uint32_t height)
+{
+    RenderGraph graph;
+    uint32_t stagingResource = graph.importBuffer("staging", staging.buffer);
+    uint32_t textureResource = graph.importImage("texture", image.image, VK_IMAGE_ASPECT_COLOR_BIT);
+    graph.addPass("upload texture",
+        {{stagingResource, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT}},
+        {{textureResource, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL}},
+        [&](VkCommandBuffer passBuffer) { copyBufferToImage(passBuffer, staging.buffer, image.image, width, height); });
+    graph.exportResource(textureResource, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    graph.compile();
+    if (settings.dumpGraph)
+    {
+        std::ostringstream os;
+        graph.dump(os);
+        Log(Logger::debug) << os.str();
+    }
+    graph.execute(cmdBuffer);
 }
 
-// fix this
-void App::makeDepthResources()
+/* aliasing saves what the attachments would need apart, lazy blocks only commit what the tiles spilled */
+void App::reportAttachmentMemory()
 {
-    depth.makeImage(swapchain.swapchainExtent.width, swapchain.swapchainExtent.height, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT);
-    depth.makeImageView(VK_IMAGE_ASPECT_DEPTH_BIT);
+    const RenderGraph &graph = renderpipeline.frameGraph;
+    VkDeviceSize requested = graph.transientBytesRequested();
+    VkDeviceSize allocated = graph.transientBytesAllocated();
+    VkDeviceSize committed = graph.transientBytesCommitted();
+    Log(Logger::info) << "Attachments msaa " << renderpipeline.msaaSamples << "x"
+                      << " requested " << requested / 1024 << " KiB allocated " << allocated / 1024
+                      << " KiB committed " << committed / 1024 << " KiB saved " << (requested - committed) / 1024 << " KiB";
+    metrics.set("attachment_kib", committed / 1024);
 }
 
-void App::loop()
+void App::benchmarkRun(const char *label)
+{
+    renderpipeline.staticRecordCount = 0;
+    cpuFrameTimes.clear();
+    gpuFrameTimes.clear();
+    uint64_t bindsIssued = 0;
+    uint64_t bindsSkipped = 0;
+    for (uint32_t i = 0; i < settings.benchFrames && !glfwWindowShouldClose(Window::win); i++)
+    {
+        glfwPollEvents();
+        simulate();
+        drawFrame();
+        bindsIssued += renderpipeline.binds.issued;
+        bindsSkipped += renderpipeline.binds.skipped;
+    }
+    size_t frames = std::max<size_t>(cpuFrameTimes.count(), 1);
+    Log(Logger::info) << label << " draws " << drawList.size() << " frames " << cpuFrameTimes.count()
+                      << " cpu ms mean " << cpuFrameTimes.mean() << " median " << cpuFrameTimes.median()
+                      << " p99 " << cpuFrameTimes.percentile(0.99)
+                      << " records " << (settings.reuseCommandBuffers ? renderpipeline.staticRecordCount : cpuFrameTimes.count())
+                      << " binds per frame issued " << bindsIssued / frames << " skipped " << bindsSkipped / frames
+                      << " render scale " << renderpipeline.renderScale;
+
+    std::string key{label};
+    std::replace(key.begin(), key.end(), ' ', '_');
+    metrics.set(key + ".cpu_ms_median", cpuFrameTimes.median());
+    metrics.set(key + ".cpu_ms_p99", cpuFrameTimes.percentile(0.99));
+    if (gpuFrameTimes.count())
+        metrics.set(key + ".gpu_ms_median", gpuFrameTimes.median());
+}
+
+/* same scene rendered with every recording strategy */
+void App::benchmark()
+{
+    Settings saved = settings;
+
+    settings.reuseCommandBuffers = false;
+    for (uint32_t threads : {0u, 1u, 2u, 4u, 8u})
+    {
+        renderpipeline.setRecordThreads(threads);
+        std::string label = "rerecord threads " + std::to_string(threads);
+        benchmarkRun(label.c_str());
+    }
+
+    settings.reuseCommandBuffers = true;
+    renderpipeline.setRecordThreads(saved.recordThreads);
+    benchmarkRun("reuse");
+
+    settings = saved;
+    vkDeviceWaitIdle(VulkanInstance::device);
+    GpuMemory::log();
+}
+
+static size_t residentMemory()
+{
+    std::ifstream statm{"/proc/self/statm"};
+    size_t total = 0, resident = 0;
+    statm >> total >> resident;
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+/* resizes the window every frame while rendering, memory has to stay flat */
+void App::resizeStress()
 {
-    std::cout << Logger::info << "Main loop" << Logger::reset;
-    while (!glfwWindowShouldClose(Window::win))
+    size_t startMemory = residentMemory();
+    for (uint32_t i = 0; i < settings.resizeStress && !glfwWindowShouldClose(Window::win); i++)
     {
+        glfwSetWindowSize(Window::win, 640 + (i * 37) % 600, 480 + (i * 53) % 400);
         glfwPollEvents();
+        simulate();
         drawFrame();
+        if (i % 100 == 0)
+            Log(Logger::debug) << "resize " << i << " rss " << residentMemory() / 1024 << " KiB pending deletions " << DeletionQueue::pending();
     }
-    std::cout << Logger::info << "Terminating" << Logger::reset;
     vkDeviceWaitIdle(VulkanInstance::device);
+    Log(Logger::info) << "resize stress " << settings.resizeStress << " rss start " << startMemory / 1024 << " KiB end "
+                      << residentMemory() / 1024 << " KiB pending deletions " << DeletionQueue::pending();
+}
+
+void App::loop()
+{
+    if (settings.benchFrames)
+    {
+        benchmark();
+        return;
+    }
+    if (settings.resizeStress)
+    {
+        resizeStress();
+        return;
+    }
+    Log(Logger::info) << "Main loop";
+    simulate();
+    renderThread = std::thread(&App::renderLoop, this);
+    while (!glfwWindowShouldClose(Window::win) && !renderFailed.load(std::memory_order_acquire))
+    {
+        /* never blocks on the GPU, acquire and fence waits only stall the render thread */
+        glfwWaitEventsTimeout(SIMULATION_INTERVAL);
+        Jobs::pumpMain();
+        simulate();
+    }
+    renderMessages.push({RenderMessage::quit});
+    renderThread.join();
+    renderThread = std::thread();
+    if (renderError)
+        std::rethrow_exception(renderError);
+    Log(Logger::info) << "Terminating";
+    vkDeviceWaitIdle(VulkanInstance::device);
+}
+
+/* render thread: owns the queue, drains window messages between frames */
+void App::renderLoop()
+{
+    try
+    {
+        bool minimized = false;
+        while (true)
+        {
+            RenderMessage message;
+            while (renderMessages.pop(message))
+            {
+                if (message.type == RenderMessage::quit)
+                    return;
+                minimized = message.width == 0 || message.height == 0;
+                frameResize = true;
+            }
+            if (minimized)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                continue;
+            }
+            drawFrame();
+        }
+    }
+    catch (...)
+    {
+        renderError = std::current_exception();
+        renderFailed.store(true, std::memory_order_release);
+        glfwPostEmptyEvent();
+    }
 }
 
-// needs refactor
 void App::clean()
 {
-    std::cout << Logger::info << "Cleanup" << Logger::reset;
-
-    // for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
-    // {
-    //     vkDestroyBuffer(VulkanInstance::device, uniformBuffers[i], nullptr);
-    //     vkFreeMemory(VulkanInstance::device, uniformBuffersMemory[i], nullptr);
-    // }
-
-    // vkDestroyImageView(VulkanInstance::device, depthImageView, nullptr);
-    // vkDestroyImage(VulkanInstance::device, depthImage, nullptr);
-    // vkFreeMemory(VulkanInstance::device, depthImageMemory, nullptr);
-
-    // vkDestroySampler(VulkanInstance::device, textureSampler, nullptr);
-
-    // vkDestroyImageView(VulkanInstance::device, textureImageView, nullptr);
-
-    // vkDestroyImage(VulkanInstance::device, textureImage, nullptr);
-    // vkFreeMemory(VulkanInstance::device, textureImageMemory, nullptr);
-
-    // vkDestroyDescriptorPool(VulkanInstance::device, descriptorPool, nullptr);
-    // vkDestroyDescriptorSetLayout(VulkanInstance::device, descriptorSetLayout, nullptr);
-
-    // vkDestroyBuffer(VulkanInstance::device, vertexBuffer, nullptr);
-    // vkFreeMemory(VulkanInstance::device, vertexBufferMemory, nullptr);
-
-    // vkDestroyBuffer(VulkanInstance::device, indexBuffer, nullptr);
-    // vkFreeMemory(VulkanInstance::device, indexBufferMemory, nullptr);
-
-    // for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
-    // {
-    //     vkDestroyFence(VulkanInstance::device, inFlightFences[i], nullptr);
-    //     vkDestroySemaphore(VulkanInstance::device, imageDoneSemaphores[i], nullptr);
-    //     vkDestroySemaphore(VulkanInstance::device, renderFinishedSemaphores[i], nullptr);
-    // }
-
-    // vkDestroyCommandPool(VulkanInstance::device, commandPool, nullptr);
-    // for (auto &buffer : swapchainFramebuffers)
-    //     vkDestroyFramebuffer(VulkanInstance::device, buffer, nullptr);
-    // vkDestroyPipeline(VulkanInstance::device, graphicsPipeline, nullptr);
-    // vkDestroyPipelineLayout(VulkanInstance::device, pipelineLayout, nullptr);
-    // vkDestroyRenderPass(VulkanInstance::device, renderPass, nullptr);
-    // for (auto &imageView : swapchainImagesViews)
-    //     vkDestroyImageView(VulkanInstance::device, imageView, nullptr);
-    // vkDestroySwapchainKHR(VulkanInstance::device, swapchain, nullptr);
-    // vkDestroyDevice(VulkanInstance::device, nullptr);
-    // vkDestroySurfaceKHR(instance, surface, nullptr);
-    // vkDestroyInstance(instance, nullptr);
+    Log(Logger::info) << "Cleanup";
+    VkDevice device = VulkanInstance::device;
+    reportAttachmentMemory();
+
+    Jobs::wait(reloadJobs);
+    for (auto &reload : reloads)
+    {
+        if (reload->pixels)
+            stbi_image_free(reload->pixels);
+    }
+    reloads.clear();
+    watcher.destroy();
+
+    /* owned handles retire into the deletion queue, flushed once the device is idle */
+    renderpipeline.recorder.destroy();
+    renderpipeline.swapchainFramebuffers.clear();
+    renderpipeline.graphicsPipeline.reset();
+    renderpipeline.pipelineLayout.reset();
+    texture.retire();
+    renderpipeline.frameGraph.clear();
+    vertexBuffer.reset();
+    indexBuffer.reset();
+    uniformRing.buffer.reset();
+    instanceBuffer.reset();
+    swapchain.swapchainImagesViews.clear();
+    vkDeviceWaitIdle(device);
+    capture.destroy();
+    streamer.destroy();
+    virtualTexture.destroy();
+    DeletionQueue::flush();
+    if (int64_t leaked = reportLeakedHandles())
+        Log(Logger::warn) << leaked << " Vulkan handles leaked";
+
+    syncobjects.destroy();
+    renderpipeline.timer.destroy();
+    vkDestroyCommandPool(device, renderpipeline.commandPool, nullptr);
+    if (renderpipeline.pipelineCache != VK_NULL_HANDLE)
+        vkDestroyPipelineCache(device, renderpipeline.pipelineCache, nullptr);
+    if (renderpipeline.bindless)
+    {
+        vkDestroyDescriptorPool(device, renderpipeline.bindlessTextures.pool, nullptr);
+        vkDestroyDescriptorSetLayout(device, renderpipeline.bindlessTextures.layout, nullptr);
+    }
+    vkDestroyDescriptorPool(device, renderpipeline.descriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(device, renderpipeline.descriptorSetLayout, nullptr);
+    if (renderpipeline.renderPass != VK_NULL_HANDLE)
+        vkDestroyRenderPass(device, renderpipeline.renderPass, nullptr);
+    vkDestroySwapchainKHR(device, swapchain.swapchain, nullptr);
+    instance.destroy();
     glfwDestroyWindow(window.win);
     glfwTerminate();
 }
 
-void App::copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height)
+void App::copyBufferToImage(VkCommandBuffer commandBuffer, VkBuffer buffer, VkImage image, uint32_t width, uint32_t height)
 {
-    VkCommandBuffer commandBuffer = RenderPipeline::beginSingleTimeCommands();
     VkBufferImageCopy region{};
     region.bufferOffset = 0;
     region.bufferRowLength = 0;
@@ -268,19 +837,113 @@ void App::copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint
         height,
         1};
     vkCmdCopyBufferToImage(commandBuffer, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
-    RenderPipeline::endSingleTimeCommands(commandBuffer);
 }
 
 void App::run()
 {
+    if (settings.benchJobs)
+    {
+        Jobs::benchmark(settings.benchJobs);
+        return;
+    }
+    if (!settings.makeChunks.empty())
+    {
+        model.path = settings.model;
+        model.loadModel();
+        MeshStreamer::convert(model, settings.makeChunks);
+        return;
+    }
+    if (!settings.makeVirtualTexture.empty())
+    {
+        VirtualTexture::convert(settings.texture, settings.makeVirtualTexture);
+        return;
+    }
     init();
     loop();
     clean();
+    checkRegressions();
+}
+
+/* throws after logging every failed check so the exit status reports the regression */
+void App::checkRegressions()
+{
+    struct rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    metrics.set("peak_rss_kib", usage.ru_maxrss);
+    for (size_t i = 0; i < static_cast<size_t>(MemoryCategory::count); i++)
+    {
+        MemoryCategory category = static_cast<MemoryCategory>(i);
+        metrics.set(std::string("memory.") + GpuMemory::name(category) + "_peak_kib", GpuMemory::categoryPeak(category) / 1024);
+    }
+    std::vector<GpuMemory::Heap> heaps = GpuMemory::heaps();
+    for (size_t i = 0; i < heaps.size(); i++)
+        metrics.set("memory.heap" + std::to_string(i) + "_peak_kib", heaps[i].peak / 1024);
+    if (!settings.metricsPath.empty())
+    {
+        metrics.write(settings.metricsPath);
+        Log(Logger::info) << "Metrics written to " << settings.metricsPath;
+    }
+
+    uint32_t failures = 0;
+    if (!settings.baselinePath.empty())
+    {
+        for (const std::string &regression : metrics.regressions(Metrics::read(settings.baselinePath), settings.regressionThreshold / 100.0))
+        {
+            Log(Logger::error) << "Regression " << regression;
+            failures++;
+        }
+    }
+    if (!settings.goldenPath.empty())
+    {
+        std::string frame = capture.file(settings.goldenFrame);
+        if (frame.empty() || settings.captureFormat != "png")
+        {
+            Log(Logger::error) << "Frame " << settings.goldenFrame << " was not captured as png";
+            failures++;
+        }
+        else if (settings.updateGolden)
+        {
+            std::filesystem::copy_file(frame, settings.goldenPath, std::filesystem::copy_options::overwrite_existing);
+            Log(Logger::info) << "Golden " << settings.goldenPath << " updated from " << frame;
+        }
+        else if (!std::filesystem::exists(settings.goldenPath))
+        {
+            Log(Logger::error) << "Golden " << settings.goldenPath << " missing, create it with --update-golden";
+            failures++;
+        }
+        else
+        {
+            double difference = GoldenImage::difference(frame, settings.goldenPath);
+            Log(Logger::info) << "Golden " << settings.goldenPath << " differs in " << difference * 100.0 << "% of pixels";
+            if (difference > settings.goldenTolerance)
+            {
+                Log(Logger::error) << "Frame " << frame << " does not match golden " << settings.goldenPath;
+                failures++;
+            }
+        }
+    }
+    if (failures)
+        throw std::runtime_error(std::to_string(failures) + " regression checks failed");
 }
 
 void App::init()
 {
-    std::cout << Logger::info << "Engine started" << Logger::reset;
+    Log(Logger::info) << "Engine started";
+    auto loadStart = std::chrono::steady_clock::now();
+    model.path = settings.model;
+    if (settings.streamPath.empty())
+        Jobs::spawn([this] { model.loadModel(); }, &assetLoads);
+    Jobs::spawn([this] { loadTexture(); }, &assetLoads);
+    window.onResize = [this](int width, int height) {
+        if (renderThread.joinable())
+            renderMessages.push({RenderMessage::resize, width, height});
+        else
+            frameResize = true;
+    };
+    if (!settings.replayClock.empty())
+        simulation.clock.replay(settings.replayClock);
+    else if (!settings.recordClock.empty())
+        simulation.clock.record(settings.recordClock);
     window.init();
     instance.init();
 
@@ -291,34 +954,64 @@ void App::init()
     instance.pickPhysicalDevice();
     instance.makeLogicalDevice();
 
-    std::cout << Logger::info << "Swapchain created" << Logger::reset;
+    Log(Logger::info) << "Swapchain created";
     /* SwapChain */
     swapchain.makeSwapchain();
 
     /* pipeline */
-    std::cout << Logger::info << "Renderpipeline" << Logger::reset;
-    renderpipeline.makeRenderPass(depth);
+    Log(Logger::info) << "Renderpipeline";
+    renderpipeline.msaaSamples = RenderPipeline::pickSampleCount(settings.msaa);
+    renderpipeline.dynamicRendering = settings.dynamicRendering && VulkanInstance::features.dynamicRendering;
+    if (settings.dynamicRendering && !renderpipeline.dynamicRendering)
+        Log(Logger::warn) << "Dynamic rendering not supported, using render pass";
+    renderpipeline.upscale = settings.targetFrameMs > 0.0f && RenderPipeline::canUpscale();
+    if (settings.targetFrameMs > 0.0f && !renderpipeline.upscale)
+        Log(Logger::warn) << "Swapchain images cannot be blitted to, dynamic resolution disabled";
+    scaler.targetMs = settings.targetFrameMs;
+    renderpipeline.makeRenderPass();
     renderpipeline.makeDescriptorSetLayout();
-    renderpipeline.makePipeline();
     renderpipeline.makeCommandPool();
-    makeDepthResources();
-    renderpipeline.makeFrameBuffer(depth);
+    renderpipeline.timer.init(QueueFamilyIndicies::findQueueFamilyIndicies(VulkanInstance::physicalDevice, VulkanInstance::surface).graphicsFamily.value());
+    if (renderpipeline.upscale && !renderpipeline.timer.supported)
+        Log(Logger::warn) << "No timestamp queries, dynamic resolution follows cpu frame time";
+    if (!settings.captureDir.empty() && !capture.init(settings.captureDir, settings.captureFormat == "yuv" ? FrameCapture::yuv : FrameCapture::png))
+        Log(Logger::warn) << "Swapchain images cannot be copied from, frame capture disabled";
+    renderpipeline.makeFrameBuffer();
+    if (settings.dumpGraph)
+    {
+        std::ostringstream os;
+        renderpipeline.frameGraph.dump(os);
+        Log(Logger::debug) << os.str();
+    }
+    Jobs::wait(assetLoads);
     makeTextureImage();
     texture.makeImageView(VK_IMAGE_ASPECT_COLOR_BIT);
     texture.makeImageSampler();
+    makeVirtualTexture();
+    makeBindless();
+    renderpipeline.makePipeline();
     renderpipeline.makeCommandBuffer();
+    renderpipeline.setRecordThreads(settings.recordThreads);
 
     /* Vertex Buffer */
-    std::cout << Logger::info << "Model creation" << Logger::reset;
-    model.loadModel();
+    Log(Logger::info) << "Model creation";
+    makeDrawList();
 
-    std::cout << Logger::info << "Buffer initialization" << Logger::reset;
-    makeVertexBuffer();
-    makeIndexBuffer();
+    Log(Logger::info) << "Buffer initialization";
+    if (!settings.streamPath.empty())
+        streamer.init(settings.streamPath, VkDeviceSize(settings.streamPoolMiB) << 20, vertexBuffer, indexBuffer);
+    else
+    {
+        makeVertexBuffer();
+        makeIndexBuffer();
+    }
     makeUniformBuffers();
+    makeInstanceBuffer();
     renderpipeline.makeDescriptorPool();
-    renderpipeline.makeDescriptorSets(uniformBuffers, texture);
+    renderpipeline.makeDescriptorSets(uniformRing.buffer, sizeof(UniformBufferObject), texture, instanceBuffer, instanceRange);
 
     /* Sync */
     syncobjects.makeSyncObjects();
+    watchAssets();
+    metrics.set("load_ms", std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - loadStart).count());
 }
\ No newline at end of file
@@ -17,7 +17,7 @@ inline static uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags
     vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProps);
     for (uint32_t i = 0; i < memProps.memoryTypeCount; i++)
     {
-        if (typeFilter & (i << 1) && (memProps.memoryTypes[i].propertyFlags & props) == props)
+        if ((typeFilter & (1u << i)) && (memProps.memoryTypes[i].propertyFlags & props) == props)
             return i;
     }
     throw std::runtime_error("Failed to find suitable memory type");
@@ -32,8 +32,59 @@ inline static uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags
 #include "buffer.hpp"
 #include "image.hpp"
 #include "Model.hpp"
+#include "Settings.hpp"
+#include "FrameStats.hpp"
+#include "uniformRing.hpp"
+#include "DrawList.hpp"
+#include "Scene.hpp"
+#include "Camera.hpp"
+#include "ResolutionScaler.hpp"
+#include "frameCapture.hpp"
+#include "meshStreamer.hpp"
+#include "virtualTexture.hpp"
+#include "Regression.hpp"
+#include "Simulation.hpp"
+#include "TripleBuffer.hpp"
+#include "MpscQueue.hpp"
+#include "JobSystem.hpp"
+#include "AssetWatcher.hpp"
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <exception>
 
 #define MAX_FRAMES_IN_FLIGHT 2
+/* longest the main thread waits for events before advancing the simulation */
+#define SIMULATION_INTERVAL (1.0 / 240.0)
+
+/* main thread to render thread */
+struct RenderMessage
+{
+    enum Type { resize, quit } type = resize;
+    int width = 0;
+    int height = 0;
+};
+
+/* a changed file, parsed on a worker and swapped in by the render thread */
+struct AssetReload
+{
+    enum Kind { model, texture, shader } kind = model;
+    std::string path;
+    std::chrono::steady_clock::time_point changed;
+    double parseMs = 0.0;
+    std::atomic<bool> done{false};
+    /* set instead of the parsed data when the file could not be used */
+    std::string error;
+    Model model;
+    unsigned char *pixels = nullptr;
+    int width = 0;
+    int height = 0;
+    /* SPIR-V of both stages, whichever of them changed */
+    std::vector<char> vertexShader;
+    std::vector<char> fragmentShader;
+};
 
 
 class App {
@@ -41,6 +92,7 @@ class App {
         uint32_t currentFrame = 0;
         Window window;
         bool frameResize = false;
+        Settings settings;
 
         void run();
     private:
@@ -85,8 +137,12 @@ class App {
         // VkBuffer indexBuffer;
         // VkDeviceMemory indexBufferMemory;
 
-        std::vector<Buffer> uniformBuffers;
-        std::vector<void *> uniformBuffersMapped;
+        /* world matrix of every scene node, one region per frame in flight */
+        Scene scene;
+        Buffer instanceBuffer;
+        VkDeviceSize instanceRange = 0;
+
+        UniformRing uniformRing;
         // std::vector<VkBuffer> uniformBuffers;
         // std::vector<VkDeviceMemory> uniformBuffersMemory;
         // std::vector<void *> uniformBuffersMapped;
@@ -98,25 +154,87 @@ class App {
         // VkImageView textureImageView;
         // VkSampler textureSampler;
 
-        Image depth{VK_FORMAT_UNDEFINED, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT};
-        // VkImage depthImage;
-        // VkDeviceMemory depthImageMemory;
-        // VkImageView depthImageView;
+        /* depth, the msaa color and the offscreen target live in renderpipeline.frameGraph */
+        ResolutionScaler scaler;
+        std::chrono::steady_clock::time_point lastFrameStart{};
 
-        Model model;
+        FrameCapture capture;
 
+        Model model;
+        uint32_t textureSlot = 0;
+        /* with --stream the vertex buffer is the chunk pool and draws come from the streamer */
+        MeshStreamer streamer;
+        uint32_t streamNode = 0;
+        /* every SPIN_STRIDE-th draw hangs below a pivot the simulation turns, indexed alike */
+        static constexpr uint32_t SPIN_STRIDE = 8;
+        std::vector<uint32_t> pivots;
+        std::vector<glm::vec3> pivotPositions;
+        /* with --vtex the model samples the tile cache instead of texture */
+        VirtualTexture virtualTexture;
+
+        /* model parsing and texture decoding run as jobs while the device is created */
+        JobCounter assetLoads;
+        unsigned char *texturePixels = nullptr;
+        int textureWidth = 0;
+        int textureHeight = 0;
+        DrawList drawList;
+        DrawList drawScratch;
+
+        /* with --hot-reload changed files are parsed on the job system and swapped in between frames */
+        AssetWatcher watcher;
+        std::deque<std::unique_ptr<AssetReload>> reloads;
+        JobCounter reloadJobs;
+
+        /* cpu time spent recording and submitting a frame */
+        FrameStats cpuFrameTimes;
+        FrameStats gpuFrameTimes;
+        Metrics metrics;
+
+        /* the main thread polls events and simulates, the render thread owns the queue */
+        std::thread renderThread;
+        MpscQueue<RenderMessage> renderMessages;
+        TripleBuffer<SceneState> sceneState;
+        Simulation simulation;
+        std::exception_ptr renderError;
+        std::atomic<bool> renderFailed{false};
+
+        void simulate();
+        void renderLoop();
         void updateUniformBuffer(uint32_t currentImage);
         void drawFrame();
+        void remakeSwapchain();
+        void adjustRenderScale();
+        void benchmark();
+        void benchmarkRun(const char *label);
+        void resizeStress();
+        void checkRegressions();
         
         // needs to move somewhere, unsure atm
-        void copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height);
+        void copyBufferToImage(VkCommandBuffer commandBuffer, VkBuffer buffer, VkImage image, uint32_t width, uint32_t height);
+        void uploadBuffer(Buffer &dst, const void *src, VkDeviceSize size, VkBufferUsageFlags usage, const char *name);
+        void recordUpload(VkCommandBuffer &cmdBuffer, Buffer &dst, Buffer &staging, const void *src, VkDeviceSize size, VkBufferUsageFlags usage, const char *name);
+        void submitUpload(VkCommandBuffer cmdBuffer, bool wait);
         void makeIndexBuffer();
         void makeVertexBuffer();
         void makeUniformBuffers();
+        void makeInstanceBuffer();
+        void makeDrawList();
+        void sortDraws(const glm::vec3 &eye);
 
+        void loadTexture();
         void makeTextureImage();
-
-        void makeDepthResources();        
+        void recordTextureUpload(VkCommandBuffer cmdBuffer, const Buffer &staging, const Image &image, uint32_t width, uint32_t height);
+        void makeBindless();
+        void makeVirtualTexture();
+
+        void watchAssets();
+        void hotReload();
+        void parseAsset(AssetReload &reload);
+        void swapModel(AssetReload &reload);
+        void swapTexture(AssetReload &reload);
+        void swapShader(AssetReload &reload);
+
+        void reportAttachmentMemory();
         void init();
         
         void loop();
@@ -0,0 +1,63 @@
+#ifndef BINDLESS_HPP
+#define BINDLESS_HPP
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#ifndef MAX_FRAMES_IN_FLIGHT
+# define MAX_FRAMES_IN_FLIGHT 2
+#endif
+
+#include <vector>
+#include <stdexcept>
+
+/* hands out indices of a fixed size array, freed indices are reused first */
+class SlotAllocator {
+public:
+    explicit SlotAllocator(uint32_t capacity = 0) : capacity(capacity) {};
+
+    uint32_t allocate()
+    {
+        if (!freeSlots.empty())
+        {
+            uint32_t slot = freeSlots.back();
+            freeSlots.pop_back();
+            return slot;
+        }
+        if (next == capacity)
+            throw std::runtime_error("Out of bindless slots");
+        return next++;
+    }
+    void release(uint32_t slot) { freeSlots.push_back(slot); };
+    uint32_t used() const { return next - static_cast<uint32_t>(freeSlots.size()); };
+
+private:
+    uint32_t capacity;
+    uint32_t next = 0;
+    std::vector<uint32_t> freeSlots;
+};
+
+/*
+ * One update-after-bind, partially bound array of sampled images shared by every draw,
+ * draws select their texture with PushConstants::materialIndex. Buffers stay in set 0,
+ * the only per draw buffer data is the instance buffer, already indexed by objectId.
+ */
+class BindlessTextures {
+public:
+    VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+    VkDescriptorPool pool = VK_NULL_HANDLE;
+    VkDescriptorSet set = VK_NULL_HANDLE;
+    uint32_t capacity = 0;
+
+    void init(VkSampler sampler);
+    uint32_t add(VkImageView view);
+    /* the slot is only reused once the frame that released it has finished */
+    void remove(uint32_t slot, uint32_t currentFrame);
+    void beginFrame(uint32_t currentFrame);
+
+private:
+    SlotAllocator slots;
+    std::vector<uint32_t> retired[MAX_FRAMES_IN_FLIGHT];
+};
+
+#endif
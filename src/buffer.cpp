@@ -1,10 +1,11 @@
 #include "buffer.hpp"
 #include <cstring>
+#include <utility>
 #include "renderPipeline.hpp"
 #include "Vulkan.hpp"
 #include "app.hpp"
 
-void Buffer::makeBuffer(VkDeviceSize tmpsize, VkBufferUsageFlags usage, VkMemoryPropertyFlags props, VkBuffer &tmpbuffer, VkDeviceMemory &tmpbufferMemory)
+void Buffer::createBuffer(VkDeviceSize tmpsize, VkBufferUsageFlags usage, VkBuffer &tmpbuffer, VkMemoryRequirements &memRequirements)
 {
     VkBufferCreateInfo bufferCreateInfo{};
     bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -13,36 +14,86 @@ void Buffer::makeBuffer(VkDeviceSize tmpsize, VkBufferUsageFlags usage, VkMemory
     bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
     if (vkCreateBuffer(VulkanInstance::device, &bufferCreateInfo, nullptr, &tmpbuffer) != VK_SUCCESS)
         throw std::runtime_error("Failed to create buffer");
-    VkMemoryRequirements memRequirements;
     vkGetBufferMemoryRequirements(VulkanInstance::device, tmpbuffer, &memRequirements);
+}
+
+void Buffer::makeBuffer(VkDeviceSize tmpsize, VkBufferUsageFlags usage, VkMemoryPropertyFlags props, VkBuffer &tmpbuffer, VkDeviceMemory &tmpbufferMemory)
+{
+    VkMemoryRequirements memRequirements;
+    createBuffer(tmpsize, usage, tmpbuffer, memRequirements);
     VkMemoryAllocateInfo allocInfo{};
     allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
     allocInfo.allocationSize = memRequirements.size;
     allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, props, VulkanInstance::physicalDevice);
 
-    if (vkAllocateMemory(VulkanInstance::device, &allocInfo, nullptr, &tmpbufferMemory) != VK_SUCCESS)
+    if (GpuMemory::allocate(allocInfo, GpuMemory::bufferCategory(usage), tmpbufferMemory) != VK_SUCCESS)
         throw std::runtime_error("Failed to allocate memory");
     vkBindBufferMemory(VulkanInstance::device, tmpbuffer, tmpbufferMemory, 0);
 }
 
-void Buffer::init(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags props)
+void Buffer::init(VkDeviceSize tmpsize, VkBufferUsageFlags usage, VkMemoryPropertyFlags props)
+{
+    reset();
+    VkBuffer rawBuffer;
+    VkDeviceMemory rawMemory;
+    makeBuffer(tmpsize, usage, props, rawBuffer, rawMemory);
+    buffer = BufferHandle(rawBuffer);
+    bufferMemory = MemoryHandle(rawMemory);
+    size = tmpsize;
+    data = nullptr;
+}
+
+bool Buffer::initDirect(VkDeviceSize tmpsize, VkBufferUsageFlags usage)
 {
+    const VkMemoryPropertyFlags props = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    reset();
+    VkBuffer rawBuffer;
+    VkMemoryRequirements memRequirements;
+    createBuffer(tmpsize, usage, rawBuffer, memRequirements);
+    BufferHandle candidate(rawBuffer);
 
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
+    /* the type has to suit this buffer, not just exist on the device */
+    VkPhysicalDeviceMemoryProperties memProps;
+    vkGetPhysicalDeviceMemoryProperties(VulkanInstance::physicalDevice, &memProps);
+    uint32_t type = memProps.memoryTypeCount;
+    for (uint32_t i = 0; i < memProps.memoryTypeCount && type == memProps.memoryTypeCount; i++)
+        if ((memRequirements.memoryTypeBits & (1u << i)) && (memProps.memoryTypes[i].propertyFlags & props) == props)
+            type = i;
+    if (type == memProps.memoryTypeCount)
+        return false;
 
-    makeBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
-    makeBuffer(size, usage, props | VK_BUFFER_USAGE_TRANSFER_DST_BIT, buffer, bufferMemory);
+    /* a small BAR window is a heap of its own, its budget keeps room for what has to be mapped */
+    if (memRequirements.size > GpuMemory::headroom(type))
+        return false;
 
-    void *data;
-    vkMapMemory(VulkanInstance::device, stagingBufferMemory, 0, size, 0, &data);
-    memcpy(data, data, (size_t)size);
-    vkUnmapMemory(VulkanInstance::device, stagingBufferMemory);
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = memRequirements.size;
+    allocInfo.memoryTypeIndex = type;
+    VkDeviceMemory rawMemory;
+    if (GpuMemory::allocate(allocInfo, GpuMemory::bufferCategory(usage), rawMemory) != VK_SUCCESS)
+        return false;
+    MemoryHandle memory(rawMemory);
+    vkBindBufferMemory(VulkanInstance::device, candidate, memory, 0);
+    void *mapped;
+    if (vkMapMemory(VulkanInstance::device, memory, 0, tmpsize, 0, &mapped) != VK_SUCCESS)
+        return false;
 
-    copyBuffer(stagingBuffer, buffer, size);
+    buffer = std::move(candidate);
+    bufferMemory = std::move(memory);
+    size = tmpsize;
+    data = mapped;
+    direct = true;
+    return true;
+}
 
-    vkDestroyBuffer(VulkanInstance::device, stagingBuffer, nullptr);
-    vkFreeMemory(VulkanInstance::device, stagingBufferMemory, nullptr);
+void Buffer::reset()
+{
+    direct = false;
+    buffer.reset();
+    bufferMemory.reset();
+    data = nullptr;
+    size = 0;
 }
 
 void Buffer::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size)
@@ -54,4 +105,5 @@ void Buffer::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize siz
     vkCmdCopyBuffer(cmdBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
 
     RenderPipeline::endSingleTimeCommands(cmdBuffer);
-}
\ No newline at end of file
+}
+
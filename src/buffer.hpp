@@ -4,6 +4,7 @@
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 #include <stdexcept>
+#include "vkHandle.hpp"
 
 // static uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags props, VkPhysicalDevice physicalDevice);
 class RenderPipeline;
@@ -11,14 +12,27 @@ class RenderPipeline;
 
 class Buffer {
 public:
-    VkBuffer buffer;
-    VkDeviceMemory bufferMemory;
-    void *data;
-    VkDeviceSize size;
+    BufferHandle buffer;
+    MemoryHandle bufferMemory;
+    void *data = nullptr;
+    VkDeviceSize size = 0;
+
+    /* allocated from device local host visible memory, data stays mapped */
+    bool direct = false;
 
     void init(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags props);
+    /*
+     * Persistently mapped device local memory the host writes to directly (resizable
+     * BAR or unified memory). False when no such type suits the buffer, its heap has
+     * no headroom left or the allocation or mapping fails, the buffer is left empty then.
+     */
+    bool initDirect(VkDeviceSize size, VkBufferUsageFlags usage);
+    void reset();
     static void makeBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags props, VkBuffer& buffer, VkDeviceMemory& memory);
     static void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
+
+private:
+    static void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer &buffer, VkMemoryRequirements &requirements);
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,85 @@
+#include "commandRecorder.hpp"
+#include <stdexcept>
+#include <algorithm>
+#include "Vulkan.hpp"
+#include "JobSystem.hpp"
+
+CommandRecorder::~CommandRecorder()
+{
+    destroy();
+}
+
+void CommandRecorder::init(uint32_t chunkCount, uint32_t queueFamily)
+{
+    destroy();
+    threadCount = chunkCount;
+    if (threadCount == 0)
+        return;
+
+    pools.assign(MAX_FRAMES_IN_FLIGHT, std::vector<VkCommandPool>(threadCount, VK_NULL_HANDLE));
+    buffers.assign(MAX_FRAMES_IN_FLIGHT, std::vector<VkCommandBuffer>(threadCount, VK_NULL_HANDLE));
+    valid.assign(MAX_FRAMES_IN_FLIGHT, false);
+    for (int frame = 0; frame < MAX_FRAMES_IN_FLIGHT; frame++)
+    {
+        for (uint32_t i = 0; i < threadCount; i++)
+        {
+            VkCommandPoolCreateInfo poolInfo{};
+            poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+            poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+            poolInfo.queueFamilyIndex = queueFamily;
+            if (vkCreateCommandPool(VulkanInstance::device, &poolInfo, nullptr, &pools[frame][i]) != VK_SUCCESS)
+                throw std::runtime_error("Failed to create worker command pool");
+
+            VkCommandBufferAllocateInfo allocInfo{};
+            allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            allocInfo.commandPool = pools[frame][i];
+            allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+            allocInfo.commandBufferCount = 1;
+            if (vkAllocateCommandBuffers(VulkanInstance::device, &allocInfo, &buffers[frame][i]) != VK_SUCCESS)
+                throw std::runtime_error("Failed to allocate secondary command buffer");
+        }
+    }
+}
+
+void CommandRecorder::destroy()
+{
+    for (auto &framePools : pools)
+        for (auto &pool : framePools)
+            vkDestroyCommandPool(VulkanInstance::device, pool, nullptr);
+    pools.clear();
+    buffers.clear();
+    valid.clear();
+    threadCount = 0;
+}
+
+const std::vector<VkCommandBuffer> &CommandRecorder::record(uint32_t frame, VkRenderPass renderPass, VkFramebuffer framebuffer, size_t drawCount, const RecordFn &fn,
+    const VkCommandBufferInheritanceRenderingInfo *renderingInfo)
+{
+    size_t chunk = (drawCount + threadCount - 1) / threadCount;
+    Jobs::parallelFor(threadCount, 1, [&](size_t index, size_t) {
+        size_t first = std::min(drawCount, index * chunk);
+        size_t last = std::min(drawCount, first + chunk);
+
+        vkResetCommandPool(VulkanInstance::device, pools[frame][index], 0);
+
+        VkCommandBufferInheritanceInfo inheritanceInfo{};
+        inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+        inheritanceInfo.pNext = renderingInfo;
+        inheritanceInfo.renderPass = renderPass;
+        inheritanceInfo.subpass = 0;
+        inheritanceInfo.framebuffer = framebuffer;
+
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+        beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+        VkCommandBuffer buffer = buffers[frame][index];
+        if (vkBeginCommandBuffer(buffer, &beginInfo) != VK_SUCCESS)
+            throw std::runtime_error("Failed to begin secondary command buffer");
+        fn(buffer, first, last);
+        if (vkEndCommandBuffer(buffer) != VK_SUCCESS)
+            throw std::runtime_error("Failed to end secondary command buffer");
+    });
+    return buffers[frame];
+}
@@ -0,0 +1,42 @@
+#ifndef COMMANDRECORDER_HPP
+#define COMMANDRECORDER_HPP
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#ifndef MAX_FRAMES_IN_FLIGHT
+# define MAX_FRAMES_IN_FLIGHT 2
+#endif
+
+#include <vector>
+#include <functional>
+
+/*
+ * Splits a draw range into chunks recorded as jobs, every chunk records into a
+ * secondary command buffer allocated from its own per-frame command pool, so it
+ * does not matter which worker picks it up.
+ */
+class CommandRecorder {
+public:
+    using RecordFn = std::function<void(VkCommandBuffer buffer, size_t first, size_t last)>;
+
+    /* per frame slot, false when the secondaries need to be recorded again */
+    std::vector<bool> valid;
+
+    ~CommandRecorder();
+    void init(uint32_t chunkCount, uint32_t queueFamily);
+    void destroy();
+    uint32_t threads() const { return threadCount; };
+
+    /* renderingInfo replaces the render pass for secondaries executed inside dynamic rendering */
+    const std::vector<VkCommandBuffer> &record(uint32_t frame, VkRenderPass renderPass, VkFramebuffer framebuffer, size_t drawCount, const RecordFn &fn,
+        const VkCommandBufferInheritanceRenderingInfo *renderingInfo = nullptr);
+    const std::vector<VkCommandBuffer> &secondaries(uint32_t frame) const { return buffers[frame]; };
+
+private:
+    uint32_t threadCount = 0;
+    std::vector<std::vector<VkCommandPool>> pools;
+    std::vector<std::vector<VkCommandBuffer>> buffers;
+};
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef DELETIONQUEUE_HPP
+#define DELETIONQUEUE_HPP
+
+#include <deque>
+#include <functional>
+#include <cstdint>
+
+/*
+ * Resources that may still be referenced by submitted work are retired here and
+ * destroyed once the GPU has passed the value of the last submit that could use them.
+ * Values are those of the frame timeline, every queue submit signals the next one.
+ */
+class DeletionQueue {
+private:
+    struct Entry
+    {
+        uint64_t lastUse;
+        std::function<void()> destroy;
+    };
+    /* never destroyed, handles released during static destruction may still retire into it */
+    static std::deque<Entry> &queue()
+    {
+        static std::deque<Entry> *entries = new std::deque<Entry>();
+        return *entries;
+    }
+
+public:
+    /* value signalled by the next queue submit, advanced by Syncobjects::submit */
+    inline static uint64_t nextSubmit = 1;
+
+    /* extra delays resources that are not covered by a submit, e.g. presented images */
+    static void retire(std::function<void()> destroy, uint64_t extra = 0)
+    {
+        queue().push_back({nextSubmit + extra, std::move(destroy)});
+    }
+
+    /* completed is the highest value the GPU is known to have signalled */
+    static void collect(uint64_t completed)
+    {
+        std::deque<Entry> &entries = queue();
+        while (!entries.empty() && entries.front().lastUse <= completed)
+        {
+            Entry entry = std::move(entries.front());
+            entries.pop_front();
+            entry.destroy();
+        }
+    }
+
+    /* only valid once the device is idle */
+    static void flush()
+    {
+        std::deque<Entry> &entries = queue();
+        while (!entries.empty())
+        {
+            Entry entry = std::move(entries.front());
+            entries.pop_front();
+            entry.destroy();
+        }
+    }
+
+    static size_t pending() { return queue().size(); };
+};
+
+#endif
@@ -0,0 +1,281 @@
+#include "frameCapture.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+#include "Vulkan.hpp"
+#include "swapchain.hpp"
+#include "renderPipeline.hpp"
+#include "Logger.hpp"
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+bool FrameCapture::init(const std::string &dir, Format fmt)
+{
+    VkFormat imageFormat = Swapchain::swapchainImageFormat;
+    if (imageFormat == VK_FORMAT_B8G8R8A8_SRGB || imageFormat == VK_FORMAT_B8G8R8A8_UNORM)
+        bgra = true;
+    else if (imageFormat != VK_FORMAT_R8G8B8A8_SRGB && imageFormat != VK_FORMAT_R8G8B8A8_UNORM)
+        return false;
+    if (!Swapchain::transferSource)
+        return false;
+
+    /* toRgba and toYuv swizzle the readback a byte at a time, without caching every load is a bus read */
+    VkMemoryPropertyFlags cached = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+    VkPhysicalDeviceMemoryProperties memProps;
+    vkGetPhysicalDeviceMemoryProperties(VulkanInstance::physicalDevice, &memProps);
+    memoryProps = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    for (uint32_t i = 0; i < memProps.memoryTypeCount; i++)
+        if ((memProps.memoryTypes[i].propertyFlags & cached) == cached)
+            memoryProps = cached;
+
+    std::filesystem::create_directories(dir);
+    directory = dir;
+    format = fmt;
+
+    VkCommandBuffer buffers[SLOTS];
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = RenderPipeline::commandPool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = SLOTS;
+    if (vkAllocateCommandBuffers(VulkanInstance::device, &allocInfo, buffers) != VK_SUCCESS)
+        throw std::runtime_error("Failed to allocate capture command buffers");
+    for (uint32_t i = 0; i < SLOTS; i++)
+        slots[i].commandBuffer = buffers[i];
+    enabled = true;
+    return true;
+}
+
+void FrameCapture::destroy()
+{
+    if (!enabled)
+        return;
+    collect(UINT64_MAX);
+    Jobs::wait(encoders);
+    for (auto &slot : slots)
+    {
+        vkFreeCommandBuffers(VulkanInstance::device, RenderPipeline::commandPool, 1, &slot.commandBuffer);
+        slot.commandBuffer = VK_NULL_HANDLE;
+        slot.buffer.reset();
+    }
+    enabled = false;
+    Log(Logger::info) << "Captured " << captured << " frames to " << directory << ", dropped " << dropped;
+}
+
+VkCommandBuffer FrameCapture::record(uint32_t image)
+{
+    Slot *slot = nullptr;
+    for (auto &candidate : slots)
+    {
+        if (candidate.state.load(std::memory_order_acquire) == FREE)
+        {
+            slot = &candidate;
+            break;
+        }
+    }
+    uint32_t frame = frameNumber++;
+    if (!slot)
+    {
+        dropped++;
+        return VK_NULL_HANDLE;
+    }
+
+    VkExtent2D extent = Swapchain::swapchainExtent;
+    VkDeviceSize size = static_cast<VkDeviceSize>(extent.width) * extent.height * 4;
+    if (slot->buffer.size < size)
+    {
+        slot->buffer.reset();
+        slot->buffer.init(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, memoryProps);
+        vkMapMemory(VulkanInstance::device, slot->buffer.bufferMemory, 0, size, 0, &slot->buffer.data);
+    }
+    slot->extent = extent;
+    slot->frame = frame;
+
+    VkCommandBuffer commandBuffer = slot->commandBuffer;
+    vkResetCommandBuffer(commandBuffer, 0);
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+        throw std::runtime_error("Failed to begin capture command buffer");
+
+    /* the frame left the image ready to present, written by the render pass or the upscale blit */
+    VkImageMemoryBarrier toTransfer{};
+    toTransfer.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    toTransfer.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+    toTransfer.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    toTransfer.oldLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    toTransfer.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    toTransfer.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    toTransfer.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    toTransfer.image = Swapchain::swapchainImages[image];
+    toTransfer.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &toTransfer);
+
+    VkBufferImageCopy region{};
+    region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+    region.imageExtent = {extent.width, extent.height, 1};
+    vkCmdCopyImageToBuffer(commandBuffer, toTransfer.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot->buffer.buffer, 1, &region);
+
+    VkImageMemoryBarrier toPresent = toTransfer;
+    toPresent.srcAccessMask = 0;
+    toPresent.dstAccessMask = 0;
+    toPresent.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    toPresent.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    VkBufferMemoryBarrier toHost{};
+    toHost.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    toHost.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    toHost.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    toHost.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    toHost.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    toHost.buffer = slot->buffer.buffer;
+    toHost.size = size;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+        0, 0, nullptr, 0, nullptr, 1, &toPresent);
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+        0, 0, nullptr, 1, &toHost, 0, nullptr);
+
+    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+        throw std::runtime_error("Failed to record capture command buffer");
+    recorded = static_cast<int>(slot - slots.data());
+    return commandBuffer;
+}
+
+void FrameCapture::submitted(uint64_t value)
+{
+    if (recorded < 0)
+        return;
+    Slot &slot = slots[recorded];
+    slot.value = value;
+    slot.state.store(SUBMITTED, std::memory_order_relaxed);
+    recorded = -1;
+}
+
+void FrameCapture::collect(uint64_t completed)
+{
+    for (auto &slot : slots)
+    {
+        if (slot.state.load(std::memory_order_relaxed) != SUBMITTED || slot.value > completed)
+            continue;
+        slot.state.store(ENCODING, std::memory_order_relaxed);
+        captured++;
+        Jobs::spawn([this, &slot] { encode(slot); }, &encoders);
+    }
+}
+
+/* worker thread, the slot is handed back as soon as its pixels are converted */
+void FrameCapture::encode(Slot &slot)
+{
+    uint32_t width = slot.extent.width;
+    uint32_t height = slot.extent.height;
+    uint32_t frame = slot.frame;
+    char name[64];
+    if (format == png)
+        std::snprintf(name, sizeof(name), "/frame_%06u.png", frame);
+    else
+        std::snprintf(name, sizeof(name), "/frame_%06u_%ux%u.yuv", frame, width, height);
+    std::string path = directory + name;
+
+    std::vector<uint8_t> pixels;
+    try
+    {
+        pixels = format == png ? toRgba(slot) : toYuv(slot);
+    }
+    catch (...)
+    {
+        slot.state.store(FREE, std::memory_order_release);
+        throw;
+    }
+    slot.state.store(FREE, std::memory_order_release);
+
+    bool written;
+    if (format == png)
+        written = stbi_write_png(path.c_str(), width, height, 4, pixels.data(), width * 4);
+    else
+    {
+        std::ofstream file(path, std::ios::binary);
+        written = static_cast<bool>(file.write(reinterpret_cast<const char *>(pixels.data()), pixels.size()));
+    }
+    if (!written)
+    {
+        Log(Logger::warn) << "Failed to write " << path;
+        return;
+    }
+    std::lock_guard<std::mutex> lock(filesMutex);
+    files[frame] = path;
+}
+
+std::string FrameCapture::file(uint32_t frame)
+{
+    std::lock_guard<std::mutex> lock(filesMutex);
+    auto found = files.find(frame);
+    return found != files.end() ? found->second : std::string();
+}
+
+std::vector<uint8_t> FrameCapture::toRgba(const Slot &slot) const
+{
+    const uint8_t *src = static_cast<const uint8_t *>(slot.buffer.data);
+    std::vector<uint8_t> rgba(static_cast<size_t>(slot.extent.width) * slot.extent.height * 4);
+    int red = bgra ? 2 : 0;
+    int blue = bgra ? 0 : 2;
+    for (size_t i = 0; i < rgba.size(); i += 4)
+    {
+        rgba[i] = src[i + red];
+        rgba[i + 1] = src[i + 1];
+        rgba[i + 2] = src[i + blue];
+        /* presented alpha is meaningless, keep the file opaque */
+        rgba[i + 3] = 255;
+    }
+    return rgba;
+}
+
+/* planar 4:2:0 with BT.601 limited range, chroma averaged over 2x2 blocks */
+std::vector<uint8_t> FrameCapture::toYuv(const Slot &slot) const
+{
+    uint32_t width = slot.extent.width;
+    uint32_t height = slot.extent.height;
+    uint32_t chromaWidth = (width + 1) / 2;
+    uint32_t chromaHeight = (height + 1) / 2;
+    const uint8_t *src = static_cast<const uint8_t *>(slot.buffer.data);
+    int red = bgra ? 2 : 0;
+    int blue = bgra ? 0 : 2;
+
+    std::vector<uint8_t> planes(static_cast<size_t>(width) * height + 2 * static_cast<size_t>(chromaWidth) * chromaHeight);
+    uint8_t *luma = planes.data();
+    uint8_t *cb = luma + static_cast<size_t>(width) * height;
+    uint8_t *cr = cb + static_cast<size_t>(chromaWidth) * chromaHeight;
+    for (size_t i = 0; i < static_cast<size_t>(width) * height; i++)
+    {
+        int r = src[i * 4 + red], g = src[i * 4 + 1], b = src[i * 4 + blue];
+        luma[i] = static_cast<uint8_t>(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+    }
+    for (uint32_t cy = 0; cy < chromaHeight; cy++)
+    {
+        for (uint32_t cx = 0; cx < chromaWidth; cx++)
+        {
+            int r = 0, g = 0, b = 0, count = 0;
+            for (uint32_t y = cy * 2; y < std::min(height, cy * 2 + 2); y++)
+            {
+                for (uint32_t x = cx * 2; x < std::min(width, cx * 2 + 2); x++)
+                {
+                    const uint8_t *pixel = src + (static_cast<size_t>(y) * width + x) * 4;
+                    r += pixel[red];
+                    g += pixel[1];
+                    b += pixel[blue];
+                    count++;
+                }
+            }
+            r /= count;
+            g /= count;
+            b /= count;
+            size_t index = static_cast<size_t>(cy) * chromaWidth + cx;
+            cb[index] = static_cast<uint8_t>(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+            cr[index] = static_cast<uint8_t>(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+        }
+    }
+    return planes;
+}
@@ -0,0 +1,77 @@
+#ifndef FRAMECAPTURE_HPP
+#define FRAMECAPTURE_HPP
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+#include <array>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "buffer.hpp"
+#include "JobSystem.hpp"
+
+#ifndef MAX_FRAMES_IN_FLIGHT
+# define MAX_FRAMES_IN_FLIGHT 2
+#endif
+
+/*
+ * Copies presented images into a ring of host visible buffers. The copy is its own
+ * submit after the frame, a slot is collected once the timeline passed it and encoded
+ * on the job system, so capturing never waits on the GPU. A frame is dropped instead
+ * of stalling when every slot is still in flight or being encoded.
+ */
+class FrameCapture {
+public:
+    enum Format { png, yuv };
+    static constexpr uint32_t SLOTS = MAX_FRAMES_IN_FLIGHT + 2;
+
+    /* false when the swapchain cannot be copied from or its format is not 8 bit rgba */
+    bool init(const std::string &directory, Format format);
+    /* waits for outstanding encodes, the device has to be idle */
+    void destroy();
+    bool active() const { return enabled; };
+
+    /* copy of a presented swapchain image, VK_NULL_HANDLE when the frame is dropped */
+    VkCommandBuffer record(uint32_t image);
+    /* timeline value of the submit holding the last recorded copy */
+    void submitted(uint64_t value);
+    /* encodes every copy the GPU is done with */
+    void collect(uint64_t completed);
+    /* file frame number was written to, empty when it was dropped or failed */
+    std::string file(uint32_t frame);
+
+private:
+    enum State : uint8_t { FREE, SUBMITTED, ENCODING };
+    struct Slot
+    {
+        Buffer buffer;
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        VkExtent2D extent{};
+        uint32_t frame = 0;
+        uint64_t value = 0;
+        /* FREE to ENCODING on the render thread, back to FREE on a worker */
+        std::atomic<State> state{FREE};
+    };
+
+    bool enabled = false;
+    bool bgra = false;
+    Format format = png;
+    VkMemoryPropertyFlags memoryProps = 0;
+    std::string directory;
+    std::array<Slot, SLOTS> slots;
+    int recorded = -1;
+    uint32_t frameNumber = 0;
+    uint32_t captured = 0;
+    uint32_t dropped = 0;
+    JobCounter encoders;
+    std::mutex filesMutex;
+    std::map<uint32_t, std::string> files;
+
+    void encode(Slot &slot);
+    std::vector<uint8_t> toRgba(const Slot &slot) const;
+    std::vector<uint8_t> toYuv(const Slot &slot) const;
+};
+
+#endif
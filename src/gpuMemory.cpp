@@ -0,0 +1,208 @@
+#include "gpuMemory.hpp"
+#include <algorithm>
+#include <sstream>
+#include "Vulkan.hpp"
+#include "Logger.hpp"
+
+VkResult GpuMemory::allocate(const VkMemoryAllocateInfo &info, MemoryCategory category, VkDeviceMemory &memory)
+{
+    VkResult result = vkAllocateMemory(VulkanInstance::device, &info, nullptr, &memory);
+    if (result != VK_SUCCESS)
+        return result;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    loadHeaps();
+    uint32_t heap = typeHeaps[info.memoryTypeIndex];
+    allocations[memory] = {info.allocationSize, heap, category};
+    Heap &usage = heapList[heap];
+    usage.tracked += info.allocationSize;
+    usage.peak = std::max(usage.peak, usage.tracked);
+    size_t index = static_cast<size_t>(category);
+    categories[index] += info.allocationSize;
+    peaks[index] = std::max(peaks[index], categories[index]);
+    return result;
+}
+
+void VKAPI_PTR GpuMemory::free(VkDevice device, VkDeviceMemory memory, const VkAllocationCallbacks *allocator)
+{
+    {
+        /* erased first, a new allocation may get the same handle once it is freed */
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = allocations.find(memory);
+        if (found != allocations.end())
+        {
+            heapList[found->second.heap].tracked -= found->second.size;
+            categories[static_cast<size_t>(found->second.category)] -= found->second.size;
+            allocations.erase(found);
+        }
+    }
+    vkFreeMemory(device, memory, allocator);
+}
+
+/* the most specific usage wins, an upload destination is counted as what it holds */
+MemoryCategory GpuMemory::bufferCategory(VkBufferUsageFlags usage)
+{
+    if (usage & VK_BUFFER_USAGE_VERTEX_BUFFER_BIT)
+        return MemoryCategory::vertex;
+    if (usage & VK_BUFFER_USAGE_INDEX_BUFFER_BIT)
+        return MemoryCategory::index;
+    if (usage & VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT)
+        return MemoryCategory::uniform;
+    if (usage & VK_BUFFER_USAGE_STORAGE_BUFFER_BIT)
+        return MemoryCategory::instance;
+    if (usage & VK_BUFFER_USAGE_TRANSFER_SRC_BIT)
+        return MemoryCategory::staging;
+    return MemoryCategory::readback;
+}
+
+MemoryCategory GpuMemory::imageCategory(VkImageUsageFlags usage)
+{
+    if (usage & VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT)
+        return MemoryCategory::depth;
+    if (usage & VK_IMAGE_USAGE_SAMPLED_BIT)
+        return MemoryCategory::texture;
+    return MemoryCategory::attachment;
+}
+
+const char *GpuMemory::name(MemoryCategory category)
+{
+    static const char *names[] = {"vertex", "index", "uniform", "instance", "staging", "readback", "texture", "depth", "attachment", "transient"};
+    return names[static_cast<size_t>(category)];
+}
+
+void GpuMemory::loadHeaps()
+{
+    if (!heapList.empty())
+        return;
+    VkPhysicalDeviceMemoryProperties props;
+    vkGetPhysicalDeviceMemoryProperties(VulkanInstance::physicalDevice, &props);
+    heapList.resize(props.memoryHeapCount);
+    for (uint32_t i = 0; i < props.memoryHeapCount; i++)
+    {
+        heapList[i].size = props.memoryHeaps[i].size;
+        heapList[i].budget = static_cast<VkDeviceSize>(props.memoryHeaps[i].size * DEFAULT_BUDGET);
+        heapList[i].deviceLocal = props.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT;
+    }
+    typeHeaps.resize(props.memoryTypeCount);
+    for (uint32_t i = 0; i < props.memoryTypeCount; i++)
+        typeHeaps[i] = props.memoryTypes[i].heapIndex;
+    refreshBudgets();
+}
+
+void GpuMemory::refreshBudgets()
+{
+    lastRefresh = std::chrono::steady_clock::now();
+    if (!VulkanInstance::features.memoryBudget)
+    {
+        for (Heap &heap : heapList)
+            heap.used = heap.tracked;
+        return;
+    }
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budget{};
+    budget.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+    VkPhysicalDeviceMemoryProperties2 props{};
+    props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+    props.pNext = &budget;
+    vkGetPhysicalDeviceMemoryProperties2(VulkanInstance::physicalDevice, &props);
+    for (size_t i = 0; i < heapList.size(); i++)
+    {
+        heapList[i].budget = budget.heapBudget[i];
+        heapList[i].used = budget.heapUsage[i];
+    }
+}
+
+VkDeviceSize GpuMemory::headroom(uint32_t memoryType)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    loadHeaps();
+    refreshBudgets();
+    const Heap &heap = heapList[typeHeaps[memoryType]];
+    VkDeviceSize used = std::max(heap.used, heap.tracked);
+    VkDeviceSize limit = static_cast<VkDeviceSize>(heap.budget * PRESSURE);
+    return used < limit ? limit - used : 0;
+}
+
+void GpuMemory::onPressure(PressureFn fn)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    pressureCallbacks.push_back(std::move(fn));
+}
+
+void GpuMemory::poll(double interval)
+{
+    auto now = std::chrono::steady_clock::now();
+    std::vector<std::pair<uint32_t, Heap>> pressured;
+    std::vector<PressureFn> callbacks;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        loadHeaps();
+        /* the budget query is not free, a few refreshes per second are enough */
+        if (now - lastRefresh > std::chrono::milliseconds(250))
+            refreshBudgets();
+        for (uint32_t i = 0; i < heapList.size(); i++)
+        {
+            Heap &heap = heapList[i];
+            VkDeviceSize used = std::max(heap.used, heap.tracked);
+            if (!heap.underPressure && used > heap.budget * PRESSURE)
+            {
+                heap.underPressure = true;
+                pressured.emplace_back(i, heap);
+            }
+            else if (heap.underPressure && used < heap.budget * RELIEF)
+                heap.underPressure = false;
+        }
+        if (!pressured.empty())
+            callbacks = pressureCallbacks;
+    }
+    for (const auto &[index, heap] : pressured)
+    {
+        Log(Logger::warn) << "Memory heap " << index << " at " << std::max(heap.used, heap.tracked) / (1024 * 1024)
+                          << " MiB of " << heap.budget / (1024 * 1024) << " MiB budget";
+        for (const PressureFn &callback : callbacks)
+            callback(index, heap);
+    }
+
+    if (interval > 0.0 && now - lastLog > std::chrono::duration<double>(interval))
+    {
+        lastLog = now;
+        log();
+    }
+}
+
+void GpuMemory::log()
+{
+    std::vector<Heap> usage = heaps();
+    for (size_t i = 0; i < usage.size(); i++)
+    {
+        Log(Logger::info) << "Memory heap " << i << (usage[i].deviceLocal ? " device local" : " host")
+                          << " used " << usage[i].used / 1024 << " KiB tracked " << usage[i].tracked / 1024
+                          << " KiB peak " << usage[i].peak / 1024 << " KiB budget " << usage[i].budget / 1024 << " KiB";
+    }
+    std::ostringstream line;
+    line << "Memory by category";
+    for (size_t i = 0; i < static_cast<size_t>(MemoryCategory::count); i++)
+    {
+        MemoryCategory category = static_cast<MemoryCategory>(i);
+        if (categoryPeak(category))
+            line << " " << name(category) << " " << categoryBytes(category) / 1024 << "/" << categoryPeak(category) / 1024;
+    }
+    Log(Logger::info) << line.str() << " KiB current/peak";
+}
+
+std::vector<GpuMemory::Heap> GpuMemory::heaps()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return heapList;
+}
+
+VkDeviceSize GpuMemory::categoryBytes(MemoryCategory category)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return categories[static_cast<size_t>(category)];
+}
+
+VkDeviceSize GpuMemory::categoryPeak(MemoryCategory category)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return peaks[static_cast<size_t>(category)];
+}
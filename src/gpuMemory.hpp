@@ -0,0 +1,84 @@
+#ifndef GPUMEMORY_HPP
+#define GPUMEMORY_HPP
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+enum class MemoryCategory { vertex, index, uniform, instance, staging, readback, texture, depth, attachment, transient, count };
+
+/*
+ * Accounting of every device memory allocation by category and heap. Budgets come
+ * from VK_EXT_memory_budget when the device has it, otherwise a fixed share of the
+ * heap size is assumed. Pressure callbacks run once a heap passes PRESSURE of its
+ * budget and are armed again after it drops below RELIEF.
+ */
+class GpuMemory {
+public:
+    static constexpr double PRESSURE = 0.9;
+    static constexpr double RELIEF = 0.8;
+    /* assumed budget without the extension, the rest belongs to other processes and the driver */
+    static constexpr double DEFAULT_BUDGET = 0.8;
+
+    struct Heap
+    {
+        VkDeviceSize size = 0;
+        VkDeviceSize budget = 0;
+        /* allocated by this process, as reported by the driver when the extension is present */
+        VkDeviceSize used = 0;
+        VkDeviceSize tracked = 0;
+        VkDeviceSize peak = 0;
+        bool deviceLocal = false;
+        bool underPressure = false;
+    };
+    using PressureFn = std::function<void(uint32_t heap, const Heap &usage)>;
+
+    /* vkAllocateMemory, recorded under category */
+    static VkResult allocate(const VkMemoryAllocateInfo &info, MemoryCategory category, VkDeviceMemory &memory);
+    /* vkFreeMemory signature, MemoryHandle releases through it */
+    static void VKAPI_PTR free(VkDevice device, VkDeviceMemory memory, const VkAllocationCallbacks *allocator);
+
+    static MemoryCategory bufferCategory(VkBufferUsageFlags usage);
+    static MemoryCategory imageCategory(VkImageUsageFlags usage);
+    static const char *name(MemoryCategory category);
+
+    /* bytes the heap of memoryType can take before it comes under pressure, budgets are queried fresh */
+    static VkDeviceSize headroom(uint32_t memoryType);
+    /* fn runs on the thread calling poll and is never removed, what it captures has to live as long */
+    static void onPressure(PressureFn fn);
+    /* refreshes budgets, runs pressure callbacks and logs every interval seconds, 0 never logs */
+    static void poll(double interval);
+    static void log();
+
+    static std::vector<Heap> heaps();
+    static VkDeviceSize categoryBytes(MemoryCategory category);
+    static VkDeviceSize categoryPeak(MemoryCategory category);
+
+private:
+    struct Allocation
+    {
+        VkDeviceSize size;
+        uint32_t heap;
+        MemoryCategory category;
+    };
+
+    inline static std::mutex mutex;
+    inline static std::unordered_map<VkDeviceMemory, Allocation> allocations;
+    inline static std::vector<Heap> heapList;
+    inline static std::vector<uint32_t> typeHeaps;
+    inline static VkDeviceSize categories[static_cast<size_t>(MemoryCategory::count)] = {};
+    inline static VkDeviceSize peaks[static_cast<size_t>(MemoryCategory::count)] = {};
+    inline static std::vector<PressureFn> pressureCallbacks;
+    inline static std::chrono::steady_clock::time_point lastRefresh{};
+    inline static std::chrono::steady_clock::time_point lastLog{};
+
+    /* caller holds the mutex */
+    static void loadHeaps();
+    static void refreshBudgets();
+};
+
+#endif
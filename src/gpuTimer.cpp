@@ -0,0 +1,63 @@
+#include "gpuTimer.hpp"
+#include <stdexcept>
+#include <vector>
+#include "Vulkan.hpp"
+
+void GpuTimer::init(uint32_t queueFamily)
+{
+    uint32_t familyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(VulkanInstance::physicalDevice, &familyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> families(familyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(VulkanInstance::physicalDevice, &familyCount, families.data());
+    uint32_t validBits = families[queueFamily].timestampValidBits;
+
+    VkPhysicalDeviceProperties props{};
+    vkGetPhysicalDeviceProperties(VulkanInstance::physicalDevice, &props);
+    supported = validBits > 0 && props.limits.timestampPeriod > 0.0f;
+    if (!supported)
+        return;
+    period = props.limits.timestampPeriod;
+    validMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+    VkQueryPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    poolInfo.queryCount = 2 * MAX_FRAMES_IN_FLIGHT;
+    if (vkCreateQueryPool(VulkanInstance::device, &poolInfo, nullptr, &pool) != VK_SUCCESS)
+        throw std::runtime_error("Failed to create timestamp query pool");
+}
+
+void GpuTimer::destroy()
+{
+    if (pool != VK_NULL_HANDLE)
+        vkDestroyQueryPool(VulkanInstance::device, pool, nullptr);
+    pool = VK_NULL_HANDLE;
+    supported = false;
+}
+
+void GpuTimer::begin(VkCommandBuffer buffer, uint32_t frame)
+{
+    if (!supported)
+        return;
+    vkCmdResetQueryPool(buffer, pool, frame * 2, 2);
+    vkCmdWriteTimestamp(buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, pool, frame * 2);
+}
+
+void GpuTimer::end(VkCommandBuffer buffer, uint32_t frame)
+{
+    if (!supported)
+        return;
+    vkCmdWriteTimestamp(buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, pool, frame * 2 + 1);
+    recorded[frame] = true;
+}
+
+double GpuTimer::read(uint32_t frame)
+{
+    if (!supported || !recorded[frame])
+        return -1.0;
+    uint64_t ticks[2];
+    if (vkGetQueryPoolResults(VulkanInstance::device, pool, frame * 2, 2, sizeof(ticks), ticks, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS)
+        return -1.0;
+    uint64_t elapsed = ((ticks[1] & validMask) - (ticks[0] & validMask)) & validMask;
+    return elapsed * period / 1e6;
+}
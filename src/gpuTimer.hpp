@@ -0,0 +1,35 @@
+#ifndef GPUTIMER_HPP
+#define GPUTIMER_HPP
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#ifndef MAX_FRAMES_IN_FLIGHT
+# define MAX_FRAMES_IN_FLIGHT 2
+#endif
+
+/*
+ * Two timestamps per frame slot around a primary command buffer. A slot is read
+ * back after its last submit finished, so reading never waits on the GPU.
+ */
+class GpuTimer {
+public:
+    bool supported = false;
+
+    void init(uint32_t queueFamily);
+    void destroy();
+    /* outside of any render pass */
+    void begin(VkCommandBuffer buffer, uint32_t frame);
+    void end(VkCommandBuffer buffer, uint32_t frame);
+    /* gpu milliseconds of the last submit of the slot, negative when there is no result */
+    double read(uint32_t frame);
+
+private:
+    VkQueryPool pool = VK_NULL_HANDLE;
+    /* nanoseconds per tick */
+    double period = 0.0;
+    uint64_t validMask = ~0ull;
+    bool recorded[MAX_FRAMES_IN_FLIGHT] = {};
+};
+
+#endif
@@ -3,7 +3,7 @@
 #include "Vulkan.hpp"
 #include "app.hpp"
 
-void Image::makeImage(uint32_t width, uint32_t height, VkImageTiling tiling, VkImageUsageFlags usage)
+void Image::makeImage(uint32_t width, uint32_t height, VkImageTiling tiling, VkImageUsageFlags usage, VkSampleCountFlagBits samples)
 {
     if (format == VK_FORMAT_UNDEFINED)
             format = findSupportedFormat({VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT},
@@ -23,10 +23,12 @@ void Image::makeImage(uint32_t width, uint32_t height, VkImageTiling tiling, VkI
     imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
     imageInfo.usage = usage;
     imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.samples = samples;
 
-    if (vkCreateImage(VulkanInstance::device, &imageInfo, nullptr, &image) != VK_SUCCESS)
+    VkImage rawImage;
+    if (vkCreateImage(VulkanInstance::device, &imageInfo, nullptr, &rawImage) != VK_SUCCESS)
         throw std::runtime_error("Failed to create texture image");
+    image = ImageHandle(rawImage);
 
     VkMemoryRequirements memRequirements;
     vkGetImageMemoryRequirements(VulkanInstance::device, image, &memRequirements);
@@ -34,13 +36,47 @@ void Image::makeImage(uint32_t width, uint32_t height, VkImageTiling tiling, VkI
     VkMemoryAllocateInfo allocInfo{};
     allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
     allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VulkanInstance::physicalDevice);
+    lazilyAllocated = false;
+    if (usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT)
+    {
+        try
+        {
+            allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT, VulkanInstance::physicalDevice);
+            lazilyAllocated = true;
+        }
+        catch (const std::runtime_error &) {}
+    }
+    if (!lazilyAllocated)
+        allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VulkanInstance::physicalDevice);
+    memorySize = memRequirements.size;
 
-    if (vkAllocateMemory(VulkanInstance::device, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS)
+    VkDeviceMemory rawMemory;
+    if (GpuMemory::allocate(allocInfo, GpuMemory::imageCategory(usage), rawMemory) != VK_SUCCESS)
         throw std::runtime_error("Failed to allocate texture image memory");
+    imageMemory = MemoryHandle(rawMemory);
     vkBindImageMemory(VulkanInstance::device, image, imageMemory, 0);
 }
 
+VkDeviceSize Image::committedMemory() const
+{
+    if (!lazilyAllocated)
+        return memorySize;
+    VkDeviceSize committed = 0;
+    vkGetDeviceMemoryCommitment(VulkanInstance::device, imageMemory, &committed);
+    return committed;
+}
+
+/* the handles retire themselves, frames in flight may still use them */
+void Image::retire()
+{
+    imageView.reset();
+    sampler.reset();
+    image.reset();
+    imageMemory.reset();
+    memorySize = 0;
+    lazilyAllocated = false;
+}
+
 void Image::makeImageView(VkImageAspectFlags aspectFlags)
 {
     VkImageViewCreateInfo viewInfo{};
@@ -54,8 +90,10 @@ void Image::makeImageView(VkImageAspectFlags aspectFlags)
     viewInfo.subresourceRange.baseArrayLayer = 0;
     viewInfo.subresourceRange.layerCount = 1;
 
-    if (vkCreateImageView(VulkanInstance::device, &viewInfo, nullptr, &imageView) != VK_SUCCESS)
+    VkImageView rawView;
+    if (vkCreateImageView(VulkanInstance::device, &viewInfo, nullptr, &rawView) != VK_SUCCESS)
         throw std::runtime_error("Failed to create texture image view");
+    imageView = ImageViewHandle(rawView);
 }
 
 void Image::makeImageSampler()
@@ -79,48 +117,10 @@ void Image::makeImageSampler()
     samplerInfo.mipLodBias = 0.0f;
     samplerInfo.minLod = 0.0f;
     samplerInfo.maxLod = 0.0f;
-    if (vkCreateSampler(VulkanInstance::device, &samplerInfo, nullptr, &sampler) != VK_SUCCESS)
+    VkSampler rawSampler;
+    if (vkCreateSampler(VulkanInstance::device, &samplerInfo, nullptr, &rawSampler) != VK_SUCCESS)
         throw std::runtime_error("Failed to create texture sampler");
-}
-
-void Image::transitionImageLayout(RenderPipeline &renderer, VkImageLayout oldLayout, VkImageLayout newLayout)
-{
-    VkCommandBuffer cmdBuffer = renderer.beginSingleTimeCommands();
-    VkImageMemoryBarrier barrier{};
-    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-    barrier.oldLayout = oldLayout;
-    barrier.newLayout = newLayout;
-    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier.image = image;
-    barrier.subresourceRange.baseMipLevel = 0;
-    barrier.subresourceRange.levelCount = 1;
-    barrier.subresourceRange.baseArrayLayer = 0;
-    barrier.subresourceRange.layerCount = 1;
-    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-
-    VkPipelineStageFlags sourceStage;
-    VkPipelineStageFlags destStage;
-
-    if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL)
-    {
-        barrier.srcAccessMask = 0;
-        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-
-        sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-        destStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-    }
-
-    if (oldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
-    {
-        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-        sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-        destStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-    }
-    vkCmdPipelineBarrier(cmdBuffer, sourceStage, destStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
-    renderer.endSingleTimeCommands(cmdBuffer);
+    sampler = SamplerHandle(rawSampler);
 }
 
 VkFormat Image::findSupportedFormat(const std::vector<VkFormat> &candidates, VkImageTiling tiling, VkFormatFeatureFlags features)
@@ -5,6 +5,7 @@
 #include <GLFW/glfw3.h>
 #include <stdexcept>
 #include <vector>
+#include "vkHandle.hpp"
 
 // uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags props, VkPhysicalDevice physical);
 
@@ -14,15 +15,20 @@ class Image{
 public:
     Image(VkFormat _format, VkImageAspectFlags _flags)
     : flags(_flags), format(_format) {};
-    VkImage image;
-    VkDeviceMemory imageMemory;
-    VkImageView imageView;
-    VkSampler sampler;
+    ImageHandle image;
+    MemoryHandle imageMemory;
+    ImageViewHandle imageView;
+    SamplerHandle sampler;
+    /* size of the allocation, lazily allocated memory may commit less of it */
+    VkDeviceSize memorySize = 0;
+    bool lazilyAllocated = false;
     void makeImageView(VkImageAspectFlags aspectFlags);
-    void makeImage(uint32_t width, uint32_t height, VkImageTiling tiling, VkImageUsageFlags usage);
+    /* transient usage is backed by lazily allocated memory when the device has it */
+    void makeImage(uint32_t width, uint32_t height, VkImageTiling tiling, VkImageUsageFlags usage, VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT);
+    VkDeviceSize committedMemory() const;
     void makeImageSampler();
-    void transitionImageLayout(RenderPipeline& renderpipeline, VkImageLayout oldLayout, VkImageLayout newLayout);
-    VkFormat findSupportedFormat(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features);
+    void retire();
+    static VkFormat findSupportedFormat(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features);
 private:
     VkFormat format;
     VkImageAspectFlags flags;
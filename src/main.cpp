@@ -1,17 +1,26 @@
 #include "app.hpp"
+#include "Logger.hpp"
+#include "JobSystem.hpp"
 #include <iostream>
 
-int main()
+int main(int argc, char **argv)
 {
     App app;
 
     try
     {
         std::cout << "\033[2J";
+        Log::init();
+        app.settings = Settings::parse(argc, argv);
+        Jobs::init(app.settings.jobThreads);
         app.run();
+        Jobs::shutdown();
+        Log::shutdown();
     }
     catch(const std::exception& e)
     {
+        Jobs::shutdown();
+        Log::shutdown();
         std::cerr << "\033[1;31" << e.what() << "\033[0m" << '\n';
         exit(69);
     }
@@ -0,0 +1,345 @@
+#include "meshStreamer.hpp"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <numeric>
+#include <stdexcept>
+#include "Vulkan.hpp"
+#include "swapchain.hpp"
+#include "renderPipeline.hpp"
+#include "syncobjects.hpp"
+#include "deletionQueue.hpp"
+#include "Logger.hpp"
+#include "FileRead.hpp"
+
+void MeshStreamer::convert(const Model &model, const std::string &path, uint32_t maxChunkVertices)
+{
+    uint32_t maxTriangles = std::max(maxChunkVertices / 3, 1u);
+    size_t triangleCount = model.indices.size() / 3;
+    auto corner = [&](size_t triangle, int k) -> const Vertex & { return model.vertices[model.indices[triangle * 3 + k]]; };
+
+    std::vector<uint32_t> triangles(triangleCount);
+    std::iota(triangles.begin(), triangles.end(), 0);
+    std::vector<glm::vec3> centroids(triangleCount);
+    for (size_t i = 0; i < triangleCount; i++)
+        centroids[i] = (corner(i, 0).pos + corner(i, 1).pos + corner(i, 2).pos) / 3.0f;
+
+    /* depth first, neighbouring chunks end up next to each other in the file */
+    std::vector<std::pair<size_t, size_t>> pending{{0, triangleCount}};
+    std::vector<std::pair<size_t, size_t>> leaves;
+    while (!pending.empty())
+    {
+        auto [first, last] = pending.back();
+        pending.pop_back();
+        if (last - first <= maxTriangles)
+        {
+            if (last > first)
+                leaves.emplace_back(first, last);
+            continue;
+        }
+        glm::vec3 low(FLT_MAX), high(-FLT_MAX);
+        for (size_t i = first; i < last; i++)
+        {
+            low = glm::min(low, centroids[triangles[i]]);
+            high = glm::max(high, centroids[triangles[i]]);
+        }
+        glm::vec3 extent = high - low;
+        int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+        size_t middle = first + (last - first) / 2;
+        std::nth_element(triangles.begin() + first, triangles.begin() + middle, triangles.begin() + last,
+            [&](uint32_t a, uint32_t b) { return centroids[a][axis] < centroids[b][axis]; });
+        pending.emplace_back(middle, last);
+        pending.emplace_back(first, middle);
+    }
+
+    ChunkFileHeader header;
+    header.chunkCount = static_cast<uint32_t>(leaves.size());
+    header.maxChunkVertices = maxTriangles * 3;
+    std::vector<ChunkInfo> table(leaves.size());
+    uint64_t offset = sizeof(ChunkFileHeader) + sizeof(ChunkInfo) * table.size();
+    for (size_t c = 0; c < leaves.size(); c++)
+    {
+        ChunkInfo &info = table[c];
+        info.min = glm::vec3(FLT_MAX);
+        info.max = glm::vec3(-FLT_MAX);
+        for (size_t i = leaves[c].first; i < leaves[c].second; i++)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                info.min = glm::min(info.min, corner(triangles[i], k).pos);
+                info.max = glm::max(info.max, corner(triangles[i], k).pos);
+            }
+        }
+        info.offset = offset;
+        info.vertexCount = static_cast<uint32_t>((leaves[c].second - leaves[c].first) * 3);
+        offset += sizeof(Vertex) * info.vertexCount;
+    }
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file.is_open())
+        throw std::runtime_error("Failed to open " + path);
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(table.data()), sizeof(ChunkInfo) * table.size());
+    for (auto [first, last] : leaves)
+        for (size_t i = first; i < last; i++)
+            for (int k = 0; k < 3; k++)
+                file.write(reinterpret_cast<const char *>(&corner(triangles[i], k)), sizeof(Vertex));
+    if (!file)
+        throw std::runtime_error("Failed to write " + path);
+    Log(Logger::info) << "Wrote " << header.chunkCount << " chunks of at most " << header.maxChunkVertices << " vertices to " << path;
+}
+
+void MeshStreamer::init(const std::string &path, VkDeviceSize poolBytes, Buffer &poolBuffer, Buffer &indices)
+{
+    stream.init(path, "chunk file");
+    ChunkFileHeader header;
+    readAll(stream.fd, &header, sizeof(header), 0, "chunk file header");
+    if (memcmp(header.magic, ChunkFileHeader{}.magic, 4) != 0 || header.version != ChunkFileHeader{}.version)
+        throw std::runtime_error(path + " is not a chunked mesh");
+    std::vector<ChunkInfo> table(header.chunkCount);
+    readAll(stream.fd, table.data(), sizeof(ChunkInfo) * table.size(), sizeof(header), "chunk table");
+    chunks.resize(table.size());
+    for (size_t i = 0; i < table.size(); i++)
+        chunks[i].info = table[i];
+
+    maxChunkVertices = header.maxChunkVertices;
+    slotBytes = sizeof(Vertex) * maxChunkVertices;
+    uint32_t slotCount = static_cast<uint32_t>(poolBytes / slotBytes);
+    if (slotCount == 0)
+        throw std::runtime_error("Geometry pool is smaller than one chunk");
+
+    pool = &poolBuffer;
+    makePool(slotCount);
+
+    /* chunks are unindexed triangle lists, every draw shares the identity index range */
+    std::vector<uint32_t> sequence(maxChunkVertices);
+    std::iota(sequence.begin(), sequence.end(), 0u);
+    VkDeviceSize indexBytes = sizeof(uint32_t) * sequence.size();
+    if (indices.initDirect(indexBytes, VK_BUFFER_USAGE_INDEX_BUFFER_BIT))
+        memcpy(indices.data, sequence.data(), indexBytes);
+    else
+    {
+        Buffer upload;
+        upload.init(indexBytes, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        vkMapMemory(VulkanInstance::device, upload.bufferMemory, 0, indexBytes, 0, &upload.data);
+        memcpy(upload.data, sequence.data(), indexBytes);
+        indices.init(indexBytes, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        Buffer::copyBuffer(upload.buffer, indices.buffer, indexBytes);
+    }
+    Log(Logger::info) << "Streaming " << chunks.size() << " chunks from " << path << " through " << slotCount << " slots of "
+                      << slotBytes / 1024 << " KiB, " << (direct ? "read into the pool" : "copied through staging");
+}
+
+void MeshStreamer::makePool(uint32_t slotCount)
+{
+    direct = pool->initDirect(slotBytes * slotCount, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+    if (!direct)
+    {
+        pool->init(slotBytes * slotCount, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        if (stream.staging.size == 0)
+            stream.makeStaging(slotBytes, MAX_LOADS);
+    }
+    poolGeneration++;
+    freeSlots.clear();
+    for (uint32_t i = slotCount; i > 0; i--)
+        freeSlots.push_back(i - 1);
+}
+
+/*
+ * Halves the pool once a device local heap came under pressure. The old pool retires
+ * after the frames drawing from it, every chunk streams in again into the new one.
+ */
+bool MeshStreamer::shrink()
+{
+    uint32_t slotCount = static_cast<uint32_t>(pool->size / slotBytes) / 2;
+    if (slotCount == 0)
+        return false;
+    /* finished reads are dropped, their data belongs to slots of the old pool */
+    stream.cancel();
+    for (Chunk &chunk : chunks)
+        chunk.state = ABSENT;
+    drawn.clear();
+    makePool(slotCount);
+    Log(Logger::warn) << "Memory pressure, geometry pool shrunk to " << slotCount << " slots of " << slotBytes / 1024 << " KiB";
+    return true;
+}
+
+void MeshStreamer::destroy()
+{
+    stream.destroy();
+}
+
+void MeshStreamer::finishLoads()
+{
+    VkCommandBuffer upload = VK_NULL_HANDLE;
+    stream.finish([&](const StreamReader::Load &load) {
+        Chunk &chunk = chunks[load.id];
+        if (load.failed)
+        {
+            chunk.state = ABSENT;
+            freeSlots.push_back(chunk.slot);
+            return;
+        }
+        chunk.state = RESIDENT;
+        if (load.staging < 0)
+            return;
+
+        if (upload == VK_NULL_HANDLE)
+            upload = RenderPipeline::beginSingleTimeCommands();
+        VkBufferCopy region{};
+        region.srcOffset = slotBytes * load.staging;
+        region.dstOffset = slotBytes * chunk.slot;
+        region.size = load.bytes;
+        vkCmdCopyBuffer(upload, stream.staging.buffer, pool->buffer, 1, &region);
+    });
+    if (upload == VK_NULL_HANDLE)
+        return;
+
+    /* queued before the frame, the barrier orders the copies against its vertex fetches */
+    VkBufferMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = pool->buffer;
+    barrier.size = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(upload, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+    vkEndCommandBuffer(upload);
+    DeletionQueue::retire([upload]() { vkFreeCommandBuffers(VulkanInstance::device, RenderPipeline::commandPool, 1, &upload); });
+    Syncobjects::submit(RenderPipeline::graphicsQueue, upload, VK_NULL_HANDLE, 0, VK_NULL_HANDLE, VK_NULL_HANDLE);
+}
+
+/* true when every corner is outside one of the clip planes */
+static bool outsideFrustum(const glm::mat4 &viewProj, const glm::vec3 &low, const glm::vec3 &high)
+{
+    int outside[6] = {};
+    for (int i = 0; i < 8; i++)
+    {
+        glm::vec4 corner(i & 1 ? high.x : low.x, i & 2 ? high.y : low.y, i & 4 ? high.z : low.z, 1.0f);
+        glm::vec4 clip = viewProj * corner;
+        outside[0] += clip.x < -clip.w;
+        outside[1] += clip.x > clip.w;
+        outside[2] += clip.y < -clip.w;
+        outside[3] += clip.y > clip.w;
+        outside[4] += clip.z < 0.0f;
+        outside[5] += clip.z > clip.w;
+    }
+    for (int plane = 0; plane < 6; plane++)
+        if (outside[plane] == 8)
+            return true;
+    return false;
+}
+
+/* priority is the projected radius of the bounding sphere in pixels, 0 when culled */
+void MeshStreamer::rank(const glm::mat4 &viewProj, const glm::mat4 &proj, const glm::vec3 &eye)
+{
+    float focal = std::abs(proj[1][1]) * 0.5f * Swapchain::swapchainExtent.height;
+    visible.clear();
+    for (uint32_t i = 0; i < chunks.size(); i++)
+    {
+        Chunk &chunk = chunks[i];
+        chunk.priority = 0.0f;
+        if (outsideFrustum(viewProj, chunk.info.min, chunk.info.max))
+            continue;
+        glm::vec3 center = (chunk.info.min + chunk.info.max) * 0.5f;
+        float radius = glm::length(chunk.info.max - center);
+        chunk.priority = focal * radius / std::max(glm::length(center - eye), 1e-3f);
+        chunk.lastVisible = frame;
+        visible.push_back(i);
+    }
+    std::sort(visible.begin(), visible.end(), [this](uint32_t a, uint32_t b) { return chunks[a].priority > chunks[b].priority; });
+}
+
+void MeshStreamer::request(uint32_t wanted)
+{
+    std::vector<uint32_t> missing;
+    std::vector<uint8_t> keep(chunks.size(), 0);
+    for (uint32_t i = 0; i < wanted; i++)
+    {
+        keep[visible[i]] = 1;
+        if (chunks[visible[i]].state == ABSENT)
+            missing.push_back(visible[i]);
+    }
+    if (missing.empty())
+        return;
+
+    /* least important first, least recently seen among equals */
+    std::vector<uint32_t> victims;
+    for (uint32_t i = 0; i < chunks.size(); i++)
+        if (chunks[i].state == RESIDENT && !keep[i])
+            victims.push_back(i);
+    std::sort(victims.begin(), victims.end(), [this](uint32_t a, uint32_t b) {
+        if (chunks[a].priority != chunks[b].priority)
+            return chunks[a].priority < chunks[b].priority;
+        return chunks[a].lastVisible < chunks[b].lastVisible;
+    });
+
+    size_t budget = MAX_LOADS - std::min<size_t>(stream.pending(), MAX_LOADS);
+    size_t victim = 0;
+    for (uint32_t index : missing)
+    {
+        if (budget == 0)
+            break;
+        if (freeSlots.empty() || (!direct && !stream.stagingFree()))
+        {
+            if (freeSlots.empty() && victim < victims.size())
+            {
+                /* frames already submitted may still draw from the slot */
+                Chunk &evicted = chunks[victims[victim++]];
+                evicted.state = ABSENT;
+                uint32_t slot = evicted.slot;
+                DeletionQueue::retire([this, slot, generation = poolGeneration]() {
+                    if (generation == poolGeneration)
+                        freeSlots.push_back(slot);
+                });
+                budget--;
+                continue;
+            }
+            break;
+        }
+
+        Chunk &chunk = chunks[index];
+        chunk.state = LOADING;
+        chunk.slot = freeSlots.back();
+        freeSlots.pop_back();
+        void *destination = direct ? static_cast<char *>(pool->data) + slotBytes * chunk.slot : nullptr;
+        stream.start(index, chunk.info.offset, sizeof(Vertex) * chunk.info.vertexCount, destination);
+        budget--;
+    }
+}
+
+bool MeshStreamer::update(const glm::mat4 &viewProj, const glm::mat4 &proj, const glm::vec3 &eye, const PushConstants &object, DrawList &draws)
+{
+    frame++;
+    /* the draws point into the old pool, they are rebuilt even when nothing is resident */
+    bool reallocated = stream.pressure() && shrink();
+    finishLoads();
+    rank(viewProj, proj, eye);
+    uint32_t slotCount = static_cast<uint32_t>(pool->size / slotBytes);
+    request(std::min(static_cast<uint32_t>(visible.size()), slotCount));
+
+    /* visible resident chunks, largest on screen first which roughly sorts them front to back */
+    std::vector<uint32_t> current;
+    for (uint32_t index : visible)
+        if (chunks[index].state == RESIDENT)
+            current.push_back(index);
+    if (current == drawn && !reallocated)
+        return false;
+    drawn.swap(current);
+
+    draws.clear();
+    for (uint32_t index : drawn)
+    {
+        DrawCommand draw;
+        draw.indexCount = chunks[index].info.vertexCount;
+        draw.firstIndex = 0;
+        draw.vertexOffset = static_cast<int32_t>(maxChunkVertices * chunks[index].slot);
+        draw.object = object;
+        draw.sortKey = SortKey::pack(0, 0, object.materialIndex, 0, 0);
+        draws.push_back(draw);
+    }
+    return true;
+}
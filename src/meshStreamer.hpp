@@ -0,0 +1,101 @@
+#ifndef MESHSTREAMER_HPP
+#define MESHSTREAMER_HPP
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+#include "buffer.hpp"
+#include "DrawList.hpp"
+#include "Model.hpp"
+#include "streamReader.hpp"
+
+/*
+ * Chunked mesh file: header, chunk table, then the vertices of every chunk stored
+ * contiguously. Chunks are spatially coherent groups of whole triangles, their bounds
+ * are the spatial index the streamer culls and ranks with.
+ */
+struct ChunkFileHeader
+{
+    char magic[4] = {'S', 'C', 'M', 'C'};
+    uint32_t version = 1;
+    uint32_t chunkCount = 0;
+    uint32_t maxChunkVertices = 0;
+};
+
+struct ChunkInfo
+{
+    glm::vec3 min;
+    glm::vec3 max;
+    uint64_t offset;
+    uint32_t vertexCount;
+    uint32_t padding = 0;
+};
+
+/*
+ * Keeps the chunks that cover the most screen space in a fixed size pool of equally
+ * sized vertex slots. Chunks are read from disk on the job system. The pool lives
+ * in host visible device local memory when the device has it, workers then read
+ * straight into it, otherwise reads land in a small staging ring and are copied
+ * before the frame. Memory stays at the pool size however large the file is, the
+ * pool halves whenever device local memory comes under pressure.
+ */
+class MeshStreamer {
+public:
+    static constexpr uint32_t DEFAULT_CHUNK_VERTICES = 3 * 8192;
+    /* reads in flight, also the size of the staging ring */
+    static constexpr uint32_t MAX_LOADS = 8;
+
+    /* splits the triangles of model at the median of the longest axis until chunks fit */
+    static void convert(const Model &model, const std::string &path, uint32_t maxChunkVertices = DEFAULT_CHUNK_VERTICES);
+
+    /* reads the chunk table and creates the pool and the shared index buffer */
+    void init(const std::string &path, VkDeviceSize poolBytes, Buffer &pool, Buffer &indices);
+    void destroy();
+    bool active() const { return stream.active(); };
+
+    /*
+     * Ranks chunks for this view, evicts and starts reads, then rebuilds draws from the
+     * resident visible chunks. Returns true when draws changed.
+     */
+    bool update(const glm::mat4 &viewProj, const glm::mat4 &proj, const glm::vec3 &eye, const PushConstants &object, DrawList &draws);
+
+private:
+    enum State : uint8_t { ABSENT, LOADING, RESIDENT };
+    struct Chunk
+    {
+        ChunkInfo info;
+        State state = ABSENT;
+        uint32_t slot = 0;
+        float priority = 0.0f;
+        uint64_t lastVisible = 0;
+    };
+
+    StreamReader stream;
+    uint32_t maxChunkVertices = 0;
+    VkDeviceSize slotBytes = 0;
+    std::vector<Chunk> chunks;
+    Buffer *pool = nullptr;
+    std::vector<uint32_t> freeSlots;
+    /* bumped with every new pool, evictions retired against an older one are dropped */
+    uint32_t poolGeneration = 0;
+    bool direct = false;
+
+    uint64_t frame = 0;
+    std::vector<uint32_t> visible;
+    std::vector<uint32_t> drawn;
+
+    void makePool(uint32_t slotCount);
+    /* false when the pool is down to one slot */
+    bool shrink();
+    void rank(const glm::mat4 &viewProj, const glm::mat4 &proj, const glm::vec3 &eye);
+    void finishLoads();
+    void request(uint32_t wanted);
+};
+
+#endif
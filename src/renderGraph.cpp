@@ -0,0 +1,501 @@
+#include "renderGraph.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include "Vulkan.hpp"
+#include "app.hpp"
+
+uint32_t RenderGraph::importImage(const std::string &name, VkImage image, VkImageAspectFlags aspect, VkImageLayout layout, VkPipelineStageFlags stage)
+{
+    Resource resource;
+    resource.name = name;
+    resource.isImage = true;
+    resource.image = image;
+    resource.aspect = aspect;
+    resource.initial.layout = layout;
+    resource.initial.stage = stage;
+    resources.push_back(std::move(resource));
+    compiled = false;
+    return resources.size() - 1;
+}
+
+uint32_t RenderGraph::importBuffer(const std::string &name, VkBuffer buffer)
+{
+    Resource resource;
+    resource.name = name;
+    resource.buffer = buffer;
+    resources.push_back(std::move(resource));
+    compiled = false;
+    return resources.size() - 1;
+}
+
+uint32_t RenderGraph::createImage(const std::string &name, const TransientImageDesc &desc)
+{
+    Resource resource;
+    resource.name = name;
+    resource.isImage = true;
+    resource.transient = true;
+    resource.aspect = desc.aspect;
+    resource.imageDesc = desc;
+    resources.push_back(std::move(resource));
+    compiled = false;
+    return resources.size() - 1;
+}
+
+uint32_t RenderGraph::createBuffer(const std::string &name, VkDeviceSize size, VkBufferUsageFlags usage)
+{
+    Resource resource;
+    resource.name = name;
+    resource.transient = true;
+    resource.size = size;
+    resource.usage = usage;
+    resources.push_back(std::move(resource));
+    compiled = false;
+    return resources.size() - 1;
+}
+
+uint32_t RenderGraph::addPass(const std::string &name, std::vector<ResourceUse> reads, std::vector<ResourceUse> writes, RecordFn record)
+{
+    Pass pass;
+    pass.name = name;
+    pass.reads = std::move(reads);
+    pass.writes = std::move(writes);
+    pass.record = std::move(record);
+    passes.push_back(std::move(pass));
+    compiled = false;
+    return passes.size() - 1;
+}
+
+void RenderGraph::setRecord(uint32_t pass, RecordFn record)
+{
+    passes.at(pass).record = std::move(record);
+}
+
+void RenderGraph::rebindImage(uint32_t resource, VkImage image)
+{
+    resources.at(resource).image = image;
+    auto patch = [&](Barriers &barriers) {
+        for (size_t i = 0; i < barriers.images.size(); i++)
+        {
+            if (barriers.imageResources[i] == resource)
+                barriers.images[i].image = image;
+        }
+    };
+    for (auto &pass : passes)
+        patch(pass.barriers);
+    patch(trailing);
+}
+
+void RenderGraph::exportResource(uint32_t resource, VkPipelineStageFlags stage, VkAccessFlags access, VkImageLayout layout)
+{
+    resources[resource].exported = true;
+    resources[resource].exportState = {stage, access, layout, false};
+    compiled = false;
+}
+
+/* resources referenced by the graph are released through the deletion queue */
+void RenderGraph::clear()
+{
+    passes.clear();
+    resources.clear();
+    blocks.clear();
+    trailing = {};
+    compiled = false;
+}
+
+void RenderGraph::computeLifetimes()
+{
+    for (auto &resource : resources)
+    {
+        resource.firstPass = -1;
+        resource.lastPass = -1;
+    }
+    for (int i = 0; i < static_cast<int>(passes.size()); i++)
+    {
+        for (const auto *uses : {&passes[i].reads, &passes[i].writes})
+        {
+            for (const auto &use : *uses)
+            {
+                Resource &resource = resources.at(use.resource);
+                if (resource.firstPass < 0)
+                    resource.firstPass = i;
+                resource.lastPass = i;
+            }
+        }
+    }
+}
+
+RenderGraph::State RenderGraph::lastUse(uint32_t index) const
+{
+    State state;
+    const Resource &resource = resources[index];
+    if (resource.lastPass < 0)
+        return state;
+    state.stage = 0;
+    for (const auto *uses : {&passes[resource.lastPass].reads, &passes[resource.lastPass].writes})
+    {
+        for (const auto &use : *uses)
+        {
+            if (use.resource != index)
+                continue;
+            state.stage |= use.stage;
+            state.access |= use.access;
+            state.layout = use.layout;
+            state.written |= uses == &passes[resource.lastPass].writes;
+        }
+    }
+    return state;
+}
+
+/* greedy placement, largest first, into the first block none of whose users overlap */
+void RenderGraph::allocateTransients()
+{
+    blocks.clear();
+    std::vector<uint32_t> order;
+    for (uint32_t i = 0; i < resources.size(); i++)
+    {
+        Resource &resource = resources[i];
+        resource.block = -1;
+        resource.aliasOf = -1;
+        if (!resource.transient || resource.firstPass < 0)
+            continue;
+
+        if (resource.isImage)
+        {
+            VkImageCreateInfo imageInfo{};
+            imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+            imageInfo.imageType = VK_IMAGE_TYPE_2D;
+            imageInfo.extent = {resource.imageDesc.extent.width, resource.imageDesc.extent.height, 1};
+            imageInfo.mipLevels = 1;
+            imageInfo.arrayLayers = 1;
+            imageInfo.format = resource.imageDesc.format;
+            imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+            imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            imageInfo.usage = resource.imageDesc.usage;
+            imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+            imageInfo.samples = resource.imageDesc.samples;
+            VkImage rawImage;
+            if (vkCreateImage(VulkanInstance::device, &imageInfo, nullptr, &rawImage) != VK_SUCCESS)
+                throw std::runtime_error("Failed to create transient image " + resource.name);
+            resource.ownedImage = ImageHandle(rawImage);
+            resource.image = rawImage;
+            vkGetImageMemoryRequirements(VulkanInstance::device, rawImage, &resource.requirements);
+        }
+        else
+        {
+            VkBufferCreateInfo bufferInfo{};
+            bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+            bufferInfo.size = resource.size;
+            bufferInfo.usage = resource.usage;
+            bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+            VkBuffer rawBuffer;
+            if (vkCreateBuffer(VulkanInstance::device, &bufferInfo, nullptr, &rawBuffer) != VK_SUCCESS)
+                throw std::runtime_error("Failed to create transient buffer " + resource.name);
+            resource.ownedBuffer = BufferHandle(rawBuffer);
+            resource.buffer = rawBuffer;
+            vkGetBufferMemoryRequirements(VulkanInstance::device, rawBuffer, &resource.requirements);
+        }
+        order.push_back(i);
+    }
+
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        return resources[a].requirements.size > resources[b].requirements.size;
+    });
+    for (uint32_t index : order)
+    {
+        Resource &resource = resources[index];
+        auto fits = [&](const MemoryBlock &block) {
+            if (!(block.typeBits & resource.requirements.memoryTypeBits))
+                return false;
+            for (uint32_t other : block.resources)
+            {
+                if (!(resources[other].lastPass < resource.firstPass || resource.lastPass < resources[other].firstPass))
+                    return false;
+            }
+            return true;
+        };
+        auto block = std::find_if(blocks.begin(), blocks.end(), fits);
+        if (block == blocks.end())
+            block = blocks.emplace(blocks.end());
+        bool lazy = resource.isImage && (resource.imageDesc.usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT);
+        block->lazy = block->resources.empty() ? lazy : block->lazy && lazy;
+        block->typeBits &= resource.requirements.memoryTypeBits;
+        block->size = std::max(block->size, resource.requirements.size);
+        block->resources.push_back(index);
+        resource.block = block - blocks.begin();
+    }
+
+    for (auto &block : blocks)
+    {
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = block.size;
+        if (block.lazy)
+        {
+            try
+            {
+                allocInfo.memoryTypeIndex = findMemoryType(block.typeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT, VulkanInstance::physicalDevice);
+            }
+            catch (const std::runtime_error &)
+            {
+                block.lazy = false;
+            }
+        }
+        if (!block.lazy)
+            allocInfo.memoryTypeIndex = findMemoryType(block.typeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VulkanInstance::physicalDevice);
+        VkDeviceMemory rawMemory;
+        if (GpuMemory::allocate(allocInfo, MemoryCategory::transient, rawMemory) != VK_SUCCESS)
+            throw std::runtime_error("Failed to allocate transient memory");
+        block.memory = MemoryHandle(rawMemory);
+
+        std::sort(block.resources.begin(), block.resources.end(), [&](uint32_t a, uint32_t b) {
+            return resources[a].firstPass < resources[b].firstPass;
+        });
+        for (size_t i = 0; i < block.resources.size(); i++)
+        {
+            Resource &resource = resources[block.resources[i]];
+            if (i > 0)
+                resource.aliasOf = block.resources[i - 1];
+            if (resource.isImage)
+            {
+                vkBindImageMemory(VulkanInstance::device, resource.image, block.memory, 0);
+
+                VkImageViewCreateInfo viewInfo{};
+                viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+                viewInfo.image = resource.image;
+                viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+                viewInfo.format = resource.imageDesc.format;
+                /* depth stencil attachments are viewed through depth, barriers still cover both aspects */
+                VkImageAspectFlags viewAspect = (resource.aspect & VK_IMAGE_ASPECT_DEPTH_BIT) ? VK_IMAGE_ASPECT_DEPTH_BIT : resource.aspect;
+                viewInfo.subresourceRange = {viewAspect, 0, 1, 0, 1};
+                VkImageView rawView;
+                if (vkCreateImageView(VulkanInstance::device, &viewInfo, nullptr, &rawView) != VK_SUCCESS)
+                    throw std::runtime_error("Failed to create transient image view " + resource.name);
+                resource.ownedView = ImageViewHandle(rawView);
+                resource.view = rawView;
+            }
+            else
+                vkBindBufferMemory(VulkanInstance::device, resource.buffer, block.memory, 0);
+        }
+    }
+}
+
+/*
+ * Read after read in the same layout needs nothing, write after read only an execution
+ * dependency, everything else a memory barrier from the last write.
+ */
+void RenderGraph::transition(Barriers &barriers, uint32_t index, State &state, const State &next)
+{
+    const Resource &resource = resources[index];
+    bool layoutChange = resource.isImage && state.layout != next.layout;
+    if (!layoutChange && !state.written && !next.written)
+    {
+        state.stage |= next.stage;
+        state.access |= next.access;
+        return;
+    }
+
+    barriers.srcStage |= state.stage;
+    barriers.dstStage |= next.stage;
+    VkAccessFlags srcAccess = state.written ? state.access : 0;
+    if (resource.isImage && (layoutChange || state.written))
+    {
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.oldLayout = state.layout;
+        barrier.newLayout = next.layout;
+        barrier.srcAccessMask = srcAccess;
+        barrier.dstAccessMask = next.access;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = resource.image;
+        barrier.subresourceRange = {resource.aspect, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS};
+        barriers.images.push_back(barrier);
+        barriers.imageResources.push_back(index);
+    }
+    else if (!resource.isImage && state.written)
+    {
+        VkBufferMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier.srcAccessMask = srcAccess;
+        barrier.dstAccessMask = next.access;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.buffer = resource.buffer;
+        barrier.offset = 0;
+        barrier.size = VK_WHOLE_SIZE;
+        barriers.buffers.push_back(barrier);
+        barriers.bufferResources.push_back(index);
+    }
+    state = next;
+}
+
+void RenderGraph::compile()
+{
+    computeLifetimes();
+    allocateTransients();
+
+    std::vector<State> states;
+    for (const auto &resource : resources)
+        states.push_back(resource.initial);
+    /* a graph executed every frame finds its memory as the last user of the previous frame left it */
+    for (const auto &block : blocks)
+    {
+        State previous = lastUse(block.resources.back());
+        states[block.resources.front()] = {previous.stage, previous.written ? previous.access : 0, VK_IMAGE_LAYOUT_UNDEFINED, true};
+    }
+
+    for (int i = 0; i < static_cast<int>(passes.size()); i++)
+    {
+        Pass &pass = passes[i];
+        pass.barriers = {};
+
+        /* a resource both read and written by the pass gets a single transition */
+        std::vector<std::pair<uint32_t, State>> uses;
+        for (const auto &read : pass.reads)
+            uses.push_back({read.resource, {read.stage, read.access, read.layout, false}});
+        for (const auto &write : pass.writes)
+        {
+            auto same = std::find_if(uses.begin(), uses.end(), [&](const auto &use) { return use.first == write.resource; });
+            if (same == uses.end())
+                uses.push_back({write.resource, {write.stage, write.access, write.layout, true}});
+            else
+                same->second = {same->second.stage | write.stage, same->second.access | write.access, write.layout, true};
+        }
+
+        for (auto &[index, next] : uses)
+        {
+            const Resource &resource = resources[index];
+            /* aliased memory starts undefined once the previous user is done with it */
+            if (resource.firstPass == i && resource.aliasOf >= 0)
+            {
+                const State &previous = states[resource.aliasOf];
+                states[index] = {previous.stage, previous.written ? previous.access : 0, VK_IMAGE_LAYOUT_UNDEFINED, true};
+            }
+            transition(pass.barriers, index, states[index], next);
+        }
+    }
+
+    trailing = {};
+    for (uint32_t i = 0; i < resources.size(); i++)
+    {
+        if (resources[i].exported)
+            transition(trailing, i, states[i], resources[i].exportState);
+    }
+    compiled = true;
+}
+
+void RenderGraph::recordBarriers(VkCommandBuffer buffer, const Barriers &barriers) const
+{
+    if (!barriers.srcStage && !barriers.dstStage)
+        return;
+    vkCmdPipelineBarrier(buffer, barriers.srcStage, barriers.dstStage, 0,
+        0, nullptr,
+        barriers.buffers.size(), barriers.buffers.data(),
+        barriers.images.size(), barriers.images.data());
+}
+
+void RenderGraph::execute(VkCommandBuffer buffer) const
+{
+    if (!compiled)
+        throw std::runtime_error("Render graph executed before compile");
+    for (const auto &pass : passes)
+    {
+        recordBarriers(buffer, pass.barriers);
+        if (pass.record)
+            pass.record(buffer);
+    }
+    recordBarriers(buffer, trailing);
+}
+
+size_t RenderGraph::barrierCalls() const
+{
+    size_t calls = (trailing.srcStage || trailing.dstStage) ? 1 : 0;
+    for (const auto &pass : passes)
+    {
+        if (pass.barriers.srcStage || pass.barriers.dstStage)
+            calls++;
+    }
+    return calls;
+}
+
+VkDeviceSize RenderGraph::transientBytesRequested() const
+{
+    VkDeviceSize total = 0;
+    for (const auto &resource : resources)
+    {
+        if (resource.block >= 0)
+            total += resource.requirements.size;
+    }
+    return total;
+}
+
+VkDeviceSize RenderGraph::transientBytesAllocated() const
+{
+    VkDeviceSize total = 0;
+    for (const auto &block : blocks)
+        total += block.size;
+    return total;
+}
+
+VkDeviceSize RenderGraph::transientBytesCommitted() const
+{
+    VkDeviceSize total = 0;
+    for (const auto &block : blocks)
+    {
+        VkDeviceSize committed = block.size;
+        if (block.lazy)
+            vkGetDeviceMemoryCommitment(VulkanInstance::device, block.memory, &committed);
+        total += committed;
+    }
+    return total;
+}
+
+void RenderGraph::dumpBarriers(std::ostream &os, const Barriers &barriers) const
+{
+    if (!barriers.srcStage && !barriers.dstStage)
+        return;
+    os << "    barrier stages 0x" << std::hex << barriers.srcStage << " -> 0x" << barriers.dstStage << std::dec << "\n";
+    for (size_t i = 0; i < barriers.images.size(); i++)
+    {
+        const VkImageMemoryBarrier &barrier = barriers.images[i];
+        os << "      image " << resources[barriers.imageResources[i]].name
+           << " layout " << barrier.oldLayout << " -> " << barrier.newLayout
+           << " access 0x" << std::hex << barrier.srcAccessMask << " -> 0x" << barrier.dstAccessMask << std::dec << "\n";
+    }
+    for (size_t i = 0; i < barriers.buffers.size(); i++)
+    {
+        const VkBufferMemoryBarrier &barrier = barriers.buffers[i];
+        os << "      buffer " << resources[barriers.bufferResources[i]].name
+           << " access 0x" << std::hex << barrier.srcAccessMask << " -> 0x" << barrier.dstAccessMask << std::dec << "\n";
+    }
+}
+
+void RenderGraph::dump(std::ostream &os) const
+{
+    os << "render graph: " << passes.size() << " passes, " << resources.size() << " resources, "
+       << barrierCalls() << " barrier calls" << (compiled ? "" : " (not compiled)") << "\n";
+    for (size_t i = 0; i < passes.size(); i++)
+    {
+        const Pass &pass = passes[i];
+        os << "  pass " << i << " " << pass.name << "\n";
+        dumpBarriers(os, pass.barriers);
+        for (const auto &read : pass.reads)
+            os << "    read  " << resources[read.resource].name << "\n";
+        for (const auto &write : pass.writes)
+            os << "    write " << resources[write.resource].name << "\n";
+    }
+    if (trailing.srcStage || trailing.dstStage)
+    {
+        os << "  exports\n";
+        dumpBarriers(os, trailing);
+    }
+    for (size_t i = 0; i < blocks.size(); i++)
+    {
+        os << "  memory block " << i << " " << blocks[i].size << " bytes" << (blocks[i].lazy ? " lazy" : "") << ":";
+        for (uint32_t index : blocks[i].resources)
+            os << " " << resources[index].name << " [" << resources[index].firstPass << ", " << resources[index].lastPass << "]";
+        os << "\n";
+    }
+    if (!blocks.empty())
+        os << "  transient memory " << transientBytesAllocated() << " of " << transientBytesRequested() << " bytes requested\n";
+}
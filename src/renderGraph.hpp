@@ -0,0 +1,153 @@
+#ifndef RENDERGRAPH_HPP
+#define RENDERGRAPH_HPP
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+#include <vector>
+#include <string>
+#include <functional>
+#include <ostream>
+#include "vkHandle.hpp"
+
+/* how a pass touches a resource, layout is ignored for buffers */
+struct ResourceUse
+{
+    uint32_t resource;
+    VkPipelineStageFlags stage;
+    VkAccessFlags access;
+    VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+};
+
+struct TransientImageDesc
+{
+    VkFormat format;
+    VkExtent2D extent;
+    VkImageUsageFlags usage;
+    VkImageAspectFlags aspect;
+    VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+};
+
+/*
+ * Passes declare what they read and write, compile() derives one batched pipeline
+ * barrier per pass and places transient resources whose lifetimes do not overlap
+ * in the same memory. Resources are referenced by the index returned on creation.
+ */
+class RenderGraph {
+public:
+    using RecordFn = std::function<void(VkCommandBuffer buffer)>;
+
+    /* stage is where the image becomes available, e.g. the stage a semaphore is waited at */
+    uint32_t importImage(const std::string &name, VkImage image, VkImageAspectFlags aspect, VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED,
+        VkPipelineStageFlags stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+    uint32_t importBuffer(const std::string &name, VkBuffer buffer);
+    uint32_t createImage(const std::string &name, const TransientImageDesc &desc);
+    uint32_t createBuffer(const std::string &name, VkDeviceSize size, VkBufferUsageFlags usage);
+
+    uint32_t addPass(const std::string &name, std::vector<ResourceUse> reads, std::vector<ResourceUse> writes, RecordFn record);
+    /* replaces what a pass records, the barriers stay compiled */
+    void setRecord(uint32_t pass, RecordFn record);
+    /* points an imported image at another handle without recompiling, e.g. the acquired swapchain image */
+    void rebindImage(uint32_t resource, VkImage image);
+    /* state a resource is left in after the last pass, for consumers outside the graph */
+    void exportResource(uint32_t resource, VkPipelineStageFlags stage, VkAccessFlags access, VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED);
+
+    void compile();
+    void execute(VkCommandBuffer buffer) const;
+    void dump(std::ostream &os) const;
+    void clear();
+
+    VkImage image(uint32_t resource) const { return resources[resource].image; };
+    VkImageView view(uint32_t resource) const { return resources[resource].view; };
+    VkBuffer buffer(uint32_t resource) const { return resources[resource].buffer; };
+
+    /* number of vkCmdPipelineBarrier calls recorded by execute */
+    size_t barrierCalls() const;
+    /* memory the transient resources would need without aliasing, and what they use */
+    VkDeviceSize transientBytesRequested() const;
+    VkDeviceSize transientBytesAllocated() const;
+    /* lazily allocated blocks only count what the device committed */
+    VkDeviceSize transientBytesCommitted() const;
+
+private:
+    struct State
+    {
+        VkPipelineStageFlags stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+        VkAccessFlags access = 0;
+        VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        bool written = false;
+    };
+
+    struct Resource
+    {
+        std::string name;
+        bool isImage = false;
+        bool transient = false;
+        VkImage image = VK_NULL_HANDLE;
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VkImageView view = VK_NULL_HANDLE;
+        VkImageAspectFlags aspect = 0;
+        TransientImageDesc imageDesc{};
+        VkDeviceSize size = 0;
+        VkBufferUsageFlags usage = 0;
+        State initial;
+
+        int firstPass = -1;
+        int lastPass = -1;
+        int block = -1;
+        /* previous resource in the same memory block, its last use has to finish first */
+        int aliasOf = -1;
+        VkMemoryRequirements requirements{};
+
+        bool exported = false;
+        State exportState;
+
+        ImageHandle ownedImage;
+        BufferHandle ownedBuffer;
+        ImageViewHandle ownedView;
+    };
+
+    struct Barriers
+    {
+        VkPipelineStageFlags srcStage = 0;
+        VkPipelineStageFlags dstStage = 0;
+        std::vector<VkImageMemoryBarrier> images;
+        std::vector<VkBufferMemoryBarrier> buffers;
+        /* resource index per barrier, for dump and rebindImage */
+        std::vector<uint32_t> imageResources;
+        std::vector<uint32_t> bufferResources;
+    };
+
+    struct Pass
+    {
+        std::string name;
+        std::vector<ResourceUse> reads;
+        std::vector<ResourceUse> writes;
+        RecordFn record;
+        Barriers barriers;
+    };
+
+    struct MemoryBlock
+    {
+        MemoryHandle memory;
+        VkDeviceSize size = 0;
+        uint32_t typeBits = ~0u;
+        /* every user is a transient attachment, the memory may never be backed outside the tiles */
+        bool lazy = false;
+        std::vector<uint32_t> resources;
+    };
+
+    std::vector<Resource> resources;
+    std::vector<Pass> passes;
+    std::vector<MemoryBlock> blocks;
+    Barriers trailing;
+    bool compiled = false;
+
+    void computeLifetimes();
+    State lastUse(uint32_t resource) const;
+    void allocateTransients();
+    void transition(Barriers &barriers, uint32_t resource, State &state, const State &next);
+    void recordBarriers(VkCommandBuffer buffer, const Barriers &barriers) const;
+    void dumpBarriers(std::ostream &os, const Barriers &barriers) const;
+};
+
+#endif
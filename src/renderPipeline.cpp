@@ -2,6 +2,7 @@
 #include <string>
 #include <fstream>
 #include <array>
+#include <algorithm>
 #include <iostream>
 #include "QueueFamilyIndicies.hpp"
 #include "UniformBufferObject.hpp"
@@ -10,8 +11,12 @@
 #include "Vulkan.hpp"
 #include "swapchain.hpp"
 #include "image.hpp"
+#include "Logger.hpp"
+#include "deletionQueue.hpp"
+#include "syncobjects.hpp"
+#include "virtualTexture.hpp"
 
-static std::vector<char> readShader(const std::string &filename)
+std::vector<char> RenderPipeline::readShader(const std::string &filename)
 {
 	std::ifstream file(filename, std::ios::ate | std::ios::binary);
 
@@ -50,70 +55,353 @@ void RenderPipeline::endSingleTimeCommands(VkCommandBuffer buffer)
 {
 	vkEndCommandBuffer(buffer);
 
-	VkSubmitInfo submitInfo{};
-	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &buffer;
-	vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-	vkQueueWaitIdle(graphicsQueue);
+	/* waits on the upload's own timeline value instead of idling the queue */
+	Syncobjects::wait(Syncobjects::submit(graphicsQueue, buffer, VK_NULL_HANDLE, 0, VK_NULL_HANDLE, VK_NULL_HANDLE));
 
 	vkFreeCommandBuffers(VulkanInstance::device, commandPool, 1, &buffer);
 }
 
-void RenderPipeline::recordCommandBuffer(VkCommandBuffer buffer, uint32_t image, uint32_t currentFrame, Buffer vertexBuffer, Buffer indexBuffer, Model model)
+void RenderPipeline::bindDrawState(VkCommandBuffer buffer)
 {
-	VkCommandBufferBeginInfo commandBufferBeginInfo{};
-	commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-
-	if (vkBeginCommandBuffer(buffer, &commandBufferBeginInfo) != VK_SUCCESS)
-		throw std::runtime_error("Failed to begin command buffer");
-
-	VkRenderPassBeginInfo renderPassBeginInfo{};
-	renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-	renderPassBeginInfo.renderPass = renderPass;
-	renderPassBeginInfo.framebuffer = swapchainFramebuffers[image];
-
-	renderPassBeginInfo.renderArea.offset = {0, 0};
-	renderPassBeginInfo.renderArea.extent = Swapchain::swapchainExtent;
-
-	std::array<VkClearValue, 2> clearValues{};
-	clearValues[0].color = {{0.1f, 0.1f, 0.8f, 1.0f}};
-	clearValues[1].depthStencil = {1.0f, 0};
-
-	renderPassBeginInfo.clearValueCount = clearValues.size();
-	renderPassBeginInfo.pClearValues = clearValues.data();
-
-	vkCmdBeginRenderPass(buffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-	vkCmdBindPipeline(buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
-
 	VkViewport viewport{};
 	viewport.x = 0.0f;
 	viewport.y = 0.0f;
-	viewport.width = (float)Swapchain::swapchainExtent.width;
-	viewport.height = (float)Swapchain::swapchainExtent.height;
+	viewport.width = (float)renderExtent.width;
+	viewport.height = (float)renderExtent.height;
 	viewport.minDepth = 0.0f;
 	viewport.maxDepth = 1.0f;
 	vkCmdSetViewport(buffer, 0, 1, &viewport);
 
 	VkRect2D scissor{};
 	scissor.offset = {0, 0};
-	scissor.extent = Swapchain::swapchainExtent;
+	scissor.extent = renderExtent;
 	vkCmdSetScissor(buffer, 0, 1, &scissor);
+}
+
+/* draws arrive sorted by key, state is only bound when its part of the key changes */
+void RenderPipeline::recordDraws(VkCommandBuffer buffer, uint32_t currentFrame, const Buffer &vertexBuffer, const Buffer &indexBuffer, const DrawList &draws, size_t first, size_t last)
+{
+	uint32_t issued = 0;
+	uint32_t skipped = 0;
+	uint32_t setCount = (bindless || virtualTexture) ? 2 : 1;
+	uint64_t bound = 0;
+	for (size_t i = first; i < last; i++)
+	{
+		uint64_t key = draws[i].sortKey;
+		bool initial = i == first;
+
+		/* one pipeline and one mesh exist so far, the key fields are compared all the same */
+		bool pipelineChange = initial || SortKey::pipeline(key) != SortKey::pipeline(bound);
+		if (pipelineChange)
+		{
+			vkCmdBindPipeline(buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+			issued++;
+		}
+		else
+			skipped++;
+
+		/* materials arrive through push constants, the sets and their offsets only change with the pipeline */
+		if (pipelineChange)
+		{
+			uint32_t dynamicOffsets[] = {uniformOffsets[currentFrame], instanceOffsets[currentFrame]};
+			vkCmdBindDescriptorSets(buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 2, dynamicOffsets);
+			if (virtualTexture)
+			{
+				uint32_t feedbackOffset = virtualTexture->feedbackOffset(currentFrame);
+				vkCmdBindDescriptorSets(buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 1, 1, &virtualTexture->set, 1, &feedbackOffset);
+			}
+			else if (bindless)
+				vkCmdBindDescriptorSets(buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 1, 1, &bindlessTextures.set, 0, nullptr);
+			issued += setCount;
+		}
+		else
+			skipped += setCount;
+
+		if (initial || SortKey::mesh(key) != SortKey::mesh(bound))
+		{
+			VkBuffer vertexBuffers[] = {vertexBuffer.buffer};
+			VkDeviceSize offsets[] = {0};
+			vkCmdBindVertexBuffers(buffer, 0, 1, vertexBuffers, offsets);
+			vkCmdBindIndexBuffer(buffer, indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+			issued += 2;
+		}
+		else
+			skipped += 2;
+		bound = key;
+
+		vkCmdPushConstants(buffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PushConstants), &draws[i].object);
+		vkCmdDrawIndexed(buffer, draws[i].indexCount, 1, draws[i].firstIndex, draws[i].vertexOffset, 0);
+	}
+	binds.issued += issued;
+	binds.skipped += skipped;
+}
 
-	VkBuffer vertexBuffers[] = {vertexBuffer.buffer};
-	VkDeviceSize offsets[] = {0};
-	vkCmdBindVertexBuffers(buffer, 0, 1, vertexBuffers, offsets);
-	vkCmdBindIndexBuffer(buffer, indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+static VkImageMemoryBarrier attachmentBarrier(VkImage image, VkImageAspectFlags aspect, VkImageLayout oldLayout, VkImageLayout newLayout, VkAccessFlags srcAccess, VkAccessFlags dstAccess)
+{
+	VkImageMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.oldLayout = oldLayout;
+	barrier.newLayout = newLayout;
+	barrier.srcAccessMask = srcAccess;
+	barrier.dstAccessMask = dstAccess;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = image;
+	barrier.subresourceRange = {aspect, 0, 1, 0, 1};
+	return barrier;
+}
+
+void RenderPipeline::beginRendering(VkCommandBuffer buffer, uint32_t image, bool secondaries)
+{
+	VkClearValue colorClear{};
+	colorClear.color = {{0.1f, 0.1f, 0.8f, 1.0f}};
+	VkClearValue depthClear{};
+	depthClear.depthStencil = {1.0f, 0};
 
-	vkCmdBindDescriptorSets(buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets[currentFrame], 0, nullptr);
-	vkCmdDrawIndexed(buffer, static_cast<uint32_t>(model.indices.size()), 1, 0, 0, 0);
+	if (!dynamicRendering)
+	{
+		VkRenderPassBeginInfo renderPassBeginInfo{};
+		renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		renderPassBeginInfo.renderPass = renderPass;
+		renderPassBeginInfo.framebuffer = swapchainFramebuffers[image];
 
-	vkCmdEndRenderPass(buffer);
+		renderPassBeginInfo.renderArea.offset = {0, 0};
+		renderPassBeginInfo.renderArea.extent = renderExtent;
+
+		std::array<VkClearValue, 2> clearValues = {colorClear, depthClear};
+		renderPassBeginInfo.clearValueCount = clearValues.size();
+		renderPassBeginInfo.pClearValues = clearValues.data();
+
+		vkCmdBeginRenderPass(buffer, &renderPassBeginInfo, secondaries ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE);
+		return;
+	}
+
+	/* the frame graph already moved the attachments into their layouts */
+	bool multisampled = msaaSamples != VK_SAMPLE_COUNT_1_BIT;
+	VkImageView targetView = upscale ? sceneTargetView : Swapchain::swapchainImagesViews[image].get();
+
+	VkRenderingAttachmentInfo colorAttachmentInfo{};
+	colorAttachmentInfo.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+	colorAttachmentInfo.imageView = multisampled ? colorAttachmentView : targetView;
+	colorAttachmentInfo.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	if (multisampled)
+	{
+		colorAttachmentInfo.resolveMode = VK_RESOLVE_MODE_AVERAGE_BIT;
+		colorAttachmentInfo.resolveImageView = targetView;
+		colorAttachmentInfo.resolveImageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	}
+	colorAttachmentInfo.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	colorAttachmentInfo.storeOp = multisampled ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE;
+	colorAttachmentInfo.clearValue = colorClear;
+
+	VkRenderingAttachmentInfo depthAttachmentInfo{};
+	depthAttachmentInfo.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+	depthAttachmentInfo.imageView = depthAttachmentView;
+	depthAttachmentInfo.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	depthAttachmentInfo.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	depthAttachmentInfo.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	depthAttachmentInfo.clearValue = depthClear;
+
+	VkRenderingInfo renderingInfo{};
+	renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+	renderingInfo.flags = secondaries ? VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT : 0;
+	renderingInfo.renderArea.offset = {0, 0};
+	renderingInfo.renderArea.extent = renderExtent;
+	renderingInfo.layerCount = 1;
+	renderingInfo.colorAttachmentCount = 1;
+	renderingInfo.pColorAttachments = &colorAttachmentInfo;
+	renderingInfo.pDepthAttachment = &depthAttachmentInfo;
+	cmdBeginRendering(buffer, &renderingInfo);
+}
+
+void RenderPipeline::endRendering(VkCommandBuffer buffer)
+{
+	if (!dynamicRendering)
+	{
+		vkCmdEndRenderPass(buffer);
+		return;
+	}
+	cmdEndRendering(buffer);
+}
+
+/* linear filtered copy of the rendered area over the whole swapchain image */
+void RenderPipeline::blit(VkCommandBuffer buffer, VkImage destination)
+{
+	VkImageBlit region{};
+	region.srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+	region.srcOffsets[1] = {static_cast<int32_t>(renderExtent.width), static_cast<int32_t>(renderExtent.height), 1};
+	region.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+	region.dstOffsets[1] = {static_cast<int32_t>(Swapchain::swapchainExtent.width), static_cast<int32_t>(Swapchain::swapchainExtent.height), 1};
+	vkCmdBlitImage(buffer, sceneTarget, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, destination, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		1, &region, VK_FILTER_LINEAR);
+}
+
+/* the render pass left the offscreen target in transfer source, the swapchain image needs its own transitions */
+void RenderPipeline::blitToSwapchain(VkCommandBuffer buffer, uint32_t image)
+{
+	/* the acquire semaphore is waited at color attachment output, chain the transfer behind it */
+	VkImageMemoryBarrier destination = attachmentBarrier(Swapchain::swapchainImages[image], VK_IMAGE_ASPECT_COLOR_BIT,
+		VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0, VK_ACCESS_TRANSFER_WRITE_BIT);
+	vkCmdPipelineBarrier(buffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+		0, 0, nullptr, 0, nullptr, 1, &destination);
+
+	blit(buffer, Swapchain::swapchainImages[image]);
+
+	VkImageMemoryBarrier present = attachmentBarrier(Swapchain::swapchainImages[image], VK_IMAGE_ASPECT_COLOR_BIT,
+		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_ACCESS_TRANSFER_WRITE_BIT, 0);
+	vkCmdPipelineBarrier(buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+		0, 0, nullptr, 0, nullptr, 1, &present);
+}
+
+void RenderPipeline::recordCommandBuffer(VkCommandBuffer buffer, uint32_t image, uint32_t currentFrame, const Buffer &vertexBuffer, const Buffer &indexBuffer, const DrawList &draws, bool reuseSecondaries)
+{
+	VkCommandBufferBeginInfo commandBufferBeginInfo{};
+	commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+
+	if (vkBeginCommandBuffer(buffer, &commandBufferBeginInfo) != VK_SUCCESS)
+		throw std::runtime_error("Failed to begin command buffer");
+	timer.begin(buffer, currentFrame);
+	if (virtualTexture)
+		virtualTexture->beginFeedback(buffer, currentFrame);
+
+	auto scene = [&](VkCommandBuffer passBuffer) {
+		if (recorder.threads() == 0)
+		{
+			beginRendering(passBuffer, image, false);
+			bindDrawState(passBuffer);
+			binds.reset();
+			recordDraws(passBuffer, currentFrame, vertexBuffer, indexBuffer, draws, 0, draws.size());
+		}
+		else
+		{
+			beginRendering(passBuffer, image, true);
+			/* reused secondaries are shared by every image of the frame slot, so they cannot name a framebuffer */
+			if (!reuseSecondaries || !recorder.valid[currentFrame])
+			{
+				VkFramebuffer framebuffer = (reuseSecondaries || dynamicRendering) ? VK_NULL_HANDLE : swapchainFramebuffers[image].get();
+
+				VkCommandBufferInheritanceRenderingInfo renderingInfo{};
+				renderingInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO;
+				renderingInfo.colorAttachmentCount = 1;
+				renderingInfo.pColorAttachmentFormats = &Swapchain::swapchainImageFormat;
+				renderingInfo.depthAttachmentFormat = depthFormat;
+				renderingInfo.rasterizationSamples = msaaSamples;
+
+				binds.reset();
+				recorder.record(currentFrame, dynamicRendering ? VK_NULL_HANDLE : renderPass, framebuffer, draws.size(), [&](VkCommandBuffer secondary, size_t first, size_t last) {
+					bindDrawState(secondary);
+					recordDraws(secondary, currentFrame, vertexBuffer, indexBuffer, draws, first, last);
+				}, dynamicRendering ? &renderingInfo : nullptr);
+				recorder.valid[currentFrame] = reuseSecondaries;
+			}
+			const std::vector<VkCommandBuffer> &secondaries = recorder.secondaries(currentFrame);
+			vkCmdExecuteCommands(passBuffer, static_cast<uint32_t>(secondaries.size()), secondaries.data());
+		}
+		endRendering(passBuffer);
+	};
+
+	if (dynamicRendering)
+	{
+		/* the graph records the attachment transitions and the blit, only the swapchain image changes */
+		frameGraph.rebindImage(frameOutput, Swapchain::swapchainImages[image]);
+		frameGraph.setRecord(scenePass, scene);
+		frameGraph.execute(buffer);
+		frameGraph.setRecord(scenePass, nullptr);
+	}
+	else
+	{
+		scene(buffer);
+		if (upscale)
+			blitToSwapchain(buffer, image);
+	}
+	if (virtualTexture)
+		virtualTexture->endFeedback(buffer, currentFrame);
+	timer.end(buffer, currentFrame);
 	if (vkEndCommandBuffer(buffer) != VK_SUCCESS)
 		throw std::runtime_error("Failed to end commandbuffer");
 }
 
+void RenderPipeline::setRecordThreads(uint32_t threads)
+{
+	vkDeviceWaitIdle(VulkanInstance::device);
+	QueueFamilyIndicies indicies = QueueFamilyIndicies::findQueueFamilyIndicies(VulkanInstance::physicalDevice, VulkanInstance::surface);
+	recorder.init(threads, indicies.graphicsFamily.value());
+	invalidate(DIRTY_PIPELINE);
+}
+
+void RenderPipeline::setRenderScale(float scale)
+{
+	renderScale = upscale ? scale : 1.0f;
+	updateRenderExtent();
+	invalidate(DIRTY_RESOLUTION);
+}
+
+void RenderPipeline::updateRenderExtent()
+{
+	renderExtent.width = std::max(1u, static_cast<uint32_t>(Swapchain::swapchainExtent.width * renderScale + 0.5f));
+	renderExtent.height = std::max(1u, static_cast<uint32_t>(Swapchain::swapchainExtent.height * renderScale + 0.5f));
+}
+
+/* the swapchain has to accept blits and the format has to be linearly filterable */
+bool RenderPipeline::canUpscale()
+{
+	VkFormatProperties props{};
+	vkGetPhysicalDeviceFormatProperties(VulkanInstance::physicalDevice, Swapchain::swapchainImageFormat, &props);
+	VkFormatFeatureFlags needed = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+	return Swapchain::transferTarget && (props.optimalTilingFeatures & needed) == needed;
+}
+
+VkCommandBuffer RenderPipeline::getStaticCommandBuffer(uint32_t image, uint32_t currentFrame, const Buffer &vertexBuffer, const Buffer &indexBuffer, const DrawList &draws)
+{
+	if (staticCommandBuffers.size() != MAX_FRAMES_IN_FLIGHT)
+	{
+		staticCommandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+		staticCommandBuffersValid.resize(MAX_FRAMES_IN_FLIGHT);
+	}
+	std::vector<VkCommandBuffer> &buffers = staticCommandBuffers[currentFrame];
+	std::vector<bool> &valid = staticCommandBuffersValid[currentFrame];
+
+	/* the fence of this frame slot has been waited on, none of its buffers are pending */
+	if (buffers.size() != Swapchain::swapchainImages.size())
+	{
+		if (!buffers.empty())
+			vkFreeCommandBuffers(VulkanInstance::device, commandPool, buffers.size(), buffers.data());
+		buffers.resize(Swapchain::swapchainImages.size());
+		valid.assign(buffers.size(), false);
+
+		VkCommandBufferAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.commandBufferCount = buffers.size();
+		allocInfo.commandPool = commandPool;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		if (vkAllocateCommandBuffers(VulkanInstance::device, &allocInfo, buffers.data()) != VK_SUCCESS)
+			throw std::runtime_error("Failed to allocate command buffer");
+	}
+
+	if (!valid[image])
+	{
+		vkResetCommandBuffer(buffers[image], 0);
+		recordCommandBuffer(buffers[image], image, currentFrame, vertexBuffer, indexBuffer, draws, true);
+		valid[image] = true;
+		staticRecordCount++;
+	}
+	return buffers[image];
+}
+
+void RenderPipeline::invalidate(uint32_t reasons)
+{
+	if (reasons == DIRTY_NONE)
+		return;
+	Log::deferred(Logger::debug, [reasons](std::ostream &os) {
+		os << "Command buffers invalidated:" << (reasons & DIRTY_SWAPCHAIN ? " swapchain" : "")
+		   << (reasons & DIRTY_PIPELINE ? " pipeline" : "") << (reasons & DIRTY_DRAWLIST ? " drawlist" : "")
+		   << (reasons & DIRTY_RESOLUTION ? " resolution" : "") << (reasons & DIRTY_DESCRIPTORS ? " descriptors" : "");
+	});
+	for (auto &valid : staticCommandBuffersValid)
+		valid.assign(valid.size(), false);
+	recorder.valid.assign(recorder.valid.size(), false);
+}
+
 void RenderPipeline::makeCommandPool()
 {
 	QueueFamilyIndicies indicies = QueueFamilyIndicies::findQueueFamilyIndicies(VulkanInstance::physicalDevice, VulkanInstance::surface);
@@ -143,7 +431,7 @@ void RenderPipeline::makeDescriptorSetLayout()
 	VkDescriptorSetLayoutBinding uboLayoutBinding{};
 	uboLayoutBinding.binding = 0;
 	uboLayoutBinding.descriptorCount = 1;
-	uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 
 	uboLayoutBinding.pImmutableSamplers = nullptr;
 	uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
@@ -155,7 +443,14 @@ void RenderPipeline::makeDescriptorSetLayout()
 	samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 	samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 
-	std::array<VkDescriptorSetLayoutBinding, 2> bindings = {uboLayoutBinding, samplerLayoutBinding};
+	VkDescriptorSetLayoutBinding instanceLayoutBinding{};
+	instanceLayoutBinding.binding = 2;
+	instanceLayoutBinding.descriptorCount = 1;
+	instanceLayoutBinding.pImmutableSamplers = nullptr;
+	instanceLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	instanceLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+	std::array<VkDescriptorSetLayoutBinding, 3> bindings = {uboLayoutBinding, samplerLayoutBinding, instanceLayoutBinding};
 
 	VkDescriptorSetLayoutCreateInfo layoutInfo{};
 	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
@@ -166,90 +461,166 @@ void RenderPipeline::makeDescriptorSetLayout()
 		throw std::runtime_error("Failed to create descriptor set layout");
 }
 
-void RenderPipeline::makeDescriptorSets(std::vector<Buffer> uniformBuffers, Image textureImage)
+/* a single set for every frame, the frame is selected with the dynamic offset */
+void RenderPipeline::makeDescriptorSets(const Buffer &uniformBuffer, VkDeviceSize uniformRange, const Image &textureImage, const Buffer &instanceBuffer, VkDeviceSize instanceRange)
 {
-	std::vector<VkDescriptorSetLayout> layouts(MAX_FRAMES_IN_FLIGHT, descriptorSetLayout);
-
 	VkDescriptorSetAllocateInfo allocInfo{};
 	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
 	allocInfo.descriptorPool = descriptorPool;
-	allocInfo.descriptorSetCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
-	allocInfo.pSetLayouts = layouts.data();
+	allocInfo.descriptorSetCount = 1;
+	allocInfo.pSetLayouts = &descriptorSetLayout;
 
-	descriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
-	if (vkAllocateDescriptorSets(VulkanInstance::device, &allocInfo, descriptorSets.data()) != VK_SUCCESS)
+	if (vkAllocateDescriptorSets(VulkanInstance::device, &allocInfo, &descriptorSet) != VK_SUCCESS)
 		throw std::runtime_error("Failed to create descriptor set");
 
-	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+	VkDescriptorBufferInfo bufferInfo{};
+	bufferInfo.buffer = uniformBuffer.buffer;
+	bufferInfo.offset = 0;
+	bufferInfo.range = uniformRange;
+
+	VkDescriptorImageInfo imageInfo{};
+	imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	imageInfo.imageView = textureImage.imageView;
+	imageInfo.sampler = textureImage.sampler;
+
+	VkDescriptorBufferInfo instanceInfo{};
+	instanceInfo.buffer = instanceBuffer.buffer;
+	instanceInfo.offset = 0;
+	instanceInfo.range = instanceRange;
+
+	std::array<VkWriteDescriptorSet, 3> descriptorWrites{};
+	descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptorWrites[0].dstSet = descriptorSet;
+	descriptorWrites[0].dstBinding = 0;
+	descriptorWrites[0].dstArrayElement = 0;
+	descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	descriptorWrites[0].descriptorCount = 1;
+	descriptorWrites[0].pBufferInfo = &bufferInfo;
+
+	descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptorWrites[1].dstSet = descriptorSet;
+	descriptorWrites[1].dstBinding = 1;
+	descriptorWrites[1].dstArrayElement = 0;
+	descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	descriptorWrites[1].descriptorCount = 1;
+	descriptorWrites[1].pImageInfo = &imageInfo;
+
+	descriptorWrites[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptorWrites[2].dstSet = descriptorSet;
+	descriptorWrites[2].dstBinding = 2;
+	descriptorWrites[2].dstArrayElement = 0;
+	descriptorWrites[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	descriptorWrites[2].descriptorCount = 1;
+	descriptorWrites[2].pBufferInfo = &instanceInfo;
+
+	vkUpdateDescriptorSets(VulkanInstance::device, descriptorWrites.size(), descriptorWrites.data(), 0, nullptr);
+}
+
+/* the buffer bindings are copied from the current set, only the texture is written */
+void RenderPipeline::replaceTexture(VkImageView imageView, VkSampler sampler)
+{
+	VkDescriptorSetAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = descriptorPool;
+	allocInfo.descriptorSetCount = 1;
+	allocInfo.pSetLayouts = &descriptorSetLayout;
+
+	VkDescriptorSet fresh;
+	if (vkAllocateDescriptorSets(VulkanInstance::device, &allocInfo, &fresh) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create descriptor set, too many texture swaps in flight");
+
+	std::array<VkCopyDescriptorSet, 2> descriptorCopies{};
+	for (uint32_t i = 0; i < descriptorCopies.size(); i++)
 	{
-		VkDescriptorBufferInfo bufferInfo{};
-		bufferInfo.buffer = uniformBuffers[i].buffer;
-		bufferInfo.offset = 0;
-		bufferInfo.range = sizeof(UniformBufferObject);
-
-		VkDescriptorImageInfo imageInfo{};
-		imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		imageInfo.imageView = textureImage.imageView;
-		imageInfo.sampler = textureImage.sampler;
-
-		std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
-		descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		descriptorWrites[0].dstSet = descriptorSets[i];
-		descriptorWrites[0].dstBinding = 0;
-		descriptorWrites[0].dstArrayElement = 0;
-		descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		descriptorWrites[0].descriptorCount = 1;
-		descriptorWrites[0].pBufferInfo = &bufferInfo;
-
-		descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		descriptorWrites[1].dstSet = descriptorSets[i];
-		descriptorWrites[1].dstBinding = 1;
-		descriptorWrites[1].dstArrayElement = 0;
-		descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		descriptorWrites[1].descriptorCount = 1;
-		descriptorWrites[1].pImageInfo = &imageInfo;
-
-		vkUpdateDescriptorSets(VulkanInstance::device, descriptorWrites.size(), descriptorWrites.data(), 0, nullptr);
+		descriptorCopies[i].sType = VK_STRUCTURE_TYPE_COPY_DESCRIPTOR_SET;
+		descriptorCopies[i].srcSet = descriptorSet;
+		descriptorCopies[i].srcBinding = i * 2;
+		descriptorCopies[i].dstSet = fresh;
+		descriptorCopies[i].dstBinding = i * 2;
+		descriptorCopies[i].descriptorCount = 1;
 	}
+
+	VkDescriptorImageInfo imageInfo{};
+	imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	imageInfo.imageView = imageView;
+	imageInfo.sampler = sampler;
+
+	VkWriteDescriptorSet descriptorWrite{};
+	descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptorWrite.dstSet = fresh;
+	descriptorWrite.dstBinding = 1;
+	descriptorWrite.dstArrayElement = 0;
+	descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	descriptorWrite.descriptorCount = 1;
+	descriptorWrite.pImageInfo = &imageInfo;
+	vkUpdateDescriptorSets(VulkanInstance::device, 1, &descriptorWrite, descriptorCopies.size(), descriptorCopies.data());
+
+	VkDescriptorPool pool = descriptorPool;
+	VkDescriptorSet old = descriptorSet;
+	DeletionQueue::retire([pool, old]() { vkFreeDescriptorSets(VulkanInstance::device, pool, 1, &old); });
+	descriptorSet = fresh;
+	invalidate(DIRTY_DESCRIPTORS);
 }
 
 void RenderPipeline::makeDescriptorPool()
 {
-	std::array<VkDescriptorPoolSize, 2> poolSizes{};
-	poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	poolSizes[0].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+	std::array<VkDescriptorPoolSize, 3> poolSizes{};
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	poolSizes[0].descriptorCount = DESCRIPTOR_SETS;
 	poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	poolSizes[1].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+	poolSizes[1].descriptorCount = DESCRIPTOR_SETS;
+	poolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	poolSizes[2].descriptorCount = DESCRIPTOR_SETS;
 
 	VkDescriptorPoolCreateInfo poolInfo{};
 	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
 	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
 	poolInfo.pPoolSizes = poolSizes.data();
-	poolInfo.maxSets = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+	/* texture swaps free their replaced set */
+	poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
+	poolInfo.maxSets = DESCRIPTOR_SETS;
 
 	if (vkCreateDescriptorPool(VulkanInstance::device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS)
 		throw std::runtime_error("Failed to create descriptor pool");
 }
 
-void RenderPipeline::makeRenderPass(Image depthImage)
+void RenderPipeline::makeRenderPass()
 {
+	depthFormat = Image::findSupportedFormat({VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT}, VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
+	if (dynamicRendering)
+	{
+		/* no render pass object, only the attachment formats and the entry points are needed */
+		bool core = VulkanInstance::features.apiVersion >= VK_API_VERSION_1_3;
+		cmdBeginRendering = reinterpret_cast<PFN_vkCmdBeginRendering>(vkGetDeviceProcAddr(VulkanInstance::device, core ? "vkCmdBeginRendering" : "vkCmdBeginRenderingKHR"));
+		cmdEndRendering = reinterpret_cast<PFN_vkCmdEndRendering>(vkGetDeviceProcAddr(VulkanInstance::device, core ? "vkCmdEndRendering" : "vkCmdEndRenderingKHR"));
+		if (!cmdBeginRendering || !cmdEndRendering)
+			throw std::runtime_error("Failed to load dynamic rendering entry points");
+		return;
+	}
+
+	bool multisampled = msaaSamples != VK_SAMPLE_COUNT_1_BIT;
+
+	/* a multisampled color target is resolved at the end of the subpass and never stored */
 	VkAttachmentDescription attachmentDescription{};
 	attachmentDescription.format = Swapchain::swapchainImageFormat;
-	attachmentDescription.samples = VK_SAMPLE_COUNT_1_BIT;
+	attachmentDescription.samples = msaaSamples;
 	attachmentDescription.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-	attachmentDescription.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	attachmentDescription.storeOp = multisampled ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE;
 	attachmentDescription.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	attachmentDescription.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	attachmentDescription.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	attachmentDescription.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	/* the offscreen target is blitted to the swapchain afterwards instead of presented */
+	VkImageLayout outputLayout = upscale ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	attachmentDescription.finalLayout = multisampled ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : outputLayout;
 
 	VkAttachmentReference attachmentReference{};
 	attachmentReference.attachment = 0;
 	attachmentReference.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
+	/* depth is only read inside the pass, nothing is stored so it can live in tile memory */
 	VkAttachmentDescription depthAttachment{};
-	depthAttachment.format = depthImage.findSupportedFormat({VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT}, VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
-	depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+	depthAttachment.format = depthFormat;
+	depthAttachment.samples = msaaSamples;
 	depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
 	depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
@@ -261,11 +632,27 @@ void RenderPipeline::makeRenderPass(Image depthImage)
 	depthAttachmentReference.attachment = 1;
 	depthAttachmentReference.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
+	VkAttachmentDescription resolveAttachment{};
+	resolveAttachment.format = Swapchain::swapchainImageFormat;
+	resolveAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+	resolveAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	resolveAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	resolveAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	resolveAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	resolveAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	resolveAttachment.finalLayout = outputLayout;
+
+	VkAttachmentReference resolveAttachmentReference{};
+	resolveAttachmentReference.attachment = 2;
+	resolveAttachmentReference.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
 	VkSubpassDescription subpassDescription{};
 	subpassDescription.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
 	subpassDescription.colorAttachmentCount = 1;
 	subpassDescription.pColorAttachments = &attachmentReference;
 	subpassDescription.pDepthStencilAttachment = &depthAttachmentReference;
+	if (multisampled)
+		subpassDescription.pResolveAttachments = &resolveAttachmentReference;
 
 	VkSubpassDependency subpassDependency{};
 	subpassDependency.srcSubpass = VK_SUBPASS_EXTERNAL;
@@ -273,42 +660,71 @@ void RenderPipeline::makeRenderPass(Image depthImage)
 
 	subpassDependency.srcAccessMask = 0;
 	subpassDependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+	/* the blit of the previous frame still reads the offscreen target */
+	if (upscale)
+		subpassDependency.srcStageMask |= VK_PIPELINE_STAGE_TRANSFER_BIT;
 	subpassDependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
 	subpassDependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 
-	std::array<VkAttachmentDescription, 2> attachments = {attachmentDescription, depthAttachment};
+	VkSubpassDependency blitDependency{};
+	blitDependency.srcSubpass = 0;
+	blitDependency.dstSubpass = VK_SUBPASS_EXTERNAL;
+	blitDependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	blitDependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	blitDependency.dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+	blitDependency.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	std::array<VkSubpassDependency, 2> dependencies = {subpassDependency, blitDependency};
+
+	std::array<VkAttachmentDescription, 3> attachments = {attachmentDescription, depthAttachment, resolveAttachment};
 
 	VkRenderPassCreateInfo renderPassCreateInfo{};
 	renderPassCreateInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-	renderPassCreateInfo.attachmentCount = attachments.size();
+	renderPassCreateInfo.attachmentCount = multisampled ? 3 : 2;
 	renderPassCreateInfo.pAttachments = attachments.data();
 	renderPassCreateInfo.subpassCount = 1;
 	renderPassCreateInfo.pSubpasses = &subpassDescription;
-	renderPassCreateInfo.dependencyCount = 1;
-	renderPassCreateInfo.pDependencies = &subpassDependency;
+	renderPassCreateInfo.dependencyCount = upscale ? 2 : 1;
+	renderPassCreateInfo.pDependencies = dependencies.data();
 
 	if (vkCreateRenderPass(VulkanInstance::device, &renderPassCreateInfo, nullptr, &renderPass) != VK_SUCCESS)
 		throw std::runtime_error("Failed to create renderpass");
 }
 
-void RenderPipeline::makePipeline()
+/* highest supported count not above the request, for both color and depth */
+VkSampleCountFlagBits RenderPipeline::pickSampleCount(uint32_t requested)
 {
-	std::vector<char> vertexShader = readShader("shaders/vert.spv");
-	std::vector<char> fragmentShader = readShader("shaders/frag.spv");
+	VkPhysicalDeviceProperties props{};
+	vkGetPhysicalDeviceProperties(VulkanInstance::physicalDevice, &props);
+	VkSampleCountFlags supported = props.limits.framebufferColorSampleCounts & props.limits.framebufferDepthSampleCounts;
+	for (uint32_t count = VK_SAMPLE_COUNT_64_BIT; count > VK_SAMPLE_COUNT_1_BIT; count >>= 1)
+	{
+		if (count <= requested && (supported & count))
+			return static_cast<VkSampleCountFlagBits>(count);
+	}
+	return VK_SAMPLE_COUNT_1_BIT;
+}
 
-	VkShaderModule vertexShaderModule = makeShaderModule(vertexShader);
-	VkShaderModule fragmentShaderModule = makeShaderModule(fragmentShader);
+std::vector<std::string> RenderPipeline::shaderFiles() const
+{
+	return {"shaders/vert.spv", virtualTexture ? "shaders/virtual_frag.spv" : bindless ? "shaders/bindless_frag.spv" : "shaders/frag.spv"};
+}
 
+void RenderPipeline::makePipeline()
+{
+	std::vector<std::string> files = shaderFiles();
+	makePipeline(readShader(files[0]), readShader(files[1]));
+}
+
+void RenderPipeline::makePipeline(const std::vector<char> &vertexShader, const std::vector<char> &fragmentShader)
+{
 	VkPipelineShaderStageCreateInfo vertexShaderStageCreateInfo{};
 	vertexShaderStageCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
 	vertexShaderStageCreateInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-	vertexShaderStageCreateInfo.module = vertexShaderModule;
 	vertexShaderStageCreateInfo.pName = "main";
 
 	VkPipelineShaderStageCreateInfo fragmentShaderStageCreateInfo{};
 	fragmentShaderStageCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
 	fragmentShaderStageCreateInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-	fragmentShaderStageCreateInfo.module = fragmentShaderModule;
 	fragmentShaderStageCreateInfo.pName = "main";
 
 	VkPipelineShaderStageCreateInfo pipelineShaderStageCreateInfo[] = {vertexShaderStageCreateInfo, fragmentShaderStageCreateInfo};
@@ -369,7 +785,7 @@ void RenderPipeline::makePipeline()
 	VkPipelineMultisampleStateCreateInfo pipelineMultisampleStateCreateInfo{};
 	pipelineMultisampleStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
 	pipelineMultisampleStateCreateInfo.sampleShadingEnable = VK_FALSE;
-	pipelineMultisampleStateCreateInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+	pipelineMultisampleStateCreateInfo.rasterizationSamples = msaaSamples;
 
 	VkPipelineColorBlendAttachmentState pipelineColorBlendAttachmentState{};
 	pipelineColorBlendAttachmentState.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
@@ -383,11 +799,28 @@ void RenderPipeline::makePipeline()
 
 	VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo{};
 	pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-	pipelineLayoutCreateInfo.setLayoutCount = 1;
-	pipelineLayoutCreateInfo.pSetLayouts = &descriptorSetLayout;
-
-	if (vkCreatePipelineLayout(VulkanInstance::device, &pipelineLayoutCreateInfo, nullptr, &pipelineLayout) != VK_SUCCESS)
-		throw std::runtime_error("Failed to create pipeline layout");
+	std::vector<VkDescriptorSetLayout> setLayouts = {descriptorSetLayout};
+	if (virtualTexture)
+		setLayouts.push_back(virtualTexture->layout);
+	else if (bindless)
+		setLayouts.push_back(bindlessTextures.layout);
+	pipelineLayoutCreateInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+	pipelineLayoutCreateInfo.pSetLayouts = setLayouts.data();
+
+	VkPushConstantRange pushConstantRange{};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(PushConstants);
+	pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+	pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+
+	if (pipelineLayout.get() == VK_NULL_HANDLE)
+	{
+		VkPipelineLayout rawLayout;
+		if (vkCreatePipelineLayout(VulkanInstance::device, &pipelineLayoutCreateInfo, nullptr, &rawLayout) != VK_SUCCESS)
+			throw std::runtime_error("Failed to create pipeline layout");
+		pipelineLayout = PipelineLayoutHandle(rawLayout);
+	}
 
 	VkPipelineDepthStencilStateCreateInfo depthStencil{};
 	depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
@@ -413,40 +846,140 @@ void RenderPipeline::makePipeline()
 	graphicsPipelineCreateInfo.pViewportState = &pipelineViewpoerStateCreateInfo;
 	graphicsPipelineCreateInfo.pMultisampleState = &pipelineMultisampleStateCreateInfo;
 	graphicsPipelineCreateInfo.pDynamicState = &pipelineDynamicStateCreateInfo;
-	graphicsPipelineCreateInfo.renderPass = renderPass;
+	/* with dynamic rendering the pipeline only has to match the attachment formats */
+	VkPipelineRenderingCreateInfo pipelineRenderingCreateInfo{};
+	pipelineRenderingCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+	pipelineRenderingCreateInfo.colorAttachmentCount = 1;
+	pipelineRenderingCreateInfo.pColorAttachmentFormats = &Swapchain::swapchainImageFormat;
+	pipelineRenderingCreateInfo.depthAttachmentFormat = depthFormat;
+	if (dynamicRendering)
+		graphicsPipelineCreateInfo.pNext = &pipelineRenderingCreateInfo;
+	graphicsPipelineCreateInfo.renderPass = dynamicRendering ? VK_NULL_HANDLE : renderPass;
 	graphicsPipelineCreateInfo.subpass = 0;
 	graphicsPipelineCreateInfo.basePipelineHandle = VK_NULL_HANDLE;
 	graphicsPipelineCreateInfo.basePipelineIndex = -1;
 	graphicsPipelineCreateInfo.pDepthStencilState = &depthStencil;
 
-	if (vkCreateGraphicsPipelines(VulkanInstance::device, VK_NULL_HANDLE, 1, &graphicsPipelineCreateInfo, nullptr, &graphicsPipeline) != VK_SUCCESS)
-		throw std::runtime_error("Failed to create pipeline");
+	if (pipelineCache == VK_NULL_HANDLE)
+	{
+		VkPipelineCacheCreateInfo cacheCreateInfo{};
+		cacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+		if (vkCreatePipelineCache(VulkanInstance::device, &cacheCreateInfo, nullptr, &pipelineCache) != VK_SUCCESS)
+			pipelineCache = VK_NULL_HANDLE;
+	}
+
+	/* made last so nothing that throws runs while they exist, a hot reload must not leak them */
+	VkShaderModule vertexShaderModule = makeShaderModule(vertexShader);
+	VkShaderModule fragmentShaderModule;
+	try
+	{
+		fragmentShaderModule = makeShaderModule(fragmentShader);
+	}
+	catch (...)
+	{
+		vkDestroyShaderModule(VulkanInstance::device, vertexShaderModule, nullptr);
+		throw;
+	}
+	pipelineShaderStageCreateInfo[0].module = vertexShaderModule;
+	pipelineShaderStageCreateInfo[1].module = fragmentShaderModule;
 
+	VkPipeline rawPipeline;
+	VkResult result = vkCreateGraphicsPipelines(VulkanInstance::device, pipelineCache, 1, &graphicsPipelineCreateInfo, nullptr, &rawPipeline);
 	vkDestroyShaderModule(VulkanInstance::device, vertexShaderModule, nullptr);
 	vkDestroyShaderModule(VulkanInstance::device, fragmentShaderModule, nullptr);
+	if (result != VK_SUCCESS)
+		throw std::runtime_error("Failed to create pipeline");
+	/* the old pipeline retires until the frames recorded with it finished */
+	graphicsPipeline = PipelineHandle(rawPipeline);
+}
+
+/*
+ * Depth and the multisampled color only live inside the scene pass, the offscreen target
+ * until the upscale blit. The first use of each frame waits for the last one of the frame before.
+ */
+void RenderPipeline::makeFrameGraph()
+{
+	bool multisampled = msaaSamples != VK_SAMPLE_COUNT_1_BIT;
+	VkExtent2D extent = Swapchain::swapchainExtent;
+	VkImageAspectFlags depthAspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+	if (depthFormat == VK_FORMAT_D32_SFLOAT_S8_UINT || depthFormat == VK_FORMAT_D24_UNORM_S8_UINT)
+		depthAspect |= VK_IMAGE_ASPECT_STENCIL_BIT;
+
+	/* old images and memory retire themselves */
+	frameGraph.clear();
+	/* the acquire semaphore is waited at color attachment output, the first transition chains behind it */
+	frameOutput = frameGraph.importImage("swapchain", Swapchain::swapchainImages[0], VK_IMAGE_ASPECT_COLOR_BIT,
+		VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+	uint32_t depth = frameGraph.createImage("depth", {depthFormat, extent,
+		VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT, depthAspect, msaaSamples});
+	uint32_t target = frameOutput;
+	if (upscale)
+		target = frameGraph.createImage("scene color", {Swapchain::swapchainImageFormat, extent,
+			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_IMAGE_ASPECT_COLOR_BIT});
+
+	std::vector<ResourceUse> writes = {
+		{target, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL},
+		{depth, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+			VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL}};
+	uint32_t color = 0;
+	if (multisampled)
+	{
+		color = frameGraph.createImage("msaa color", {Swapchain::swapchainImageFormat, extent,
+			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT, VK_IMAGE_ASPECT_COLOR_BIT, msaaSamples});
+		writes.push_back({color, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL});
+	}
+	/* recorded per command buffer, it depends on the draws and the swapchain image */
+	scenePass = frameGraph.addPass("scene", {}, writes, nullptr);
+	if (upscale)
+	{
+		frameGraph.addPass("upscale",
+			{{target, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL}},
+			{{frameOutput, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL}},
+			[this](VkCommandBuffer buffer) { blit(buffer, frameGraph.image(frameOutput)); });
+	}
+	frameGraph.exportResource(frameOutput, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+	frameGraph.compile();
+
+	depthAttachmentView = frameGraph.view(depth);
+	colorAttachmentView = multisampled ? frameGraph.view(color) : VK_NULL_HANDLE;
+	sceneTarget = upscale ? frameGraph.image(target) : VK_NULL_HANDLE;
+	sceneTargetView = upscale ? frameGraph.view(target) : VK_NULL_HANDLE;
 }
 
-void RenderPipeline::makeFrameBuffer(Image depthImage)
+void RenderPipeline::makeFrameBuffer()
 {
+	bool multisampled = msaaSamples != VK_SAMPLE_COUNT_1_BIT;
+	makeFrameGraph();
+	updateRenderExtent();
+	/* old framebuffers retire themselves */
+	swapchainFramebuffers.clear();
+	/* nothing to rebuild, the views are bound when rendering begins */
+	if (dynamicRendering)
+		return;
 	swapchainFramebuffers.resize(Swapchain::swapchainImages.size());
 
 	for (int i = 0; i < Swapchain::swapchainImages.size(); i++)
 	{
-		std::array<VkImageView, 2> attachments = {
-			Swapchain::swapchainImagesViews[i],
-			depthImage.imageView};
+		/* attachment order matches makeRenderPass, the output is the resolve target when multisampled */
+		VkImageView output = upscale ? sceneTargetView : Swapchain::swapchainImagesViews[i].get();
+		std::array<VkImageView, 3> attachments = {
+			multisampled ? colorAttachmentView : output,
+			depthAttachmentView,
+			output};
 
 		VkFramebufferCreateInfo framebufferCreateInfo{};
 		framebufferCreateInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
 		framebufferCreateInfo.renderPass = renderPass;
-		framebufferCreateInfo.attachmentCount = attachments.size();
+		framebufferCreateInfo.attachmentCount = multisampled ? 3 : 2;
 		framebufferCreateInfo.pAttachments = attachments.data();
 		framebufferCreateInfo.height = Swapchain::swapchainExtent.height;
 		framebufferCreateInfo.width = Swapchain::swapchainExtent.width;
 		framebufferCreateInfo.layers = 1;
 
-		if (vkCreateFramebuffer(VulkanInstance::device, &framebufferCreateInfo, nullptr, &swapchainFramebuffers[i]) != VK_SUCCESS)
+		VkFramebuffer framebuffer;
+		if (vkCreateFramebuffer(VulkanInstance::device, &framebufferCreateInfo, nullptr, &framebuffer) != VK_SUCCESS)
 			throw std::runtime_error("Failed to create framebuffers");
+		swapchainFramebuffers[i] = FramebufferHandle(framebuffer);
 	}
 }
 
@@ -9,47 +9,156 @@
 #endif
 
 #include <vector>
+#include <string>
+#include <atomic>
+#include "DrawList.hpp"
+#include "commandRecorder.hpp"
+#include "bindless.hpp"
+#include "vkHandle.hpp"
+#include "gpuTimer.hpp"
+#include "renderGraph.hpp"
+
+/* reasons a pre-recorded command buffer has to be recorded again */
+enum DirtyFlags : uint32_t {
+    DIRTY_NONE = 0,
+    DIRTY_SWAPCHAIN = 1 << 0,
+    DIRTY_PIPELINE = 1 << 1,
+    DIRTY_DRAWLIST = 1 << 2,
+    DIRTY_RESOLUTION = 1 << 3,
+    DIRTY_DESCRIPTORS = 1 << 4,
+};
+
+/* bind calls in the draws of the latest recording, which reused buffers keep executing; skipped ones were redundant by sort key */
+struct BindCounters
+{
+    std::atomic<uint32_t> issued{0};
+    std::atomic<uint32_t> skipped{0};
+
+    void reset()
+    {
+        issued = 0;
+        skipped = 0;
+    }
+};
 
 class RenderObject;
 class Image;
-class Model;
 class Buffer;
+class VirtualTexture;
 
 class RenderPipeline {
 private:
+    /* the live set, plus those replaced over the frames in flight and the current one */
+    static constexpr uint32_t DESCRIPTOR_SETS = MAX_FRAMES_IN_FLIGHT + 2;
+
     VkShaderModule makeShaderModule(const std::vector<char>& shader);
+    void bindDrawState(VkCommandBuffer buffer);
+    void recordDraws(VkCommandBuffer buffer, uint32_t currentFrame, const Buffer &vertexBuffer, const Buffer &indexBuffer, const DrawList &draws, size_t first, size_t last);
+    void beginRendering(VkCommandBuffer buffer, uint32_t image, bool secondaries);
+    void endRendering(VkCommandBuffer buffer);
+    void blitToSwapchain(VkCommandBuffer buffer, uint32_t image);
+    void blit(VkCommandBuffer buffer, VkImage destination);
+    void makeFrameGraph();
+    void updateRenderExtent();
 public:
-    VkRenderPass renderPass;
+    VkRenderPass renderPass = VK_NULL_HANDLE;
     VkDescriptorSetLayout descriptorSetLayout;
-    VkPipelineLayout pipelineLayout;
+    PipelineLayoutHandle pipelineLayout;
 
     inline static VkQueue graphicsQueue;
     inline static VkQueue presentQueue;
 
-    inline static VkPipeline graphicsPipeline;
-    std::vector<VkFramebuffer> swapchainFramebuffers;
+    inline static PipelineHandle graphicsPipeline;
+    /* lets a rebuilt pipeline reuse the compiled state of the ones before it */
+    VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+    std::vector<FramebufferHandle> swapchainFramebuffers;
 
     inline static VkCommandPool commandPool;
     std::vector<VkCommandBuffer> commandBuffers;
 
+    /* reusable command buffers, indexed [frame][swapchain image] */
+    std::vector<std::vector<VkCommandBuffer>> staticCommandBuffers;
+    std::vector<std::vector<bool>> staticCommandBuffersValid;
+    uint32_t staticRecordCount = 0;
+    BindCounters binds;
+
+    /* multithreaded recording into secondary command buffers, disabled with 0 threads */
+    CommandRecorder recorder;
+
+    /* descriptor indexing path, textures are selected per draw from one array */
+    bool bindless = false;
+    BindlessTextures bindlessTextures;
+
+    /* virtual texturing path, set 1 samples through the page table, not owned */
+    VirtualTexture *virtualTexture = nullptr;
+
+    /* render straight into the attachment views, pipelines are built against attachment formats only */
+    bool dynamicRendering = false;
+    VkFormat depthFormat = VK_FORMAT_UNDEFINED;
+    /* attachments placed by the frame graph, refreshed by makeFrameBuffer */
+    VkImageView depthAttachmentView = VK_NULL_HANDLE;
+    VkImageView colorAttachmentView = VK_NULL_HANDLE;
+    inline static PFN_vkCmdBeginRendering cmdBeginRendering = nullptr;
+    inline static PFN_vkCmdEndRendering cmdEndRendering = nullptr;
+
+    /* samples of the color and depth attachments, above 1 the color is resolved into the swapchain image */
+    VkSampleCountFlagBits msaaSamples = VK_SAMPLE_COUNT_1_BIT;
+
+    /*
+     * Dynamic resolution: the scene is rendered into the top left renderExtent of a
+     * swapchain sized offscreen target and blitted with a linear filter to the swapchain.
+     */
+    bool upscale = false;
+    float renderScale = 1.0f;
+    VkExtent2D renderExtent{};
+    VkImage sceneTarget = VK_NULL_HANDLE;
+    VkImageView sceneTargetView = VK_NULL_HANDLE;
+
+    /*
+     * Scene and upscale passes with the attachments as transient resources. The graph places
+     * their memory for both paths, with dynamic rendering it also records the transitions.
+     */
+    RenderGraph frameGraph;
+    uint32_t frameOutput = 0;
+    uint32_t scenePass = 0;
+    GpuTimer timer;
+
     VkDescriptorPool descriptorPool;
-    std::vector<VkDescriptorSet> descriptorSets;
+    VkDescriptorSet descriptorSet;
+    /* dynamic offset of the per frame uniforms inside the uniform ring */
+    uint32_t uniformOffsets[MAX_FRAMES_IN_FLIGHT] = {};
+    /* dynamic offset of the per frame world matrices inside the instance buffer */
+    uint32_t instanceOffsets[MAX_FRAMES_IN_FLIGHT] = {};
 
     static VkCommandBuffer beginSingleTimeCommands();
     static void endSingleTimeCommands(VkCommandBuffer buffer);
-    void recordCommandBuffer(VkCommandBuffer buffer, uint32_t image, uint32_t currentFrame , Buffer vertexBuffer, Buffer indexBuffer, Model model);
+    void recordCommandBuffer(VkCommandBuffer buffer, uint32_t image, uint32_t currentFrame, const Buffer &vertexBuffer, const Buffer &indexBuffer, const DrawList &draws, bool reuseSecondaries = false);
+    VkCommandBuffer getStaticCommandBuffer(uint32_t image, uint32_t currentFrame, const Buffer &vertexBuffer, const Buffer &indexBuffer, const DrawList &draws);
+    void invalidate(uint32_t reasons);
+    void setRecordThreads(uint32_t threads);
+    void setRenderScale(float scale);
+    static bool canUpscale();
 
     void makeCommandPool();
     void makeCommandBuffer();
 
-    void makeFrameBuffer(Image depthImage);
+    void makeFrameBuffer();
 
     void makeDescriptorSetLayout();
-    void makeDescriptorSets(std::vector<Buffer> uniformBuffers, Image textureImage);
+    void makeDescriptorSets(const Buffer &uniformBuffer, VkDeviceSize uniformRange, const Image &textureImage, const Buffer &instanceBuffer, VkDeviceSize instanceRange);
+    /* moves to a new set sampling imageView, the old one is freed once no submitted frame uses it */
+    void replaceTexture(VkImageView imageView, VkSampler sampler);
     void makeDescriptorPool();
 
-    void makeRenderPass(Image depthImage);
+    void makeRenderPass();
+    static VkSampleCountFlagBits pickSampleCount(uint32_t requested);
+    /* SPIR-V files the graphics pipeline is built from */
+    std::vector<std::string> shaderFiles() const;
+    static std::vector<char> readShader(const std::string &filename);
+    /* keeps the layout once made, a failed rebuild leaves the old pipeline in place */
     void makePipeline();
+    /* from SPIR-V already in memory, a hot reload reads it off the render thread */
+    void makePipeline(const std::vector<char> &vertexShader, const std::vector<char> &fragmentShader);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,116 @@
+#include "streamReader.hpp"
+#include <fcntl.h>
+#include <stdexcept>
+#include <unistd.h>
+#include "Vulkan.hpp"
+#include "deletionQueue.hpp"
+#include "gpuMemory.hpp"
+#include "Logger.hpp"
+#include "FileRead.hpp"
+
+void StreamReader::init(const std::string &file, const char *name)
+{
+    path = file;
+    what = name;
+    fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("Failed to open " + path);
+    GpuMemory::onPressure([this](uint32_t, const GpuMemory::Heap &heap) {
+        if (heap.deviceLocal)
+            pressured = true;
+    });
+}
+
+void StreamReader::destroy()
+{
+    if (fd < 0)
+        return;
+    Jobs::wait(reads);
+    loads.clear();
+    freeStaging.clear();
+    staging.reset();
+    close(fd);
+    fd = -1;
+}
+
+void StreamReader::makeStaging(VkDeviceSize bytes, uint32_t entries, VkDeviceSize extraBytes)
+{
+    entryBytes = bytes;
+    staging.init(entryBytes * entries + extraBytes, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    vkMapMemory(VulkanInstance::device, staging.bufferMemory, 0, staging.size, 0, &staging.data);
+    freeStaging.clear();
+    for (int i = static_cast<int>(entries) - 1; i >= 0; i--)
+        freeStaging.push_back(i);
+}
+
+void StreamReader::start(uint32_t id, uint64_t offset, size_t bytes, void *destination)
+{
+    auto load = std::make_unique<Load>();
+    load->id = id;
+    load->offset = offset;
+    load->bytes = bytes;
+    load->staging = -1;
+    if (!destination)
+    {
+        load->staging = freeStaging.back();
+        freeStaging.pop_back();
+        destination = static_cast<char *>(staging.data) + entryBytes * load->staging;
+    }
+    Load *raw = load.get();
+    loads.push_back(std::move(load));
+    Jobs::spawn([this, raw, destination] { read(*raw, destination); }, &reads);
+}
+
+/* worker thread */
+void StreamReader::read(Load &load, void *destination)
+{
+    try
+    {
+        readAll(fd, destination, load.bytes, load.offset, what);
+    }
+    catch (const std::exception &e)
+    {
+        Log(Logger::warn) << e.what() << " " << path;
+        load.failed = true;
+    }
+    load.done.store(true, std::memory_order_release);
+}
+
+void StreamReader::finish(const std::function<void(const Load &)> &fn)
+{
+    /* decided once per load, a read finishing halfway through must not be dropped unhandled */
+    size_t kept = 0;
+    for (auto &load : loads)
+    {
+        if (!load->done.load(std::memory_order_acquire))
+        {
+            loads[kept++] = std::move(load);
+            continue;
+        }
+        fn(*load);
+        int entry = load->staging;
+        if (entry < 0)
+            continue;
+        if (load->failed)
+            freeStaging.push_back(entry);
+        else
+            DeletionQueue::retire([this, entry]() { freeStaging.push_back(entry); });
+    }
+    loads.resize(kept);
+}
+
+void StreamReader::cancel()
+{
+    Jobs::wait(reads);
+    for (auto &load : loads)
+        if (load->staging >= 0)
+            freeStaging.push_back(load->staging);
+    loads.clear();
+}
+
+bool StreamReader::pressure()
+{
+    bool raised = pressured;
+    pressured = false;
+    return raised;
+}
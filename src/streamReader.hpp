@@ -0,0 +1,72 @@
+#ifndef STREAMREADER_HPP
+#define STREAMREADER_HPP
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "buffer.hpp"
+#include "JobSystem.hpp"
+
+/*
+ * Reads ranges of one file on the job system, either straight into mapped device
+ * memory or into a ring of equally sized staging entries the owner copies from ahead
+ * of the frame. Raises a flag when a device local heap comes under pressure so the
+ * owner can shrink its pool at the next update.
+ */
+class StreamReader {
+public:
+    struct Load
+    {
+        /* chunk or page of the owner */
+        uint32_t id;
+        uint64_t offset;
+        size_t bytes;
+        /* staging ring entry, -1 when reading straight into device memory */
+        int staging;
+        std::atomic<bool> done{false};
+        bool failed = false;
+    };
+
+    int fd = -1;
+    std::string path;
+    /* entries of entryBytes, then whatever extra bytes the owner asked for */
+    Buffer staging;
+    VkDeviceSize entryBytes = 0;
+
+    /* what names the file in read errors */
+    void init(const std::string &path, const char *what);
+    /* waits for outstanding reads, the device has to be idle */
+    void destroy();
+    bool active() const { return fd >= 0; };
+
+    void makeStaging(VkDeviceSize entryBytes, uint32_t entries, VkDeviceSize extraBytes = 0);
+    bool stagingFree() const { return !freeStaging.empty(); };
+    size_t pending() const { return loads.size(); };
+    /* starts a read into destination, or into a staging entry when it is null */
+    void start(uint32_t id, uint64_t offset, size_t bytes, void *destination = nullptr);
+    /*
+     * Hands every finished read to fn and forgets it. Staging entries of failed reads are
+     * free again at once, the others after the copies submitted this frame have executed.
+     */
+    void finish(const std::function<void(const Load &)> &fn);
+    /* waits for and drops every read, their data is stale */
+    void cancel();
+    /* true once per memory pressure event */
+    bool pressure();
+
+private:
+    const char *what = "";
+    std::vector<int> freeStaging;
+    std::vector<std::unique_ptr<Load>> loads;
+    JobCounter reads;
+    bool pressured = false;
+
+    void read(Load &load, void *destination);
+};
+
+#endif
@@ -2,13 +2,14 @@
 #include "QueueFamilyIndicies.hpp"
 #include "Vulkan.hpp"
 #include "window.hpp"
+#include "deletionQueue.hpp"
 #include <iostream>
 
 VkSurfaceFormatKHR pickSurfaceFormat(const std::vector<VkSurfaceFormatKHR> formats);
 VkPresentModeKHR pickSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes);
 VkExtent2D pickSwapChainExtent(const VkSurfaceCapabilitiesKHR& capabilities);
 
-void Swapchain::makeSwapchain()
+void Swapchain::makeSwapchain(VkSwapchainKHR oldSwapchain)
 {
     SwapChainSupportDetails details = findSwapChainSupportDetails();
     uint32_t imageCount = details.capabilities.minImageCount + 1;
@@ -26,6 +27,12 @@ void Swapchain::makeSwapchain()
     swapchainCreateInfo.imageExtent = swapchainExtent;
     swapchainCreateInfo.imageArrayLayers = 1;
     swapchainCreateInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    transferTarget = details.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    if (transferTarget)
+        swapchainCreateInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    transferSource = details.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    if (transferSource)
+        swapchainCreateInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
     swapchainCreateInfo.presentMode = pickSwapPresentMode(details.modes);
     QueueFamilyIndicies indicies = QueueFamilyIndicies::findQueueFamilyIndicies(VulkanInstance::physicalDevice, VulkanInstance::surface);
     uint32_t queueFamilyIndices[] = {indicies.graphicsFamily.value(), indicies.presentFamily.value()};
@@ -40,7 +47,7 @@ void Swapchain::makeSwapchain()
     swapchainCreateInfo.preTransform = details.capabilities.currentTransform;
     swapchainCreateInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
     swapchainCreateInfo.clipped = VK_TRUE;
-    swapchainCreateInfo.oldSwapchain = nullptr;
+    swapchainCreateInfo.oldSwapchain = oldSwapchain;
     if (vkCreateSwapchainKHR(VulkanInstance::device, &swapchainCreateInfo, nullptr, &swapchain) != VK_SUCCESS)
         throw std::runtime_error("Failed to create swapchain");
 
@@ -49,22 +56,20 @@ void Swapchain::makeSwapchain()
     swapchainImages.resize(swapchainImageCount);
     vkGetSwapchainImagesKHR(VulkanInstance::device, swapchain, &swapchainImageCount, swapchainImages.data());
     /* Make swapchain image views */
-    swapchainImagesViews.resize(swapchainImages.size());
+    swapchainImagesViews.clear();
     for (int i = 0; i < swapchainImages.size(); i++)
-        swapchainImagesViews[i] = makeImageView(swapchainImages[i], swapchainImageFormat, VK_IMAGE_ASPECT_COLOR_BIT);
+        swapchainImagesViews.emplace_back(makeImageView(swapchainImages[i], swapchainImageFormat, VK_IMAGE_ASPECT_COLOR_BIT));
 }
 
+/* the caller makes sure the surface has a non zero extent */
 void Swapchain::remakeSwapchain()
 {
-    int width = 0, height = 0;
-    while (width == 0 || height == 0)
-    {
-        glfwGetFramebufferSize(Window::win, &width, &height);
-        glfwWaitEvents();
-    }
-    vkDeviceWaitIdle(VulkanInstance::device);
-    cleanupSwapChain();
-    makeSwapchain();
+    /* frames in flight keep using the old images, they are destroyed once those frames are done */
+    VkSwapchainKHR oldSwapchain = swapchain;
+    makeSwapchain(oldSwapchain);
+    DeletionQueue::retire([oldSwapchain]() {
+        vkDestroySwapchainKHR(VulkanInstance::device, oldSwapchain, nullptr);
+    }, 1);
 }
 
 // void Swapchain::makeFrameBuffer()
@@ -98,8 +103,7 @@ void Swapchain::cleanupSwapChain()
     // vkDestroyImageView(device, depthImageView, nullptr);
     // vkDestroyImage(device, depthImage, nullptr);
     // vkFreeMemory(device, depthImageMemory, nullptr);
-    for (auto& imview : swapchainImagesViews)
-        vkDestroyImageView(VulkanInstance::device, imview, nullptr);
+    swapchainImagesViews.clear();
     // for (auto& framebuf : swapchainFramebuffers)
     //     vkDestroyFramebuffer(device, framebuf, nullptr);
     vkDestroySwapchainKHR(VulkanInstance::device, swapchain, nullptr);
@@ -145,6 +149,13 @@ VkExtent2D pickSwapChainExtent(const VkSurfaceCapabilitiesKHR& capabilities)
     return capabilities.currentExtent;
 }
 
+VkExtent2D Swapchain::surfaceExtent()
+{
+    VkSurfaceCapabilitiesKHR capabilities;
+    vkGetPhysicalDeviceSurfaceCapabilitiesKHR(VulkanInstance::physicalDevice, VulkanInstance::surface, &capabilities);
+    return capabilities.currentExtent;
+}
+
 VkImageView makeImageView(VkImage image, VkFormat format, VkImageAspectFlags flags)
 {
     VkImageViewCreateInfo viewInfo{};
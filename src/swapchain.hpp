@@ -6,6 +6,7 @@
 #include <vector>
 #include <stdexcept>
 #include <optional>
+#include "vkHandle.hpp"
 
 struct SwapChainSupportDetails
 {
@@ -24,12 +25,18 @@ class Swapchain {
         inline static VkExtent2D swapchainExtent;
         // needs refactor into Image class
         inline static std::vector<VkImage> swapchainImages;
-        inline static std::vector<VkImageView> swapchainImagesViews;
+        inline static std::vector<ImageViewHandle> swapchainImagesViews;
         inline static VkFormat swapchainImageFormat;
+        /* images can be blitted into, required to upscale a smaller render */
+        inline static bool transferTarget = false;
+        /* images can be copied from, required for frame capture */
+        inline static bool transferSource = false;
         uint32_t swapchainImageCount = 0;
-        void makeSwapchain();
+        void makeSwapchain(VkSwapchainKHR oldSwapchain = VK_NULL_HANDLE);
         void remakeSwapchain();
         void cleanupSwapChain();
+        /* zero while the window is minimized */
+        VkExtent2D surfaceExtent();
 };
 
 #endif
\ No newline at end of file
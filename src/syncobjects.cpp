@@ -1,11 +1,12 @@
 #include "syncobjects.hpp"
 #include "Vulkan.hpp"
+#include "renderPipeline.hpp"
+#include "deletionQueue.hpp"
 
 void Syncobjects::makeSyncObjects()
 {
     imageDoneSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
     renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-    inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
     VkSemaphoreCreateInfo semaphoreCreateInfo{};
     semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
     for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
@@ -14,10 +15,140 @@ void Syncobjects::makeSyncObjects()
             throw std::runtime_error("Failed to create semaphore");
         if (vkCreateSemaphore(VulkanInstance::device, &semaphoreCreateInfo, nullptr, &renderFinishedSemaphores[i]) != VK_SUCCESS)
             throw std::runtime_error("Failed to create semaphore");
+    }
+
+    useTimeline = VulkanInstance::features.timelineSemaphore;
+    if (useTimeline)
+    {
+        bool core = VulkanInstance::features.apiVersion >= VK_API_VERSION_1_2;
+        waitSemaphores = reinterpret_cast<PFN_vkWaitSemaphores>(vkGetDeviceProcAddr(VulkanInstance::device, core ? "vkWaitSemaphores" : "vkWaitSemaphoresKHR"));
+        getCounterValue = reinterpret_cast<PFN_vkGetSemaphoreCounterValue>(vkGetDeviceProcAddr(VulkanInstance::device, core ? "vkGetSemaphoreCounterValue" : "vkGetSemaphoreCounterValueKHR"));
+        if (!waitSemaphores || !getCounterValue)
+            throw std::runtime_error("Failed to load timeline semaphore entry points");
+
+        VkSemaphoreTypeCreateInfo typeCreateInfo{};
+        typeCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+        typeCreateInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+        typeCreateInfo.initialValue = DeletionQueue::nextSubmit - 1;
+        VkSemaphoreCreateInfo timelineCreateInfo{};
+        timelineCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        timelineCreateInfo.pNext = &typeCreateInfo;
+        if (vkCreateSemaphore(VulkanInstance::device, &timelineCreateInfo, nullptr, &timeline) != VK_SUCCESS)
+            throw std::runtime_error("Failed to create timeline semaphore");
+        return;
+    }
+
+    inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
+    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    {
         VkFenceCreateInfo fenceCreateInfo{};
         fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
         fenceCreateInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
         if (vkCreateFence(VulkanInstance::device, &fenceCreateInfo, nullptr, &inFlightFences[i]) != VK_SUCCESS)
             throw std::runtime_error("Failed to create fence");
     }
-}
\ No newline at end of file
+}
+
+void Syncobjects::destroy()
+{
+    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    {
+        vkDestroySemaphore(VulkanInstance::device, imageDoneSemaphores[i], nullptr);
+        vkDestroySemaphore(VulkanInstance::device, renderFinishedSemaphores[i], nullptr);
+    }
+    for (auto &fence : inFlightFences)
+        vkDestroyFence(VulkanInstance::device, fence, nullptr);
+    if (timeline != VK_NULL_HANDLE)
+        vkDestroySemaphore(VulkanInstance::device, timeline, nullptr);
+    imageDoneSemaphores.clear();
+    renderFinishedSemaphores.clear();
+    inFlightFences.clear();
+    timeline = VK_NULL_HANDLE;
+}
+
+uint64_t Syncobjects::submit(VkQueue queue, VkCommandBuffer buffer, VkSemaphore wait, VkPipelineStageFlags waitStage, VkSemaphore signal, VkFence fence)
+{
+    uint64_t value = DeletionQueue::nextSubmit;
+
+    /* binary semaphores ignore their entry in the value arrays */
+    std::vector<VkSemaphore> signalSemaphores;
+    std::vector<uint64_t> signalValues;
+    if (signal != VK_NULL_HANDLE)
+    {
+        signalSemaphores.push_back(signal);
+        signalValues.push_back(0);
+    }
+    if (useTimeline)
+    {
+        signalSemaphores.push_back(timeline);
+        signalValues.push_back(value);
+    }
+    uint64_t waitValue = 0;
+
+    VkTimelineSemaphoreSubmitInfo timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.waitSemaphoreValueCount = wait != VK_NULL_HANDLE ? 1 : 0;
+    timelineInfo.pWaitSemaphoreValues = &waitValue;
+    timelineInfo.signalSemaphoreValueCount = static_cast<uint32_t>(signalValues.size());
+    timelineInfo.pSignalSemaphoreValues = signalValues.data();
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.pNext = useTimeline ? &timelineInfo : nullptr;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &buffer;
+    submitInfo.waitSemaphoreCount = wait != VK_NULL_HANDLE ? 1 : 0;
+    submitInfo.pWaitSemaphores = &wait;
+    submitInfo.pWaitDstStageMask = &waitStage;
+    submitInfo.signalSemaphoreCount = static_cast<uint32_t>(signalSemaphores.size());
+    submitInfo.pSignalSemaphores = signalSemaphores.data();
+
+    if (fence != VK_NULL_HANDLE)
+        vkResetFences(VulkanInstance::device, 1, &fence);
+    if (vkQueueSubmit(queue, 1, &submitInfo, fence) != VK_SUCCESS)
+        throw std::runtime_error("Failed to submit to queue");
+    DeletionQueue::nextSubmit++;
+    return value;
+}
+
+void Syncobjects::wait(uint64_t value)
+{
+    if (value <= completed())
+        return;
+    if (useTimeline)
+    {
+        VkSemaphoreWaitInfo waitInfo{};
+        waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+        waitInfo.semaphoreCount = 1;
+        waitInfo.pSemaphores = &timeline;
+        waitInfo.pValues = &value;
+        if (waitSemaphores(VulkanInstance::device, &waitInfo, UINT64_MAX) != VK_SUCCESS)
+            throw std::runtime_error("Failed to wait on timeline semaphore");
+        return;
+    }
+    /* without a timeline only an idle queue proves an arbitrary value was reached */
+    vkQueueWaitIdle(RenderPipeline::graphicsQueue);
+    completedValue = DeletionQueue::nextSubmit - 1;
+}
+
+void Syncobjects::waitFrame(uint32_t frame)
+{
+    if (useTimeline)
+    {
+        wait(frameValues[frame]);
+        return;
+    }
+    vkWaitForFences(VulkanInstance::device, 1, &inFlightFences[frame], VK_TRUE, UINT64_MAX);
+    /* the fence covers every earlier submit on the queue as well */
+    if (frameValues[frame] > completedValue)
+        completedValue = frameValues[frame];
+}
+
+uint64_t Syncobjects::completed()
+{
+    if (!useTimeline)
+        return completedValue;
+    uint64_t value = 0;
+    getCounterValue(VulkanInstance::device, timeline, &value);
+    return value;
+}
@@ -5,16 +5,41 @@
 #include <GLFW/glfw3.h>
 #include <vector>
 #include <stdexcept>
+#include <cstdint>
 
 #define MAX_FRAMES_IN_FLIGHT 2
 
+/*
+ * Frame synchronization on one timeline semaphore: every submit signals the next
+ * value and the CPU waits for values instead of per frame fences.
+ * Binary semaphores are only kept for acquire and present, fences only as the
+ * fallback for devices without timeline semaphores.
+ */
 class Syncobjects {
 private:
+    inline static PFN_vkWaitSemaphores waitSemaphores = nullptr;
+    inline static PFN_vkGetSemaphoreCounterValue getCounterValue = nullptr;
+    /* highest value known to be reached on the fence fallback */
+    inline static uint64_t completedValue = 0;
 public:
     inline static std::vector<VkSemaphore> imageDoneSemaphores;
     inline static std::vector<VkSemaphore> renderFinishedSemaphores;
     inline static std::vector<VkFence> inFlightFences;
+    inline static bool useTimeline = false;
+    inline static VkSemaphore timeline = VK_NULL_HANDLE;
+    /* value signalled by the last submit of each frame slot */
+    inline static uint64_t frameValues[MAX_FRAMES_IN_FLIGHT] = {};
+
     void makeSyncObjects();
+    void destroy();
+
+    /* submits with an optional binary wait and signal, returns the timeline value it signals */
+    static uint64_t submit(VkQueue queue, VkCommandBuffer buffer, VkSemaphore wait, VkPipelineStageFlags waitStage, VkSemaphore signal, VkFence fence);
+    /* blocks until the GPU has reached value */
+    static void wait(uint64_t value);
+    /* blocks until the last submit of the frame slot has finished */
+    static void waitFrame(uint32_t frame);
+    static uint64_t completed();
 };
 
-#endif
\ No newline at end of file
+#endif
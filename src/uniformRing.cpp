@@ -0,0 +1,41 @@
+#include "uniformRing.hpp"
+#include <cstring>
+#include <stdexcept>
+#include "Vulkan.hpp"
+
+void UniformRing::init(VkDeviceSize bytesPerFrame)
+{
+    VkPhysicalDeviceProperties props{};
+    vkGetPhysicalDeviceProperties(VulkanInstance::physicalDevice, &props);
+    alignment = props.limits.minUniformBufferOffsetAlignment;
+    if (alignment == 0)
+        alignment = 1;
+
+    regionSize = align(bytesPerFrame);
+    buffer.init(regionSize * MAX_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    vkMapMemory(VulkanInstance::device, buffer.bufferMemory, 0, buffer.size, 0, &buffer.data);
+    mapped = static_cast<char *>(buffer.data);
+}
+
+void UniformRing::beginFrame(uint32_t frame)
+{
+    regionStart = regionSize * frame;
+    cursor = 0;
+}
+
+uint32_t UniformRing::allocate(VkDeviceSize size)
+{
+    VkDeviceSize aligned = align(size);
+    if (cursor + aligned > regionSize)
+        throw std::runtime_error("Uniform ring exhausted for this frame");
+    VkDeviceSize offset = regionStart + cursor;
+    cursor += aligned;
+    return static_cast<uint32_t>(offset);
+}
+
+uint32_t UniformRing::write(const void *data, VkDeviceSize size)
+{
+    uint32_t offset = allocate(size);
+    memcpy(mapped + offset, data, size);
+    return offset;
+}
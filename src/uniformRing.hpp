@@ -0,0 +1,37 @@
+#ifndef UNIFORMRING_HPP
+#define UNIFORMRING_HPP
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#ifndef MAX_FRAMES_IN_FLIGHT
+# define MAX_FRAMES_IN_FLIGHT 2
+#endif
+
+#include "buffer.hpp"
+
+/*
+ * Persistently mapped uniform buffer split into one region per frame in flight.
+ * Allocations are bump allocated inside the region of the current frame and bound
+ * through VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC offsets.
+ */
+class UniformRing {
+public:
+    Buffer buffer;
+    VkDeviceSize regionSize = 0;
+
+    void init(VkDeviceSize bytesPerFrame);
+    void beginFrame(uint32_t frame);
+    uint32_t allocate(VkDeviceSize size);
+    uint32_t write(const void *data, VkDeviceSize size);
+
+private:
+    VkDeviceSize alignment = 0;
+    VkDeviceSize regionStart = 0;
+    VkDeviceSize cursor = 0;
+    char *mapped = nullptr;
+
+    VkDeviceSize align(VkDeviceSize size) const { return (size + alignment - 1) & ~(alignment - 1); };
+};
+
+#endif
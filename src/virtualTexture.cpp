@@ -0,0 +1,617 @@
+#include "virtualTexture.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <stb_image.h>
+#include "Vulkan.hpp"
+#include "renderPipeline.hpp"
+#include "syncobjects.hpp"
+#include "deletionQueue.hpp"
+#include "Logger.hpp"
+#include "FileRead.hpp"
+
+static_assert(sizeof(VirtualTextureParams::levels) / sizeof(VirtualTextureParams::levels[0]) == VirtualTexture::MAX_LEVELS);
+
+/* the cache is sampled as sRGB, so are the bytes of every level */
+static uint8_t linearToSrgb(float linear)
+{
+    float encoded = linear <= 0.0031308f ? linear * 12.92f : 1.055f * std::pow(linear, 1.0f / 2.4f) - 0.055f;
+    return static_cast<uint8_t>(std::clamp(encoded * 255.0f + 0.5f, 0.0f, 255.0f));
+}
+
+void VirtualTexture::convert(const std::string &image, const std::string &path, uint32_t tileSize)
+{
+    int width, height, channels;
+    stbi_uc *pixels = stbi_load(image.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+    if (!pixels)
+        throw std::runtime_error("Failed to load " + image);
+    const uint32_t *texels = reinterpret_cast<const uint32_t *>(pixels);
+    std::vector<uint32_t> level(texels, texels + static_cast<size_t>(width) * height);
+    stbi_image_free(pixels);
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file.is_open())
+        throw std::runtime_error("Failed to open " + path);
+    VirtualTextureHeader header;
+    header.width = width;
+    header.height = height;
+    header.tileSize = tileSize;
+    header.border = BORDER;
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+    std::array<float, 256> toLinear;
+    for (int i = 0; i < 256; i++)
+    {
+        float encoded = i / 255.0f;
+        toLinear[i] = encoded <= 0.04045f ? encoded / 12.92f : std::pow((encoded + 0.055f) / 1.055f, 2.4f);
+    }
+
+    uint32_t levelWidth = width;
+    uint32_t levelHeight = height;
+    uint32_t side = tileSize + 2 * BORDER;
+    std::vector<uint32_t> tile(side * side);
+    for (;;)
+    {
+        uint32_t pagesX = (levelWidth + tileSize - 1) / tileSize;
+        uint32_t pagesY = (levelHeight + tileSize - 1) / tileSize;
+        for (uint32_t py = 0; py < pagesY; py++)
+        {
+            for (uint32_t px = 0; px < pagesX; px++)
+            {
+                /* edges repeat the last texel, the border holds the neighbouring tiles' texels */
+                for (uint32_t y = 0; y < side; y++)
+                {
+                    int64_t sy = std::clamp<int64_t>(int64_t(py) * tileSize + y - BORDER, 0, levelHeight - 1);
+                    for (uint32_t x = 0; x < side; x++)
+                    {
+                        int64_t sx = std::clamp<int64_t>(int64_t(px) * tileSize + x - BORDER, 0, levelWidth - 1);
+                        tile[y * side + x] = level[sy * levelWidth + sx];
+                    }
+                }
+                file.write(reinterpret_cast<const char *>(tile.data()), sizeof(uint32_t) * tile.size());
+                header.tileCount++;
+            }
+        }
+        header.levelCount++;
+        if (pagesX == 1 && pagesY == 1)
+            break;
+        if (header.levelCount == MAX_LEVELS)
+            throw std::runtime_error(image + " needs more than 16 levels, use larger tiles");
+
+        /* 2x2 box filter in linear light, odd sizes repeat the last row and column, alpha is linear already */
+        uint32_t nextWidth = (levelWidth + 1) / 2;
+        uint32_t nextHeight = (levelHeight + 1) / 2;
+        std::vector<uint32_t> next(static_cast<size_t>(nextWidth) * nextHeight);
+        for (uint32_t y = 0; y < nextHeight; y++)
+        {
+            uint32_t y0 = 2 * y;
+            uint32_t y1 = std::min(2 * y + 1, levelHeight - 1);
+            for (uint32_t x = 0; x < nextWidth; x++)
+            {
+                uint32_t x0 = 2 * x;
+                uint32_t x1 = std::min(2 * x + 1, levelWidth - 1);
+                uint32_t quad[4] = {level[y0 * levelWidth + x0], level[y0 * levelWidth + x1], level[y1 * levelWidth + x0], level[y1 * levelWidth + x1]};
+                uint32_t texel = 0;
+                for (int shift = 0; shift < 24; shift += 8)
+                {
+                    float sum = 0.0f;
+                    for (uint32_t q : quad)
+                        sum += toLinear[(q >> shift) & 0xFF];
+                    texel |= static_cast<uint32_t>(linearToSrgb(sum * 0.25f)) << shift;
+                }
+                uint32_t alpha = 2;
+                for (uint32_t q : quad)
+                    alpha += q >> 24;
+                texel |= (alpha / 4) << 24;
+                next[static_cast<size_t>(y) * nextWidth + x] = texel;
+            }
+        }
+        level.swap(next);
+        levelWidth = nextWidth;
+        levelHeight = nextHeight;
+    }
+
+    file.seekp(0);
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    if (!file)
+        throw std::runtime_error("Failed to write " + path);
+    Log(Logger::info) << "Wrote " << header.tileCount << " tiles in " << header.levelCount << " levels to " << path;
+}
+
+static SamplerHandle makeSampler(VkFilter filter)
+{
+    VkSamplerCreateInfo samplerInfo{};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = filter;
+    samplerInfo.minFilter = filter;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.anisotropyEnable = VK_FALSE;
+    samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
+    samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    VkSampler rawSampler;
+    if (vkCreateSampler(VulkanInstance::device, &samplerInfo, nullptr, &rawSampler) != VK_SUCCESS)
+        throw std::runtime_error("Failed to create virtual texture sampler");
+    return SamplerHandle(rawSampler);
+}
+
+static VkImageMemoryBarrier layoutBarrier(VkImage image, VkImageLayout from, VkImageLayout to, VkAccessFlags src, VkAccessFlags dst)
+{
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask = src;
+    barrier.dstAccessMask = dst;
+    barrier.oldLayout = from;
+    barrier.newLayout = to;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+    return barrier;
+}
+
+void VirtualTexture::init(const std::string &path, VkDeviceSize cacheBytes)
+{
+    stream.init(path, "virtual texture tile");
+    readAll(stream.fd, &header, sizeof(header), 0, "virtual texture header");
+    if (memcmp(header.magic, VirtualTextureHeader{}.magic, 4) != 0 || header.version != VirtualTextureHeader{}.version
+        || header.levelCount == 0 || header.levelCount > MAX_LEVELS)
+        throw std::runtime_error(path + " is not a virtual texture");
+
+    /* the level chain the converter wrote, pages of level l cover tileSize << l level 0 texels */
+    uint32_t levelWidth = header.width;
+    uint32_t levelHeight = header.height;
+    uint32_t first = 0;
+    uint32_t row = 0;
+    for (uint32_t l = 0; l < header.levelCount; l++)
+    {
+        uint32_t pagesX = (levelWidth + header.tileSize - 1) / header.tileSize;
+        uint32_t pagesY = (levelHeight + header.tileSize - 1) / header.tileSize;
+        params.levels[l][0] = first;
+        params.levels[l][1] = pagesX;
+        params.levels[l][2] = pagesY;
+        params.levels[l][3] = row;
+        pages.resize(first + pagesX * pagesY);
+        for (uint32_t i = first; i < pages.size(); i++)
+            pages[i].level = static_cast<uint8_t>(l);
+        first += pagesX * pagesY;
+        row += pagesY;
+        levelWidth = (levelWidth + 1) / 2;
+        levelHeight = (levelHeight + 1) / 2;
+    }
+    if (first != header.tileCount || params.levels[header.levelCount - 1][0] != first - 1)
+        throw std::runtime_error(path + " has an inconsistent tile count");
+    tableWidth = params.levels[0][1];
+    tableRows = row;
+    table.assign(static_cast<size_t>(tableWidth) * tableRows, 0);
+
+    VkPhysicalDeviceProperties props{};
+    vkGetPhysicalDeviceProperties(VulkanInstance::physicalDevice, &props);
+    if (tableWidth > props.limits.maxImageDimension2D || tableRows > props.limits.maxImageDimension2D)
+        throw std::runtime_error(path + " has too many pages for the page table, use larger tiles");
+    slotSize = header.tileSize + 2 * header.border;
+    tileBytes = static_cast<VkDeviceSize>(slotSize) * slotSize * 4;
+    /* page table entries hold cache coordinates in 8 bits */
+    cacheTiles = static_cast<uint32_t>(std::sqrt(static_cast<double>(cacheBytes / tileBytes)));
+    cacheTiles = std::min({cacheTiles, 255u, props.limits.maxImageDimension2D / slotSize});
+    if (cacheTiles < 2)
+        throw std::runtime_error("Virtual texture cache is smaller than two tiles");
+
+    params.size[0] = static_cast<float>(header.width);
+    params.size[1] = static_cast<float>(header.height);
+    params.tileSize = static_cast<float>(header.tileSize);
+    params.border = static_cast<float>(header.border);
+    params.levelCount = header.levelCount;
+
+    pageTable.makeImage(tableWidth, tableRows, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+    pageTable.makeImageView(VK_IMAGE_ASPECT_COLOR_BIT);
+    pageTable.sampler = makeSampler(VK_FILTER_NEAREST);
+
+    VkMemoryPropertyFlags coherent = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    /* MAX_LOADS tiles followed by one page table copy per frame in flight */
+    stream.makeStaging(tileBytes, MAX_LOADS, sizeof(uint32_t) * table.size() * MAX_FRAMES_IN_FLIGHT);
+
+    /* update tests the flag of every page each frame, mostly zeros, cached memory keeps that scan off the bus */
+    VkMemoryPropertyFlags cached = coherent | VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+    VkPhysicalDeviceMemoryProperties memProps;
+    vkGetPhysicalDeviceMemoryProperties(VulkanInstance::physicalDevice, &memProps);
+    VkMemoryPropertyFlags feedbackProps = coherent;
+    for (uint32_t i = 0; i < memProps.memoryTypeCount; i++)
+        if ((memProps.memoryTypes[i].propertyFlags & cached) == cached)
+            feedbackProps = cached;
+    VkDeviceSize alignment = std::max<VkDeviceSize>(props.limits.minStorageBufferOffsetAlignment, 1);
+    feedbackRegion = (sizeof(uint32_t) * pages.size() + alignment - 1) & ~(alignment - 1);
+    feedback.init(feedbackRegion * MAX_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, feedbackProps);
+    vkMapMemory(VulkanInstance::device, feedback.bufferMemory, 0, feedback.size, 0, &feedback.data);
+    memset(feedback.data, 0, feedback.size);
+
+    parameters.init(sizeof(params), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, coherent);
+    vkMapMemory(VulkanInstance::device, parameters.bufferMemory, 0, parameters.size, 0, &parameters.data);
+
+    makeCache();
+    makeDescriptors();
+    Log(Logger::info) << "Virtual texture " << header.width << "x" << header.height << " in " << header.levelCount << " levels of "
+                      << header.tileSize << " texel tiles, cache of " << cacheTiles * cacheTiles << " tiles (" << cacheTiles * slotSize << "x" << cacheTiles * slotSize << ")";
+}
+
+/* cache image of cacheTiles squared slots holding only the coarsest tile, with the page table to match */
+void VirtualTexture::makeCache()
+{
+    params.cacheSize[0] = params.cacheSize[1] = static_cast<float>(cacheTiles * slotSize);
+    memcpy(parameters.data, &params, sizeof(params));
+    cache.makeImage(cacheTiles * slotSize, cacheTiles * slotSize, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+    cache.makeImageView(VK_IMAGE_ASPECT_COLOR_BIT);
+    cache.sampler = makeSampler(VK_FILTER_LINEAR);
+
+    /* slot 0 holds the single tile of the coarsest level for good, everything falls back to it */
+    uint32_t slotCount = cacheTiles * cacheTiles;
+    slotPages.assign(slotCount, NONE);
+    linked.assign(slotCount, false);
+    lruPrev.assign(slotCount, NONE);
+    lruNext.assign(slotCount, NONE);
+    lruHead = lruTail = NONE;
+    freeSlots.clear();
+    for (uint32_t i = slotCount - 1; i > 0; i--)
+        freeSlots.push_back(i);
+    for (Page &page : pages)
+    {
+        page.state = ABSENT;
+        page.slot = NONE;
+    }
+    uint32_t top = static_cast<uint32_t>(pages.size()) - 1;
+    pages[top].state = RESIDENT;
+    pages[top].slot = 0;
+    slotPages[0] = top;
+    readAll(stream.fd, stream.staging.data, tileBytes, sizeof(header) + tileBytes * top, "virtual texture tile");
+    rebuildTable();
+    VkDeviceSize tableBytes = sizeof(uint32_t) * table.size();
+    memcpy(static_cast<char *>(stream.staging.data) + tileBytes * MAX_LOADS, table.data(), tableBytes);
+
+    /* every table entry is written, its old contents can be dropped */
+    VkCommandBuffer cmdBuffer = RenderPipeline::beginSingleTimeCommands();
+    std::array<VkImageMemoryBarrier, 2> toTransfer = {
+        layoutBarrier(cache.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0, VK_ACCESS_TRANSFER_WRITE_BIT),
+        layoutBarrier(pageTable.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0, VK_ACCESS_TRANSFER_WRITE_BIT)};
+    vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, toTransfer.size(), toTransfer.data());
+    VkBufferImageCopy tileCopy{};
+    tileCopy.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+    tileCopy.imageExtent = {slotSize, slotSize, 1};
+    vkCmdCopyBufferToImage(cmdBuffer, stream.staging.buffer, cache.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &tileCopy);
+    VkBufferImageCopy tableCopy{};
+    tableCopy.bufferOffset = tileBytes * MAX_LOADS;
+    tableCopy.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+    tableCopy.imageExtent = {tableWidth, tableRows, 1};
+    vkCmdCopyBufferToImage(cmdBuffer, stream.staging.buffer, pageTable.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &tableCopy);
+    std::array<VkImageMemoryBarrier, 2> toShader = {
+        layoutBarrier(cache.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT),
+        layoutBarrier(pageTable.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)};
+    vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, toShader.size(), toShader.data());
+    RenderPipeline::endSingleTimeCommands(cmdBuffer);
+}
+
+/*
+ * Halves the cache once a device local heap came under pressure. Rewriting the descriptor
+ * set is not allowed while frames in flight use it, this waits for the queue instead.
+ */
+bool VirtualTexture::shrink()
+{
+    uint32_t tiles = static_cast<uint32_t>(cacheTiles / std::sqrt(2.0));
+    if (tiles < 2)
+        return false;
+    stream.cancel();
+    vkQueueWaitIdle(RenderPipeline::graphicsQueue);
+    cacheTiles = tiles;
+    cache.retire();
+    makeCache();
+    writeDescriptors();
+    Log(Logger::warn) << "Memory pressure, virtual texture cache shrunk to " << cacheTiles * cacheTiles << " tiles";
+    return true;
+}
+
+/* page table, cache, feedback and parameters, in binding order */
+static const VkDescriptorType descriptorTypes[] = {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                                   VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER};
+
+void VirtualTexture::makeDescriptors()
+{
+    std::array<VkDescriptorSetLayoutBinding, 4> bindings{};
+    std::array<VkDescriptorPoolSize, 4> poolSizes{};
+    for (uint32_t i = 0; i < bindings.size(); i++)
+    {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = descriptorTypes[i];
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+        poolSizes[i].type = descriptorTypes[i];
+        poolSizes[i].descriptorCount = 1;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = bindings.size();
+    layoutInfo.pBindings = bindings.data();
+    if (vkCreateDescriptorSetLayout(VulkanInstance::device, &layoutInfo, nullptr, &layout) != VK_SUCCESS)
+        throw std::runtime_error("Failed to create virtual texture descriptor set layout");
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = poolSizes.size();
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = 1;
+    if (vkCreateDescriptorPool(VulkanInstance::device, &poolInfo, nullptr, &pool) != VK_SUCCESS)
+        throw std::runtime_error("Failed to create virtual texture descriptor pool");
+
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = pool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &layout;
+    if (vkAllocateDescriptorSets(VulkanInstance::device, &allocInfo, &set) != VK_SUCCESS)
+        throw std::runtime_error("Failed to allocate virtual texture descriptor set");
+    writeDescriptors();
+}
+
+void VirtualTexture::writeDescriptors()
+{
+
+    VkDescriptorImageInfo tableInfo{pageTable.sampler, pageTable.imageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+    VkDescriptorImageInfo cacheInfo{cache.sampler, cache.imageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+    VkDescriptorBufferInfo feedbackInfo{feedback.buffer, 0, sizeof(uint32_t) * pages.size()};
+    VkDescriptorBufferInfo paramsInfo{parameters.buffer, 0, sizeof(params)};
+
+    std::array<VkWriteDescriptorSet, 4> writes{};
+    for (uint32_t i = 0; i < writes.size(); i++)
+    {
+        writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].dstSet = set;
+        writes[i].dstBinding = i;
+        writes[i].descriptorType = descriptorTypes[i];
+        writes[i].descriptorCount = 1;
+    }
+    writes[0].pImageInfo = &tableInfo;
+    writes[1].pImageInfo = &cacheInfo;
+    writes[2].pBufferInfo = &feedbackInfo;
+    writes[3].pBufferInfo = &paramsInfo;
+    vkUpdateDescriptorSets(VulkanInstance::device, writes.size(), writes.data(), 0, nullptr);
+}
+
+void VirtualTexture::destroy()
+{
+    if (!stream.active())
+        return;
+    stream.destroy();
+    cache.retire();
+    pageTable.retire();
+    parameters.reset();
+    feedback.reset();
+    vkDestroyDescriptorPool(VulkanInstance::device, pool, nullptr);
+    vkDestroyDescriptorSetLayout(VulkanInstance::device, layout, nullptr);
+    pool = VK_NULL_HANDLE;
+    layout = VK_NULL_HANDLE;
+}
+
+void VirtualTexture::beginFeedback(VkCommandBuffer buffer, uint32_t frame)
+{
+    vkCmdFillBuffer(buffer, feedback.buffer, feedbackRegion * frame, feedbackRegion, 0);
+    VkBufferMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = feedback.buffer;
+    barrier.offset = feedbackRegion * frame;
+    barrier.size = feedbackRegion;
+    vkCmdPipelineBarrier(buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+}
+
+void VirtualTexture::endFeedback(VkCommandBuffer buffer, uint32_t frame)
+{
+    VkBufferMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = feedback.buffer;
+    barrier.offset = feedbackRegion * frame;
+    barrier.size = feedbackRegion;
+    vkCmdPipelineBarrier(buffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+}
+
+uint32_t VirtualTexture::parent(uint32_t page) const
+{
+    uint32_t level = pages[page].level;
+    if (level + 1 == header.levelCount)
+        return NONE;
+    uint32_t local = page - params.levels[level][0];
+    uint32_t x = local % params.levels[level][1];
+    uint32_t y = local / params.levels[level][1];
+    return params.levels[level + 1][0] + (y / 2) * params.levels[level + 1][1] + x / 2;
+}
+
+void VirtualTexture::unlink(uint32_t slot)
+{
+    if (!linked[slot])
+        return;
+    (lruPrev[slot] == NONE ? lruHead : lruNext[lruPrev[slot]]) = lruNext[slot];
+    (lruNext[slot] == NONE ? lruTail : lruPrev[lruNext[slot]]) = lruPrev[slot];
+    lruPrev[slot] = lruNext[slot] = NONE;
+    linked[slot] = false;
+}
+
+/* moves slot to the most recently used end */
+void VirtualTexture::touch(uint32_t slot)
+{
+    if (slot == 0)
+        return;
+    unlink(slot);
+    lruPrev[slot] = lruTail;
+    (lruTail == NONE ? lruHead : lruNext[lruTail]) = slot;
+    lruTail = slot;
+    linked[slot] = true;
+}
+
+/*
+ * A free slot, or the least recently requested one when nothing requested it this frame.
+ * Frames already submitted may still sample it, the upload waits for their fragment work.
+ */
+uint32_t VirtualTexture::takeSlot()
+{
+    if (!freeSlots.empty())
+    {
+        uint32_t slot = freeSlots.back();
+        freeSlots.pop_back();
+        return slot;
+    }
+    if (lruHead == NONE || pages[slotPages[lruHead]].lastUsed == frameCount)
+        return NONE;
+    uint32_t slot = lruHead;
+    unlink(slot);
+    Page &evicted = pages[slotPages[slot]];
+    evicted.state = ABSENT;
+    evicted.slot = NONE;
+    slotPages[slot] = NONE;
+    tableDirty = true;
+    return slot;
+}
+
+/* coarsest level first, a missing page points at the entry of its parent */
+void VirtualTexture::rebuildTable()
+{
+    for (int l = static_cast<int>(header.levelCount) - 1; l >= 0; l--)
+    {
+        const uint32_t *level = params.levels[l];
+        for (uint32_t y = 0; y < level[2]; y++)
+        {
+            for (uint32_t x = 0; x < level[1]; x++)
+            {
+                const Page &page = pages[level[0] + y * level[1] + x];
+                uint32_t entry;
+                if (page.state == RESIDENT)
+                    entry = (page.slot % cacheTiles) | (page.slot / cacheTiles) << 8 | static_cast<uint32_t>(l) << 16;
+                else
+                    entry = table[static_cast<size_t>(params.levels[l + 1][3] + y / 2) * tableWidth + x / 2];
+                table[static_cast<size_t>(level[3] + y) * tableWidth + x] = entry;
+            }
+        }
+    }
+    tableDirty = false;
+}
+
+void VirtualTexture::upload(uint32_t frame)
+{
+    std::vector<VkBufferImageCopy> copies;
+    stream.finish([&](const StreamReader::Load &load) {
+        Page &page = pages[load.id];
+        if (load.failed)
+        {
+            freeSlots.push_back(page.slot);
+            slotPages[page.slot] = NONE;
+            page.state = ABSENT;
+            page.slot = NONE;
+            return;
+        }
+        VkBufferImageCopy region{};
+        region.bufferOffset = tileBytes * load.staging;
+        region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+        region.imageOffset = {static_cast<int32_t>(page.slot % cacheTiles * slotSize), static_cast<int32_t>(page.slot / cacheTiles * slotSize), 0};
+        region.imageExtent = {slotSize, slotSize, 1};
+        copies.push_back(region);
+        page.state = RESIDENT;
+        touch(page.slot);
+        tableDirty = true;
+    });
+    if (copies.empty() && !tableDirty)
+        return;
+
+    std::vector<VkImageMemoryBarrier> toTransfer;
+    std::vector<VkImageMemoryBarrier> toShader;
+    if (!copies.empty())
+    {
+        toTransfer.push_back(layoutBarrier(cache.image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0, VK_ACCESS_TRANSFER_WRITE_BIT));
+        toShader.push_back(layoutBarrier(cache.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT));
+    }
+    VkBufferImageCopy tableCopy{};
+    if (tableDirty)
+    {
+        rebuildTable();
+        VkDeviceSize tableBytes = sizeof(uint32_t) * table.size();
+        tableCopy.bufferOffset = tileBytes * MAX_LOADS + tableBytes * frame;
+        tableCopy.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+        tableCopy.imageExtent = {tableWidth, tableRows, 1};
+        memcpy(static_cast<char *>(stream.staging.data) + tableCopy.bufferOffset, table.data(), tableBytes);
+        toTransfer.push_back(layoutBarrier(pageTable.image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0, VK_ACCESS_TRANSFER_WRITE_BIT));
+        toShader.push_back(layoutBarrier(pageTable.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT));
+    }
+
+    /* the fragment stage dependency orders the copies after frames still sampling evicted slots */
+    VkCommandBuffer cmdBuffer = RenderPipeline::beginSingleTimeCommands();
+    vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr,
+        static_cast<uint32_t>(toTransfer.size()), toTransfer.data());
+    if (!copies.empty())
+        vkCmdCopyBufferToImage(cmdBuffer, stream.staging.buffer, cache.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(copies.size()), copies.data());
+    if (tableCopy.imageExtent.width)
+        vkCmdCopyBufferToImage(cmdBuffer, stream.staging.buffer, pageTable.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &tableCopy);
+    vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr,
+        static_cast<uint32_t>(toShader.size()), toShader.data());
+    vkEndCommandBuffer(cmdBuffer);
+    DeletionQueue::retire([cmdBuffer]() { vkFreeCommandBuffers(VulkanInstance::device, RenderPipeline::commandPool, 1, &cmdBuffer); });
+    Syncobjects::submit(RenderPipeline::graphicsQueue, cmdBuffer, VK_NULL_HANDLE, 0, VK_NULL_HANDLE, VK_NULL_HANDLE);
+}
+
+void VirtualTexture::request(std::vector<uint32_t> &missing)
+{
+    /* coarse tiles first, they improve the fallback of every finer page below them */
+    std::stable_sort(missing.begin(), missing.end(), [this](uint32_t a, uint32_t b) { return pages[a].level > pages[b].level; });
+    for (uint32_t index : missing)
+    {
+        if (!stream.stagingFree())
+            break;
+        uint32_t slot = takeSlot();
+        if (slot == NONE)
+        {
+            if (!thrashWarned)
+                Log(Logger::warn) << "Virtual texture cache holds fewer tiles than one frame requests, raise --vt-cache";
+            thrashWarned = true;
+            break;
+        }
+        Page &page = pages[index];
+        page.state = LOADING;
+        page.slot = slot;
+        slotPages[slot] = index;
+
+        stream.start(index, sizeof(header) + tileBytes * index, tileBytes);
+    }
+}
+
+bool VirtualTexture::update(uint32_t frame)
+{
+    bool rewritten = stream.pressure() && shrink();
+    frameCount++;
+    const uint32_t *requested = reinterpret_cast<const uint32_t *>(static_cast<const char *>(feedback.data) + feedbackRegion * frame);
+    std::vector<uint32_t> missing;
+    for (uint32_t i = 0; i < pages.size(); i++)
+    {
+        if (!requested[i])
+            continue;
+        /* ancestors are the fallback while a page is missing, they stay and load first */
+        for (uint32_t index = i; index != NONE && pages[index].lastUsed != frameCount; index = parent(index))
+        {
+            Page &page = pages[index];
+            page.lastUsed = frameCount;
+            if (page.state == RESIDENT)
+                touch(page.slot);
+            else if (page.state == ABSENT)
+                missing.push_back(index);
+        }
+    }
+    upload(frame);
+    request(missing);
+    return rewritten;
+}
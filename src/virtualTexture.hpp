@@ -0,0 +1,145 @@
+#ifndef VIRTUALTEXTURE_HPP
+#define VIRTUALTEXTURE_HPP
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#ifndef MAX_FRAMES_IN_FLIGHT
+# define MAX_FRAMES_IN_FLIGHT 2
+#endif
+
+#include <string>
+#include <vector>
+#include "buffer.hpp"
+#include "image.hpp"
+#include "streamReader.hpp"
+
+/*
+ * Tiled texture file: header, then every tile of every level as RGBA8 with a border of
+ * BORDER texels copied from its neighbours. Levels are stored finest first, tiles row
+ * major, so a tile is found from its page index alone.
+ */
+struct VirtualTextureHeader
+{
+    char magic[4] = {'S', 'C', 'V', 'T'};
+    uint32_t version = 1;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    /* texels per tile side without the border */
+    uint32_t tileSize = 0;
+    uint32_t border = 0;
+    uint32_t levelCount = 0;
+    uint32_t tileCount = 0;
+};
+
+/* std140 block read by virtual.frag */
+struct VirtualTextureParams
+{
+    float size[2];
+    float tileSize;
+    float border;
+    float cacheSize[2];
+    uint32_t levelCount;
+    uint32_t padding;
+    /* per level: first page, pages per row, rows, first row in the page table */
+    uint32_t levels[16][4];
+};
+
+/*
+ * Software virtual texturing. A fixed size cache texture holds the resident tiles and
+ * a page table texture maps every page of every level to the cache tile used for it,
+ * which is the nearest resident ancestor while the page itself is missing. The
+ * fragment shader marks the pages it wants in a per frame feedback buffer, the host
+ * reads it once the frame finished, loads missing tiles on the job system and evicts
+ * the least recently requested ones when the cache is full. The coarsest level is a
+ * single tile that stays resident. The cache halves whenever device local memory comes
+ * under pressure.
+ */
+class VirtualTexture {
+public:
+    static constexpr uint32_t DEFAULT_TILE_SIZE = 128;
+    static constexpr uint32_t BORDER = 1;
+    static constexpr uint32_t MAX_LEVELS = 16;
+    /* tile reads in flight, also the size of the staging ring */
+    static constexpr uint32_t MAX_LOADS = 16;
+
+    /* set 1 of the pipeline layout, replaces the bindless array */
+    VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+    VkDescriptorPool pool = VK_NULL_HANDLE;
+    VkDescriptorSet set = VK_NULL_HANDLE;
+
+    /* builds the level chain of image and writes its tiles */
+    static void convert(const std::string &image, const std::string &path, uint32_t tileSize = DEFAULT_TILE_SIZE);
+
+    void init(const std::string &path, VkDeviceSize cacheBytes);
+    void destroy();
+    bool active() const { return stream.active(); };
+
+    /* dynamic offset of the feedback region written by frame */
+    uint32_t feedbackOffset(uint32_t frame) const { return static_cast<uint32_t>(feedbackRegion * frame); };
+    /* recorded outside the render pass, clears the frame's feedback before it and hands it to the host after */
+    void beginFeedback(VkCommandBuffer buffer, uint32_t frame);
+    void endFeedback(VkCommandBuffer buffer, uint32_t frame);
+    /*
+     * Once the frame slot finished: reads what it requested, uploads finished tiles
+     * together with the page table in one submit ahead of the next frame and starts reads.
+     * True when the descriptor set was rewritten, recorded command buffers are stale then.
+     */
+    bool update(uint32_t frame);
+
+private:
+    enum State : uint8_t { ABSENT, LOADING, RESIDENT };
+    static constexpr uint32_t NONE = UINT32_MAX;
+    struct Page
+    {
+        State state = ABSENT;
+        uint8_t level = 0;
+        uint32_t slot = NONE;
+        uint32_t lastUsed = 0;
+    };
+
+    StreamReader stream;
+    VirtualTextureHeader header;
+    VirtualTextureParams params{};
+    VkDeviceSize tileBytes = 0;
+    uint32_t slotSize = 0;
+    uint32_t cacheTiles = 0;
+
+    std::vector<Page> pages;
+    std::vector<uint32_t> slotPages;
+    /* least recently requested resident slot first, the pinned slot is never linked */
+    std::vector<uint32_t> lruPrev;
+    std::vector<uint32_t> lruNext;
+    std::vector<bool> linked;
+    uint32_t lruHead = NONE;
+    uint32_t lruTail = NONE;
+    std::vector<uint32_t> freeSlots;
+
+    Image cache{VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT};
+    Image pageTable{VK_FORMAT_R8G8B8A8_UINT, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT};
+    std::vector<uint32_t> table;
+    uint32_t tableWidth = 0;
+    uint32_t tableRows = 0;
+    bool tableDirty = false;
+
+    Buffer parameters;
+    Buffer feedback;
+    VkDeviceSize feedbackRegion = 0;
+    uint32_t frameCount = 0;
+    bool thrashWarned = false;
+
+    uint32_t parent(uint32_t page) const;
+    void touch(uint32_t slot);
+    void unlink(uint32_t slot);
+    uint32_t takeSlot();
+    void rebuildTable();
+    void makeCache();
+    /* false when the cache is down to two tiles a side */
+    bool shrink();
+    void makeDescriptors();
+    void writeDescriptors();
+    void upload(uint32_t frame);
+    void request(std::vector<uint32_t> &missing);
+};
+
+#endif
@@ -0,0 +1,25 @@
+#include "vkHandle.hpp"
+#include "Logger.hpp"
+
+template <typename Handle>
+static int64_t reportLeaked(const char *name)
+{
+    int64_t count = Handle::live.load(std::memory_order_relaxed);
+    if (count)
+        Log(Logger::warn) << count << " " << name << " still alive";
+    return count;
+}
+
+int64_t reportLeakedHandles()
+{
+    int64_t total = 0;
+    total += reportLeaked<BufferHandle>("VkBuffer");
+    total += reportLeaked<MemoryHandle>("VkDeviceMemory");
+    total += reportLeaked<ImageHandle>("VkImage");
+    total += reportLeaked<ImageViewHandle>("VkImageView");
+    total += reportLeaked<SamplerHandle>("VkSampler");
+    total += reportLeaked<PipelineHandle>("VkPipeline");
+    total += reportLeaked<PipelineLayoutHandle>("VkPipelineLayout");
+    total += reportLeaked<FramebufferHandle>("VkFramebuffer");
+    return total;
+}
@@ -0,0 +1,77 @@
+#ifndef VKHANDLE_HPP
+#define VKHANDLE_HPP
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+#include <atomic>
+#include <cstdint>
+#include "Vulkan.hpp"
+#include "deletionQueue.hpp"
+#include "gpuMemory.hpp"
+
+/*
+ * Move-only owner of a non-dispatchable Vulkan handle.
+ * Releasing the handle retires it through the DeletionQueue so it is destroyed once
+ * the frames that may reference it have finished, it never waits on the GPU.
+ */
+template <typename T, void (VKAPI_PTR *Destroy)(VkDevice, T, const VkAllocationCallbacks *)>
+class VkHandle {
+private:
+    T handle = VK_NULL_HANDLE;
+
+public:
+    /* handles created and not yet destroyed, checked at shutdown */
+    inline static std::atomic<int64_t> live{0};
+
+    VkHandle() = default;
+    explicit VkHandle(T raw) : handle(raw)
+    {
+        if (handle != VK_NULL_HANDLE)
+            live.fetch_add(1, std::memory_order_relaxed);
+    }
+    ~VkHandle() { reset(); }
+
+    VkHandle(const VkHandle &) = delete;
+    VkHandle &operator=(const VkHandle &) = delete;
+    VkHandle(VkHandle &&other) noexcept : handle(other.handle) { other.handle = VK_NULL_HANDLE; }
+    VkHandle &operator=(VkHandle &&other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            handle = other.handle;
+            other.handle = VK_NULL_HANDLE;
+        }
+        return *this;
+    }
+
+    operator T() const { return handle; }
+    T get() const { return handle; }
+    const T *ptr() const { return &handle; }
+
+    void reset()
+    {
+        if (handle == VK_NULL_HANDLE)
+            return;
+        T raw = handle;
+        handle = VK_NULL_HANDLE;
+        DeletionQueue::retire([raw]() {
+            Destroy(VulkanInstance::device, raw, nullptr);
+            live.fetch_sub(1, std::memory_order_relaxed);
+        });
+    }
+};
+
+using BufferHandle = VkHandle<VkBuffer, vkDestroyBuffer>;
+using MemoryHandle = VkHandle<VkDeviceMemory, GpuMemory::free>;
+using ImageHandle = VkHandle<VkImage, vkDestroyImage>;
+using ImageViewHandle = VkHandle<VkImageView, vkDestroyImageView>;
+using SamplerHandle = VkHandle<VkSampler, vkDestroySampler>;
+using PipelineHandle = VkHandle<VkPipeline, vkDestroyPipeline>;
+using PipelineLayoutHandle = VkHandle<VkPipelineLayout, vkDestroyPipelineLayout>;
+using FramebufferHandle = VkHandle<VkFramebuffer, vkDestroyFramebuffer>;
+
+/* logs every handle type that still has live objects, returns the total */
+int64_t reportLeakedHandles();
+
+#endif
@@ -11,8 +11,9 @@ void Window::init()
     glfwSetFramebufferSizeCallback(win, framebufferResizeCallback);
 }
 
-static void framebufferResizeCallback(GLFWwindow *win, int height, int width)
+static void framebufferResizeCallback(GLFWwindow *win, int width, int height)
 {
-    auto app = reinterpret_cast<App *>(glfwGetWindowUserPointer(win));
-    app->frameResize = true;
+    auto window = reinterpret_cast<Window *>(glfwGetWindowUserPointer(win));
+    if (window->onResize)
+        window->onResize(width, height);
 }
\ No newline at end of file
@@ -3,16 +3,19 @@
 
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
+#include <functional>
 
 #define WIDTH 1000
 #define HEIGHT 1000
 
-static void framebufferResizeCallback(GLFWwindow * win, int height, int width);
+static void framebufferResizeCallback(GLFWwindow * win, int width, int height);
 
 class Window {
 public:
     void init();
     inline static GLFWwindow *win;
+    /* called on the main thread with the new framebuffer size */
+    std::function<void(int width, int height)> onResize;
 };
 
 #endif
\ No newline at end of file